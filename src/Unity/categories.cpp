@@ -22,14 +22,17 @@
 #include "categories.h"
 
 // local
+#include "tracing.h"
 #include "utils.h"
 
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonValue>
 #include <QJsonParseError>
 #include <QHash>
 #include <QDebug>
+#include <QMutex>
 #include <QPointer>
 
 #include <unity/scopes/CategoryRenderer.h>
@@ -43,10 +46,56 @@ const int MAX_NUMBER_OF_CATEGORIES = 32; // when reached, any excess categories
 // FIXME: this should be in a common place
 #define CATEGORY_JSON_DEFAULTS R"({"schema-version":1,"template": {"category-layout":"grid","card-layout":"vertical","card-size":"small","overlay-mode":null,"collapsed-rows":2}, "components": { "title":null, "art": { "aspect-ratio":1.0 }, "subtitle":null, "social-actions":null, "mascot":null, "emblem":null, "summary":null, "attributes": { "max-count":2 }, "background":null, "overlay-color":null }, "resources":{}})"
 
+const int MAX_CACHED_TEMPLATES = 128;
+
+// merged renderer template and everything derived from it, shared by all the categories using the same raw template
+struct CategoryTemplate
+{
+    QJsonValue renderer;
+    QJsonValue components;
+    quint64 rendererHash;
+    quint64 componentsHash;
+    QHash<QString, QString> componentsMapping;
+    int maxAttributes;
+};
+
+namespace
+{
+
+const quint64 FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const quint64 FNV_PRIME = 1099511628211ULL;
+
+// FNV-1a; every field is terminated so that adjacent fields can't run into each other
+quint64 hashField(quint64 hash, char const* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= FNV_PRIME;
+    }
+    hash ^= 0xff;
+    hash *= FNV_PRIME;
+    return hash;
+}
+
+quint64 hashField(quint64 hash, std::string const& field)
+{
+    return hashField(hash, field.data(), field.size());
+}
+
+quint64 hashJson(QJsonValue const& value)
+{
+    const QByteArray json(QJsonDocument(QJsonArray() << value).toJson(QJsonDocument::Compact));
+    return hashField(FNV_OFFSET_BASIS, json.constData(), json.size());
+}
+
+}
+
+static QSharedPointer<const CategoryTemplate> cachedTemplate(std::string const& raw_template);
+
 class CategoryData
 {
 public:
-    CategoryData(scopes::Category::SCPtr const& category)
+    CategoryData(scopes::Category::SCPtr const& category): m_contentHash(0), m_templateOverridden(false), m_rendererHash(0), m_componentsHash(0), m_maxAttributes(2)
     {
         setCategory(category);
     }
@@ -57,8 +106,11 @@ public:
     {
         m_category = category;
         m_rawTemplate = category->renderer_template().data();
+        m_queryUri = queryUri(*category);
+        m_contentHash = contentHash(*category, m_queryUri, m_rawTemplate);
+        m_templateOverridden = false;
 
-        parseTemplate(m_rawTemplate, &m_rendererTemplate, &m_components);
+        setTemplate(cachedTemplate(m_rawTemplate));
     }
 
     QString categoryId() const
@@ -82,7 +134,7 @@ public:
     QString headerLink() const
     {
         return m_category && m_category->query() ?
-            QString::fromStdString(m_category->query()->to_uri()) : QString();
+            QString::fromStdString(m_queryUri) : QString();
     }
 
     std::string rawTemplate() const
@@ -92,13 +144,12 @@ public:
 
     bool overrideTemplate(std::string const& raw_template)
     {
-        QJsonValue components;
-        QJsonValue renderer;
-
-        if (parseTemplate(raw_template, &renderer, &components)) {
+        auto parsed = cachedTemplate(raw_template);
+        if (parsed) {
             m_rawTemplate = raw_template;
-            m_rendererTemplate = renderer;
-            m_components = components;
+            m_contentHash = contentHash(*m_category, m_queryUri, m_rawTemplate);
+            m_templateOverridden = true;
+            setTemplate(parsed);
             return true;
         }
 
@@ -116,9 +167,19 @@ public:
     }
 
     QHash<QString, QString> getComponentsMapping() const
+    {
+        return m_componentsMapping;
+    }
+
+    int getMaxAttributes() const
+    {
+        return m_maxAttributes;
+    }
+
+    static QHash<QString, QString> componentsMapping(QJsonValue const& components)
     {
         QHash<QString, QString> result;
-        QJsonObject components_dict = m_components.toObject();
+        QJsonObject components_dict = components.toObject();
         for (auto it = components_dict.begin(); it != components_dict.end(); ++it) {
             if (it.value().isObject() == false) continue;
             QJsonObject component_dict(it.value().toObject());
@@ -130,9 +191,9 @@ public:
         return result;
     }
 
-    int getMaxAttributes() const
+    static int maxAttributes(QJsonValue const& components)
     {
-        QJsonObject components_obj = m_components.toObject();
+        QJsonObject components_obj = components.toObject();
         QJsonObject attrs_obj = components_obj.value(QStringLiteral("attributes")).toObject();
         QJsonValue max_count_val = attrs_obj.value(QStringLiteral("max-count"));
 
@@ -143,39 +204,52 @@ public:
     {
         QVector<int> roles;
 
-        if (category->title() != m_category->title()) {
-            roles.append(Categories::RoleName);
+        // the same object is re-registered when cached results are shown again
+        if (category == m_category && !m_templateOverridden) {
+            return roles;
         }
-        if (category->icon() != m_category->icon()) {
-            roles.append(Categories::RoleIcon);
+
+        const bool titleChanged = category->title() != m_category->title();
+        const bool iconChanged = category->icon() != m_category->icon();
+
+        FULL_COMPARES++;
+        const std::string newQuery(queryUri(*category));
+        const std::string newTemplate(category->renderer_template().data());
+        const quint64 newHash = contentHash(*category, newQuery, newTemplate);
+        // nothing changed, which is the common case when re-registering categories on every search;
+        // the hash can collide, so it only tells when a field comparison is needed
+        if (!titleChanged && !iconChanged && newHash == m_contentHash && newQuery == m_queryUri && newTemplate == m_rawTemplate) {
+            m_category = category;
+            return roles;
         }
-        std::string oldQuery;
-        std::string newQuery;
-        if (m_category->query()) {
-            oldQuery = m_category->query()->to_uri();
+
+        if (titleChanged) {
+            roles.append(Categories::RoleName);
         }
-        if (category->query()) {
-            newQuery = category->query()->to_uri();
+        if (iconChanged) {
+            roles.append(Categories::RoleIcon);
         }
-        if (oldQuery != newQuery) {
+        if (newQuery != m_queryUri) {
             roles.append(Categories::RoleHeaderLink);
         }
-        if (category->renderer_template().data() != m_rawTemplate) {
+        if (newTemplate != m_rawTemplate) {
             roles.append(Categories::RoleRawRendererTemplate);
 
-            QJsonValue old_renderer(m_rendererTemplate);
-            QJsonValue old_components(m_components);
+            const quint64 oldRendererHash = m_rendererHash;
+            const quint64 oldComponentsHash = m_componentsHash;
 
             setCategory(category);
 
-            if (m_rendererTemplate != old_renderer) {
+            if (m_rendererHash != oldRendererHash) {
                 roles.append(Categories::RoleRenderer);
             }
-            if (m_components != old_components) {
+            if (m_componentsHash != oldComponentsHash) {
                 roles.append(Categories::RoleComponents);
             }
         } else {
-            setCategory(category);
+            m_category = category;
+            m_queryUri = newQuery;
+            m_contentHash = newHash;
         }
 
         return roles;
@@ -238,17 +312,53 @@ public:
     }
 
     scopes::Category::SCPtr m_category;
+    static quint64 FULL_COMPARES;
 private:
     static QJsonValue* DEFAULTS;
     QString m_catId;
     QString m_catTitle;
     QString m_catIcon;
     std::string m_rawTemplate;
+    std::string m_queryUri;
+    quint64 m_contentHash; // id, title, icon, query and template
+    bool m_templateOverridden;
     QJsonValue m_rendererTemplate;
     QJsonValue m_components;
+    quint64 m_rendererHash;
+    quint64 m_componentsHash;
+    QHash<QString, QString> m_componentsMapping;
+    int m_maxAttributes;
     QSharedPointer<ResultsModel> m_resultsModel;
     QPointer<QObject> m_countObject;
 
+    void setTemplate(QSharedPointer<const CategoryTemplate> const& parsed)
+    {
+        // keep the previous template if the new one is invalid
+        if (parsed) {
+            m_rendererTemplate = parsed->renderer;
+            m_components = parsed->components;
+            m_rendererHash = parsed->rendererHash;
+            m_componentsHash = parsed->componentsHash;
+            m_componentsMapping = parsed->componentsMapping;
+            m_maxAttributes = parsed->maxAttributes;
+        }
+    }
+
+    static std::string queryUri(scopes::Category const& category)
+    {
+        return category.query() ? category.query()->to_uri() : std::string();
+    }
+
+    static quint64 contentHash(scopes::Category const& category, std::string const& queryUri, std::string const& rawTemplate)
+    {
+        quint64 hash = FNV_OFFSET_BASIS;
+        hash = hashField(hash, category.id());
+        hash = hashField(hash, category.title());
+        hash = hashField(hash, category.icon());
+        hash = hashField(hash, queryUri);
+        return hashField(hash, rawTemplate);
+    }
+
     static QJsonValue mergeOverrides(QJsonValue const& defaultVal, QJsonValue const& overrideVal)
     {
         if (overrideVal.isObject() && defaultVal.isObject()) {
@@ -284,6 +394,59 @@ private:
 };
 
 QJsonValue* CategoryData::DEFAULTS = nullptr;
+quint64 CategoryData::FULL_COMPARES = 0;
+
+namespace
+{
+
+struct TemplateCache
+{
+    TemplateCache(): hits(0), misses(0) {}
+
+    QMutex mutex;
+    QHash<QByteArray, QSharedPointer<const CategoryTemplate>> templates; // raw template -> parsed template, null if invalid
+    quint64 hits;
+    quint64 misses;
+};
+
+TemplateCache& templateCache()
+{
+    static TemplateCache cache;
+    return cache;
+}
+
+}
+
+// most scopes use a handful of templates over and over, so they're only parsed and merged once per process
+static QSharedPointer<const CategoryTemplate> cachedTemplate(std::string const& raw_template)
+{
+    TemplateCache& cache = templateCache();
+    const QByteArray key(raw_template.data(), static_cast<int>(raw_template.size()));
+
+    QMutexLocker lock(&cache.mutex);
+    auto it = cache.templates.constFind(key);
+    if (it != cache.templates.constEnd()) {
+        cache.hits++;
+        return it.value();
+    }
+    cache.misses++;
+
+    QSharedPointer<CategoryTemplate> parsed(new CategoryTemplate);
+    if (CategoryData::parseTemplate(raw_template, &parsed->renderer, &parsed->components)) {
+        parsed->rendererHash = hashJson(parsed->renderer);
+        parsed->componentsHash = hashJson(parsed->components);
+        parsed->componentsMapping = CategoryData::componentsMapping(parsed->components);
+        parsed->maxAttributes = CategoryData::maxAttributes(parsed->components);
+    } else {
+        parsed.reset();
+    }
+
+    if (cache.templates.size() >= MAX_CACHED_TEMPLATES) {
+        cache.templates.clear();
+    }
+    cache.templates.insert(key, parsed);
+    return parsed;
+}
 
 Categories::Categories(QObject* parent)
     : unity::shell::scopes::CategoriesInterface(parent),
@@ -294,6 +457,8 @@ Categories::Categories(QObject* parent)
 Categories::~Categories()
 {
     m_categories.clear();
+    m_categoryRows.clear();
+    m_modelRows.clear();
     m_categoryResults.clear();
 }
 
@@ -306,19 +471,58 @@ int Categories::rowCount(const QModelIndex& parent) const
 
 QSharedPointer<ResultsModel> Categories::lookupCategory(std::string const& category_id)
 {
-    return m_categoryResults[category_id];
+    auto it = m_categoryResults.find(category_id);
+    return it != m_categoryResults.end() ? it->second : QSharedPointer<ResultsModel>();
 }
 
 int Categories::getCategoryIndex(QString const& categoryId) const
 {
-    // there shouldn't be too many categories, linear search should be fine
-    for (int i = 0; i < m_categories.size(); i++) {
-        if (m_categories[i]->categoryId() == categoryId) {
-            return i;
+    return m_categoryRows.value(categoryId, -1);
+}
+
+int Categories::getCategoryIndex(ResultsModel const* resultsModel) const
+{
+    return m_modelRows.value(resultsModel, -1);
+}
+
+void Categories::insertCategory(int row, QSharedPointer<CategoryData> const& catData)
+{
+    m_categories.insert(row, catData);
+    reindexCategories(row);
+}
+
+QSharedPointer<CategoryData> Categories::takeCategory(int row)
+{
+    QSharedPointer<CategoryData> catData(m_categories.takeAt(row));
+    m_categoryRows.remove(catData->categoryId());
+    m_modelRows.remove(catData->resultsModel().data());
+    reindexCategories(row);
+    return catData;
+}
+
+// rows from 'from' onwards have shifted, update their index entries
+void Categories::reindexCategories(int from)
+{
+    for (int i = from; i < m_categories.size(); i++) {
+        auto const& catData = m_categories[i];
+        m_categoryRows[catData->categoryId()] = i;
+        if (catData->resultsModel()) {
+            m_modelRows[catData->resultsModel().data()] = i;
         }
     }
+    checkIndex();
+}
 
-    return -1;
+void Categories::checkIndex() const
+{
+#ifndef QT_NO_DEBUG
+    Q_ASSERT(m_categoryRows.size() == m_categories.size());
+    for (int i = 0; i < m_categories.size(); i++) {
+        auto const& catData = m_categories[i];
+        Q_ASSERT(m_categoryRows.value(catData->categoryId(), -1) == i);
+        Q_ASSERT(!catData->resultsModel() || m_modelRows.value(catData->resultsModel().data(), -1) == i);
+    }
+#endif
 }
 
 void Categories::registerCategory(const scopes::Category::SCPtr& category, QSharedPointer<ResultsModel> resultsModel)
@@ -337,7 +541,7 @@ void Categories::registerCategory(const scopes::Category::SCPtr& category, QShar
             QSharedPointer<CategoryData> catData;
             // we could do real move, but the view doesn't like it much
             beginRemoveRows(QModelIndex(), index, index);
-            catData = m_categories.takeAt(index);
+            catData = takeCategory(index);
             endRemoveRows();
 
             // check if any attributes of the category changed
@@ -350,7 +554,7 @@ void Categories::registerCategory(const scopes::Category::SCPtr& category, QShar
                 }
             }
             beginInsertRows(QModelIndex(), emptyIndex, emptyIndex);
-            m_categories.insert(emptyIndex, catData);
+            insertCategory(emptyIndex, catData);
             endInsertRows();
         } else {
             // the category has already been registered for current search,
@@ -377,7 +581,7 @@ void Categories::registerCategory(const scopes::Category::SCPtr& category, QShar
 
         beginInsertRows(QModelIndex(), emptyIndex, emptyIndex);
 
-        m_categories.insert(emptyIndex, catData);
+        insertCategory(emptyIndex, catData);
         resultsModel->setCategoryId(QString::fromStdString(category->id()));
         resultsModel->setComponentsMapping(catData->getComponentsMapping());
         resultsModel->setMaxAtrributesCount(catData->getMaxAttributes());
@@ -389,19 +593,20 @@ void Categories::registerCategory(const scopes::Category::SCPtr& category, QShar
     if (m_categories.count() >= MAX_NUMBER_OF_CATEGORIES) {
         // we register one category at a time, so there can be one excess category at most
         const int index = m_categories.count() - 1;
-        auto it = m_categories.begin() + index;
-        if ((*it)->resultsModelCount() == 0) {
-            qDebug() << "Purging unused category:" << (*it)->categoryId();
+        QSharedPointer<CategoryData> catData = m_categories[index];
+        if (catData->resultsModelCount() == 0) {
+            const QString categoryId(catData->categoryId());
+            qDebug() << "Purging unused category:" << categoryId;
             beginRemoveRows(QModelIndex(), index, index);
-            m_categoryResults.remove((*it)->categoryId().toStdString());
+            m_categoryResults.erase(categoryId.toStdString());
             for (auto kv = m_countObjects.begin(); kv != m_countObjects.end(); ++kv) {
-                if (kv.value() == (*it)->categoryId()) {
+                if (kv.value() == categoryId) {
                     kv.key()->deleteLater();
                     m_countObjects.erase(kv);
                     break;
                 }
             }
-            m_categories.erase(it);
+            takeCategory(index);
             endRemoveRows();
         }
     }
@@ -409,13 +614,7 @@ void Categories::registerCategory(const scopes::Category::SCPtr& category, QShar
 
 void Categories::updateResultCount(const QSharedPointer<ResultsModel>& resultsModel)
 {
-    int idx = -1;
-    for (int i = 0; i < m_categories.count(); i++) {
-        if (m_categories[i]->resultsModel() == resultsModel) {
-            idx = i;
-            break;
-        }
-    }
+    const int idx = getCategoryIndex(resultsModel.data());
     if (idx < 0) {
         qWarning("unable to update results counts");
         return;
@@ -432,8 +631,8 @@ void Categories::clearAll()
 {
     if (m_categories.count() == 0) return;
 
-    Q_FOREACH(QSharedPointer<ResultsModel> model, m_categoryResults) {
-        model->clearResults();
+    for (auto const& kv: m_categoryResults) {
+        kv.second->clearResults();
     }
 
     QModelIndex changeStart(index(0));
@@ -447,22 +646,31 @@ void Categories::markNewSearch()
 {
     m_categoryIndex = 0;
     m_registeredCategories.clear();
-    for (auto model: m_categoryResults) {
-        model->markNewSearch();
+    for (auto const& kv: m_categoryResults) {
+        kv.second->markNewSearch();
+    }
+}
+
+QSharedPointer<ResultsModel> Categories::resultsModelAt(int row) const
+{
+    if (row < 0 || row >= m_categories.size()) {
+        return QSharedPointer<ResultsModel>();
     }
+    return m_categories[row]->resultsModel();
 }
 
 void Categories::purgeResults()
 {
+    TraceSpan trace("search", "purgeResults");
     QVector<int> roles;
     roles.append(RoleCount);
 
-    for (auto it = m_categoryResults.begin(); it != m_categoryResults.end(); it++) {
-        auto model = it.value();
+    for (auto const& kv: m_categoryResults) {
+        auto const& model = kv.second;
         if (model->needsPurging()) {
             model->clearResults();
 
-            QModelIndex idx(index(getCategoryIndex(QString::fromStdString(it.key()))));
+            QModelIndex idx(index(getCategoryIndex(model.data())));
             Q_EMIT dataChanged(idx, idx, roles);
         }
     }
@@ -470,7 +678,32 @@ void Categories::purgeResults()
 
 bool Categories::parseTemplate(std::string const& raw_template, QJsonValue* renderer, QJsonValue* components)
 {
-    return CategoryData::parseTemplate(raw_template, renderer, components);
+    auto parsed = cachedTemplate(raw_template);
+    if (!parsed) {
+        return false;
+    }
+    *renderer = parsed->renderer;
+    *components = parsed->components;
+    return true;
+}
+
+quint64 Categories::templateCacheHits()
+{
+    TemplateCache& cache = templateCache();
+    QMutexLocker lock(&cache.mutex);
+    return cache.hits;
+}
+
+quint64 Categories::templateCacheMisses()
+{
+    TemplateCache& cache = templateCache();
+    QMutexLocker lock(&cache.mutex);
+    return cache.misses;
+}
+
+quint64 Categories::fullCategoryCompares()
+{
+    return CategoryData::FULL_COMPARES;
 }
 
 bool Categories::overrideCategoryJson(QString const& categoryId, QString const& json)
@@ -518,11 +751,10 @@ void Categories::countChanged()
 void Categories::updateResult(unity::scopes::Result const& result, QString const& categoryId, unity::scopes::Result const& updated_result)
 {
     qDebug() << "Categories::updateResult(): update result with uri" << QString::fromStdString(result.uri()) << ", category id" << categoryId;
-    for (auto catData: m_categories) {
-        if (catData->categoryId() == categoryId) {
-            catData->resultsModel()->updateResult(result, updated_result);
-            return;
-        }
+    const int idx = getCategoryIndex(categoryId);
+    if (idx >= 0 && m_categories[idx]->resultsModel()) {
+        m_categories[idx]->resultsModel()->updateResult(result, updated_result);
+        return;
     }
     qWarning() << "Categories::updateResult(): no category with id" << categoryId;
 }
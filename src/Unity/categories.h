@@ -25,8 +25,10 @@
 #include <unity/shell/scopes/CategoriesInterface.h>
 
 #include <QSharedPointer>
+#include <QHash>
 #include <QJsonValue>
 #include <set>
+#include <unordered_map>
 
 #include <unity/scopes/Category.h>
 
@@ -58,6 +60,7 @@ public:
     Q_INVOKABLE bool overrideCategoryJson(QString const& categoryId, QString const& json) override;
 
     QSharedPointer<ResultsModel> lookupCategory(std::string const& category_id);
+    QSharedPointer<ResultsModel> resultsModelAt(int row) const;
     void registerCategory(const unity::scopes::Category::SCPtr& category, QSharedPointer<ResultsModel> model);
     void updateResultCount(const QSharedPointer<ResultsModel>& resultsModel);
     void clearAll();
@@ -66,15 +69,26 @@ public:
     void updateResult(unity::scopes::Result const& result, QString const& categoryId, unity::scopes::Result const& updated_result);
 
     static bool parseTemplate(std::string const& raw_template, QJsonValue* renderer, QJsonValue* components);
+    static quint64 templateCacheHits();
+    static quint64 templateCacheMisses();
+    // re-registrations that had to look at the query and renderer template
+    static quint64 fullCategoryCompares();
 
 private Q_SLOTS:
     void countChanged();
 
 private:
     int getCategoryIndex(QString const& categoryId) const;
+    int getCategoryIndex(ResultsModel const* resultsModel) const;
+    void insertCategory(int row, QSharedPointer<CategoryData> const& catData);
+    QSharedPointer<CategoryData> takeCategory(int row);
+    void reindexCategories(int from);
+    void checkIndex() const;
 
     QList<QSharedPointer<CategoryData>> m_categories;
-    QMap<std::string, QSharedPointer<ResultsModel>> m_categoryResults;
+    QHash<QString, int> m_categoryRows; // category id -> row in m_categories
+    QHash<ResultsModel const*, int> m_modelRows; // results model -> row in m_categories
+    std::unordered_map<std::string, QSharedPointer<ResultsModel>> m_categoryResults;
     QMap<QObject*, QString> m_countObjects;
     std::set<std::string> m_registeredCategories;
     int m_categoryIndex;
@@ -21,6 +21,8 @@
 #include "collectors.h"
 
 // local
+#include "resultqueue.h"
+#include "resultsmap.h"
 #include "utils.h"
 
 // Qt
@@ -102,11 +104,8 @@ bool CollectorBase::submit(Status status)
 {
     QMutexLocker locker(&m_mutex);
     if (m_status == Status::INCOMPLETE) m_status = status;
-    if (m_posted) return false;
 
-    m_posted = true;
-
-    return true;
+    return !m_posted.exchange(true);
 }
 
 void CollectorBase::invalidate()
@@ -128,12 +127,12 @@ public:
     }
 
     // Returns bool indicating whether this resultset was already posted
+    // (lock-free, called from the runtime threads for every result)
     bool addResult(scopes::CategorisedResult::SPtr const& result)
     {
-        QMutexLocker locker(&m_mutex);
-        m_results.append(result);
+        m_results.push(result);
 
-        return m_posted;
+        return m_posted.load();
     }
 
     void setDepartment(scopes::Department::SCPtr const& department)
@@ -148,17 +147,19 @@ public:
         m_filters.append(filter);
     }
 
-    Status collect(QList<scopes::CategorisedResult::SPtr>& out_results, scopes::Department::SCPtr& out_rootDepartment, QList<scopes::FilterBase::SCPtr>& out_filters)
+    Status collect(QVector<scopes::CategorisedResult::SPtr>& out_results, scopes::Department::SCPtr& out_rootDepartment, QList<scopes::FilterBase::SCPtr>& out_filters)
     {
         Status status;
 
         QMutexLocker locker(&m_mutex);
         if (m_status == Status::INCOMPLETE) {
             // allow re-posting this collector if !resultset.finished()
+            // must happen before draining the queue: any producer which still
+            // sees m_posted == true has its result in the queue already
             m_posted = false;
         }
         status = m_status;
-        m_results.swap(out_results);
+        m_results.takeAll(out_results);
         out_rootDepartment = m_rootDepartment;
 
         out_filters = m_filters;
@@ -167,7 +168,7 @@ public:
     }
 
 private:
-    QList<scopes::CategorisedResult::SPtr> m_results;
+    ResultQueue<scopes::CategorisedResult::SPtr> m_results;
     scopes::Department::SCPtr m_rootDepartment;
     QList<scopes::FilterBase::SCPtr> m_filters;
 };
@@ -284,7 +285,7 @@ qint64 PushEvent::msecsSinceStart() const
     return m_collector->msecsSinceStart();
 }
 
-CollectorBase::Status PushEvent::collectSearchResults(QList<scopes::CategorisedResult::SPtr>& out_results, scopes::Department::SCPtr& rootDepartment,
+CollectorBase::Status PushEvent::collectSearchResults(QVector<scopes::CategorisedResult::SPtr>& out_results, scopes::Department::SCPtr& rootDepartment,
         QList<scopes::FilterBase::SCPtr>& out_filters)
 {
     auto collector = std::dynamic_pointer_cast<SearchDataCollector>(m_collector);
@@ -337,7 +338,7 @@ SearchResultReceiver::SearchResultReceiver(QObject* receiver):
 // this will be called from non-main thread, (might even be multiple different threads)
 void SearchResultReceiver::push(scopes::CategorisedResult result)
 {
-    auto res = std::make_shared<scopes::CategorisedResult>(std::move(result));
+    std::shared_ptr<scopes::CategorisedResult> res = std::make_shared<FingerprintedResult>(std::move(result));
     bool posted = m_collector->addResult(res);
     // posting as soon as possible means we minimize delay
     if (!posted) {
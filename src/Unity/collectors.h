@@ -25,6 +25,9 @@
 #include <QEvent>
 #include <QMutex>
 #include <QElapsedTimer>
+#include <QVector>
+
+#include <atomic>
 
 #include <unity/scopes/ActivationListenerBase.h>
 #include <unity/scopes/ActivationResponse.h>
@@ -44,7 +47,7 @@ class SearchDataCollector;
 class PreviewDataCollector;
 class ActivationCollector;
 
-class CollectorBase
+class Q_DECL_EXPORT CollectorBase
 {
 public:
     enum Status { UNKNOWN, INCOMPLETE, FINISHED, CANCELLED, NO_INTERNET, NO_LOCATION_DATA };
@@ -59,14 +62,14 @@ public:
 protected:
     QMutex m_mutex;
     Status m_status;
-    bool m_posted;
+    std::atomic<bool> m_posted;
 
 private:
     // not locked
     QElapsedTimer m_timer;
 };
 
-class PushEvent: public QEvent
+class Q_DECL_EXPORT PushEvent: public QEvent
 {
 public:
     static const QEvent::Type eventType;
@@ -76,7 +79,7 @@ public:
     PushEvent(Type event_type, const std::shared_ptr<CollectorBase>& collector);
     Type type();
 
-    CollectorBase::Status collectSearchResults(QList<std::shared_ptr<unity::scopes::CategorisedResult>>& out_results, unity::scopes::Department::SCPtr&
+    CollectorBase::Status collectSearchResults(QVector<std::shared_ptr<unity::scopes::CategorisedResult>>& out_results, unity::scopes::Department::SCPtr&
             out_rootDepartment, QList<unity::scopes::FilterBase::SCPtr>& out_filters);
     CollectorBase::Status collectPreviewData(unity::scopes::ColumnLayoutList& out_columns, unity::scopes::PreviewWidgetList& out_widgets, QHash<QString, QVariant>& out_data);
     CollectorBase::Status collectActivationResponse(std::shared_ptr<unity::scopes::ActivationResponse>& out_response, std::shared_ptr<unity::scopes::Result>&
@@ -89,7 +92,7 @@ private:
     std::shared_ptr<CollectorBase> m_collector;
 };
 
-class ScopeDataReceiverBase
+class Q_DECL_EXPORT ScopeDataReceiverBase
 {
 public:
     ScopeDataReceiverBase(QObject* receiver, PushEvent::Type push_type, std::shared_ptr<CollectorBase> const& collector);
@@ -105,7 +108,7 @@ private:
     std::shared_ptr<CollectorBase> m_collector;
 };
 
-class SearchResultReceiver: public unity::scopes::SearchListenerBase, public ScopeDataReceiverBase
+class Q_DECL_EXPORT SearchResultReceiver: public unity::scopes::SearchListenerBase, public ScopeDataReceiverBase
 {
 public:
     virtual void push(unity::scopes::CategorisedResult result) override;
@@ -224,11 +224,11 @@ void Filters::update(QList<unity::scopes::FilterBase::SCPtr> const& filters, boo
                 return createFilterObject(f);
             },
             // filter update function
-            [this](int, const FilterWrapper::SCPtr &f1, const QSharedPointer<unity::shell::scopes::FilterBaseInterface>& f2) -> bool {
+            [this](const FilterWrapper::SCPtr &f1, const QSharedPointer<unity::shell::scopes::FilterBaseInterface>& f2, QVector<int>&) -> UpdateResult {
                 qDebug() << "Updating filter" << f2->filterId();
                 if (f2->filterId() != QString::fromStdString(f1->id()) || f2->filterType() != getFilterType(f1))
                 {
-                    return false;
+                    return Recreate;
                 }
                 auto shellFilter = dynamic_cast<FilterUpdateInterface*>(f2.data());
                 if (shellFilter) {
@@ -237,7 +237,8 @@ void Filters::update(QList<unity::scopes::FilterBase::SCPtr> const& filters, boo
                     // this should never happen
                     qCritical() << "Failed to cast filter" << f2->filterId() << "to FilterUpdateInterface";
                 }
-                return true;
+                // filter objects notify about their own property changes
+                return Unchanged;
             });
 }
 
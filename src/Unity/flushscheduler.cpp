@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "flushscheduler.h"
+
+#include <QDebug>
+#include <QStringList>
+
+#include <algorithm>
+
+namespace scopes_ng
+{
+
+FlushScheduler::~FlushScheduler()
+{
+}
+
+void FlushScheduler::flushed()
+{
+}
+
+FlushScheduler::Ptr FlushScheduler::create(QString const& policy)
+{
+    if (policy == QLatin1String("adaptive")) {
+        return Ptr(new AdaptiveFlushScheduler);
+    }
+    if (!policy.isEmpty() && policy != QLatin1String("delay")) {
+        qWarning() << "Unknown flush policy" << policy << ", using the default one";
+    }
+    return Ptr(new DelayFlushScheduler);
+}
+
+QString FlushScheduler::policyForScope(QString const& scopeId, QByteArray const& config)
+{
+    QString policy;
+    for (QString const& entry: QString::fromUtf8(config).split(QLatin1Char(','), QString::SkipEmptyParts)) {
+        const int sep = entry.indexOf(QLatin1Char('='));
+        if (sep < 0) {
+            if (policy.isEmpty()) {
+                policy = entry.trimmed();
+            }
+        } else if (entry.left(sep).trimmed() == scopeId) {
+            return entry.mid(sep + 1).trimmed();
+        }
+    }
+    return policy;
+}
+
+QString FlushScheduler::policyForScope(QString const& scopeId)
+{
+    return policyForScope(scopeId, qgetenv("UNITY_SCOPES_FLUSH_POLICY"));
+}
+
+QString DelayFlushScheduler::name() const
+{
+    return QStringLiteral("delay");
+}
+
+int DelayFlushScheduler::searchStarted()
+{
+    return SEARCH_PROCESSING_DELAY;
+}
+
+int DelayFlushScheduler::resultsReceived(int /* count */, int /* pending */, qint64 msecsSinceStart, int remainingMs)
+{
+    if (remainingMs >= 0) {
+        return -1;
+    }
+    // the longer we've been waiting for the results, the shorter the timeout
+    double mult = 1.0 / std::max(1, static_cast<int>((msecsSinceStart / 150) + 1));
+    return SEARCH_PROCESSING_DELAY * mult;
+}
+
+AdaptiveFlushScheduler::AdaptiveFlushScheduler(int batchSize, int maxBatchSize, int frameMs, int maxDelayMs)
+    : m_initialBatchSize(batchSize),
+      m_maxBatchSize(maxBatchSize),
+      m_batchSize(batchSize),
+      m_frameMs(frameMs),
+      m_maxDelayMs(maxDelayMs),
+      m_rate(0.0),
+      m_lastArrival(-1)
+{
+}
+
+QString AdaptiveFlushScheduler::name() const
+{
+    return QStringLiteral("adaptive");
+}
+
+int AdaptiveFlushScheduler::searchStarted()
+{
+    m_batchSize = m_initialBatchSize;
+    m_rate = 0.0;
+    m_lastArrival = -1;
+    return m_maxDelayMs;
+}
+
+int AdaptiveFlushScheduler::resultsReceived(int count, int pending, qint64 msecsSinceStart, int remainingMs)
+{
+    if (m_lastArrival >= 0 && msecsSinceStart > m_lastArrival) {
+        const double rate = static_cast<double>(count) / (msecsSinceStart - m_lastArrival);
+        m_rate = m_rate > 0.0 ? 0.7 * m_rate + 0.3 * rate : rate;
+    }
+    m_lastArrival = msecsSinceStart;
+
+    if (pending >= m_batchSize) {
+        return 0;
+    }
+
+    // without a rate estimate give the burst a couple of frames to build up
+    int delay = 2 * m_frameMs;
+    if (m_rate > 0.0) {
+        delay = static_cast<int>((m_batchSize - pending) / m_rate);
+    }
+    delay = qBound(m_frameMs, delay, m_maxDelayMs);
+
+    // flush right before the frame deadline (frames counted from the start of the search)
+    const qint64 deadline = ((msecsSinceStart + delay) / m_frameMs) * m_frameMs;
+    delay = std::max<qint64>(deadline - msecsSinceStart, 0);
+
+    if (remainingMs >= 0 && remainingMs <= delay) {
+        return -1;
+    }
+    return delay;
+}
+
+void AdaptiveFlushScheduler::flushed()
+{
+    m_batchSize = std::min(m_batchSize * 2, m_maxBatchSize);
+}
+
+} // namespace scopes_ng
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NG_FLUSH_SCHEDULER_H
+#define NG_FLUSH_SCHEDULER_H
+
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QString>
+
+namespace scopes_ng
+{
+
+/*
+ * Decides when the search results collected so far get flushed into the models.
+ * All times are in milliseconds; the scheduler never touches any timers itself,
+ * which makes it possible to replay arrival timelines in tests.
+ */
+class Q_DECL_EXPORT FlushScheduler
+{
+public:
+    typedef QSharedPointer<FlushScheduler> Ptr;
+
+    virtual ~FlushScheduler();
+
+    virtual QString name() const = 0;
+
+    // returns the delay for the first flush after dispatching a new search
+    virtual int searchStarted() = 0;
+
+    // a chunk of count results arrived; pending is the number of results waiting for a flush,
+    // remainingMs is the time left on the flush timer (-1 if not running).
+    // Returns the new flush delay (0 means flush right away) or -1 to keep the timer as it is.
+    virtual int resultsReceived(int count, int pending, qint64 msecsSinceStart, int remainingMs) = 0;
+
+    // results were flushed into the models
+    virtual void flushed();
+
+    static Ptr create(QString const& policy);
+
+    // policy configured with UNITY_SCOPES_FLUSH_POLICY, which is either a policy name
+    // or a comma-separated list of "scope_id=policy" entries (plain entry sets the default)
+    static QString policyForScope(QString const& scopeId, QByteArray const& config);
+    static QString policyForScope(QString const& scopeId);
+};
+
+// The original fixed delay, shortened the longer the search has been running
+class Q_DECL_EXPORT DelayFlushScheduler : public FlushScheduler
+{
+public:
+    static const int SEARCH_PROCESSING_DELAY = 1000;
+
+    QString name() const override;
+    int searchStarted() override;
+    int resultsReceived(int count, int pending, qint64 msecsSinceStart, int remainingMs) override;
+};
+
+// Flushes as soon as a batch of results is pending, otherwise estimates from the arrival
+// rate when the batch will be complete and aligns the flush with a frame boundary.
+// The first batch is small to get the first cards out quickly, later batches grow.
+class Q_DECL_EXPORT AdaptiveFlushScheduler : public FlushScheduler
+{
+public:
+    AdaptiveFlushScheduler(int batchSize = 24, int maxBatchSize = 192, int frameMs = 16, int maxDelayMs = 500);
+
+    QString name() const override;
+    int searchStarted() override;
+    int resultsReceived(int count, int pending, qint64 msecsSinceStart, int remainingMs) override;
+    void flushed() override;
+
+private:
+    int m_initialBatchSize;
+    int m_maxBatchSize;
+    int m_batchSize;
+    int m_frameMs;
+    int m_maxDelayMs;
+    double m_rate; // results per ms
+    qint64 m_lastArrival;
+};
+
+} // namespace scopes_ng
+
+#endif // NG_FLUSH_SCHEDULER_H
@@ -18,12 +18,54 @@
  */
 
 #include "geoip.h"
+#include "utils.h"
 
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
 #include <QNetworkReply>
+#include <QSaveFile>
 #include <QXmlStreamReader>
 
+#include <algorithm>
+#include <iterator>
+
 using namespace scopes_ng;
 
+namespace
+{
+
+const quint32 CACHE_MAGIC = 0x55534749; // "USGI"
+const quint32 CACHE_VERSION = 1;
+
+// where each element of the response goes; exactly one of the members is set
+struct Field
+{
+    QLatin1String tag;
+    QString GeoIp::Result::* text;
+    double GeoIp::Result::* number;
+};
+
+const Field FIELDS[] = {
+    { QLatin1String("Ip"), &GeoIp::Result::ip, nullptr },
+    { QLatin1String("Status"), &GeoIp::Result::status, nullptr },
+    { QLatin1String("CountryCode"), &GeoIp::Result::countryCode, nullptr },
+    { QLatin1String("CountryCode3"), &GeoIp::Result::countryCode3, nullptr },
+    { QLatin1String("CountryName"), &GeoIp::Result::countryName, nullptr },
+    { QLatin1String("RegionCode"), &GeoIp::Result::regionCode, nullptr },
+    { QLatin1String("RegionName"), &GeoIp::Result::regionName, nullptr },
+    { QLatin1String("City"), &GeoIp::Result::city, nullptr },
+    { QLatin1String("ZipPostalCode"), &GeoIp::Result::zipPostalCode, nullptr },
+    { QLatin1String("Latitude"), nullptr, &GeoIp::Result::latitude },
+    { QLatin1String("Longitude"), nullptr, &GeoIp::Result::longitude },
+    { QLatin1String("AreaCode"), &GeoIp::Result::areaCode, nullptr },
+    { QLatin1String("TimeZone"), &GeoIp::Result::timeZone, nullptr },
+};
+
+}
+
 GeoIp::GeoIp(const QUrl& url) :
         m_url(url)
 {
@@ -37,6 +79,11 @@ void GeoIp::whollyMoveThread(QThread *thread)
     m_networkAccessManager.moveToThread(thread);
 }
 
+bool GeoIp::isRunning() const
+{
+    return m_running;
+}
+
 void GeoIp::start()
 {
     if (!m_running)
@@ -49,6 +96,7 @@ void GeoIp::start()
 void GeoIp::response(QNetworkReply * const reply)
 {
     m_running = false;
+    reply->deleteLater();
 
     Result result;
 
@@ -60,29 +108,10 @@ void GeoIp::response(QNetworkReply * const reply)
     }
 
     QXmlStreamReader xml(reply);
-    while (!xml.atEnd() && !xml.hasError())
+    if (xml.readNextStartElement() && xml.name() == QLatin1String("Response"))
     {
-        QXmlStreamReader::TokenType token = xml.readNext();
-
-        /* If token is just StartDocument, we'll go to next.*/
-        if (token == QXmlStreamReader::StartDocument)
-        {
-            continue;
-        }
-
-        /* If token is StartElement, we'll see if we can read it.*/
-        if (token == QXmlStreamReader::StartElement)
-        {
-            /* If it's named persons, we'll go to the next.*/
-            if (xml.name() == "Response")
-            {
-                parseResponse(result, xml);
-                if (!xml.hasError())
-                {
-                    result.valid = true;
-                }
-            }
-        }
+        parseResponse(result, xml);
+        result.valid = !xml.hasError();
     }
 
     if (xml.hasError())
@@ -95,82 +124,105 @@ void GeoIp::response(QNetworkReply * const reply)
 
 void GeoIp::parseResponse(Result& result, QXmlStreamReader& xml)
 {
-    xml.readNext();
+    // The children of <Response>, in any order. Tag names are compared without copying them,
+    // and only the fields that are kept are turned into strings.
+    while (xml.readNextStartElement())
+    {
+        const QStringRef name = xml.name();
+        auto field = std::find_if(std::begin(FIELDS), std::end(FIELDS), [&name](Field const& f) {
+            return name == f.tag;
+        });
+        if (field == std::end(FIELDS))
+        {
+            xml.skipCurrentElement();
+            continue;
+        }
+
+        // stops at the end of the field even if it has child elements
+        const QString text = xml.readElementText(QXmlStreamReader::SkipChildElements);
+        if (field->text)
+        {
+            result.*(field->text) = text;
+        }
+        else if (!text.isEmpty())
+        {
+            result.*(field->number) = text.toDouble();
+        }
+    }
+}
+
+QString GeoIp::cachePath()
+{
+    return QDir(configDir()).filePath(QStringLiteral("geoip.cache"));
+}
 
-    /*
-     * We're going to loop over the things because the order might change.
-     * We'll continue the loop until we hit an EndElement named Response.
-     */
-    while (!xml.atEnd() && !(xml.isEndElement() && xml.name() == "Response"))
+bool GeoIp::saveResult(QString const& path, Result const& result, qint64 timestamp)
+{
+    QByteArray data;
     {
-        if (xml.isStartElement())
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_0);
+        stream << CACHE_MAGIC << CACHE_VERSION << timestamp;
+        for (auto const& field : FIELDS)
         {
-            if (xml.name() == "Ip")
+            if (field.text)
             {
-                result.ip = readText(xml);
+                stream << result.*(field.text);
             }
-            else if (xml.name() == "Status")
+            else
             {
-                result.status = readText(xml);
-            }
-            else if (xml.name() == "CountryCode")
-            {
-                result.countryCode = readText(xml);
-            }
-            else if (xml.name() == "CountryCode3")
-            {
-                result.countryCode3 = readText(xml);
-            }
-            else if (xml.name() == "CountryName")
-            {
-                result.countryName = readText(xml);
-            }
-            else if (xml.name() == "RegionCode")
-            {
-                result.regionCode = readText(xml);
-            }
-            else if (xml.name() == "RegionName")
-            {
-                result.regionName = readText(xml);
-            }
-            else if (xml.name() == "City")
-            {
-                result.city = readText(xml);
-            }
-            else if (xml.name() == "ZipPostalCode")
-            {
-                result.zipPostalCode = readText(xml);
-            }
-            else if (xml.name() == "Latitude")
-            {
-                result.latitude = readText(xml).toDouble();
-            }
-            else if (xml.name() == "Longitude")
-            {
-                result.longitude = readText(xml).toDouble();
-            }
-            else if (xml.name() == "AreaCode")
-            {
-                result.areaCode = readText(xml);
-            }
-            else if (xml.name() == "TimeZone")
-            {
-                result.timeZone = readText(xml);
+                stream << result.*(field.number);
             }
         }
+    }
 
-        xml.readNext();
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit())
+    {
+        qWarning() << "GeoIp: failed to write" << path << ":" << file.errorString();
+        return false;
     }
+    return true;
 }
 
-QString GeoIp::readText(QXmlStreamReader& xml)
+bool GeoIp::loadResult(QString const& path, Result& result, qint64& timestamp)
 {
-    xml.readNext();
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
 
-    if (xml.tokenType() != QXmlStreamReader::Characters)
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic, version;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != CACHE_MAGIC || version != CACHE_VERSION)
+    {
+        return false;
+    }
+
+    Result loaded;
+    stream >> timestamp;
+    for (auto const& field : FIELDS)
+    {
+        if (field.text)
+        {
+            stream >> loaded.*(field.text);
+        }
+        else
+        {
+            stream >> loaded.*(field.number);
+        }
+    }
+    if (stream.status() != QDataStream::Ok)
     {
-        return QString();
+        return false;
     }
 
-    return xml.text().toString();
+    loaded.valid = true;
+    result = loaded;
+    return true;
 }
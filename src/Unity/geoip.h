@@ -75,6 +75,14 @@ public:
 
     void whollyMoveThread(QThread *thread);
 
+    bool isRunning() const;
+
+    // The last successful lookup is kept on disk, so that location is known right away on startup.
+    // The timestamp is in milliseconds since the epoch.
+    static QString cachePath();
+    static bool saveResult(QString const& path, Result const& result, qint64 timestamp);
+    static bool loadResult(QString const& path, Result& result, qint64& timestamp);
+
 public Q_SLOTS:
     void start();
 
@@ -87,8 +95,6 @@ protected Q_SLOTS:
 protected:
     void parseResponse(Result& result, QXmlStreamReader& xml);
 
-    QString readText(QXmlStreamReader& xml);
-
     QUrl m_url;
 
     QNetworkAccessManager m_networkAccessManager;
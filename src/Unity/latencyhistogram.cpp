@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// self
+#include "latencyhistogram.h"
+
+// Qt
+#include <QStringList>
+
+#include <algorithm>
+
+namespace scopes_ng
+{
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::add(qint64 nsecs)
+{
+    const qint64 usecs = std::max<qint64>(nsecs / 1000, 0);
+
+    int index = 0;
+    while (index < BUCKETS - 1 && (Q_INT64_C(1) << index) <= usecs) {
+        index++;
+    }
+
+    m_buckets[index]++;
+    m_count++;
+    m_totalUsecs += usecs;
+    m_maxUsecs = std::max(m_maxUsecs, usecs);
+}
+
+void LatencyHistogram::reset()
+{
+    std::fill(m_buckets, m_buckets + BUCKETS, 0);
+    m_count = 0;
+    m_maxUsecs = 0;
+    m_totalUsecs = 0;
+}
+
+quint64 LatencyHistogram::count() const
+{
+    return m_count;
+}
+
+quint64 LatencyHistogram::bucket(int index) const
+{
+    return index >= 0 && index < BUCKETS ? m_buckets[index] : 0;
+}
+
+qint64 LatencyHistogram::maxUsecs() const
+{
+    return m_maxUsecs;
+}
+
+qint64 LatencyHistogram::totalUsecs() const
+{
+    return m_totalUsecs;
+}
+
+qint64 LatencyHistogram::percentileUsecs(double percentile) const
+{
+    if (m_count == 0) {
+        return 0;
+    }
+
+    const quint64 target = std::max<quint64>(1, static_cast<quint64>(m_count * percentile / 100.0 + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < BUCKETS - 1; i++) {
+        seen += m_buckets[i];
+        if (seen >= target) {
+            return std::min(Q_INT64_C(1) << i, m_maxUsecs);
+        }
+    }
+    return m_maxUsecs;
+}
+
+QString LatencyHistogram::toString() const
+{
+    QStringList buckets;
+    for (int i = 0; i < BUCKETS; i++) {
+        if (m_buckets[i] > 0) {
+            const QString bound = i < BUCKETS - 1 ? QStringLiteral("<%1us").arg(Q_INT64_C(1) << i) : QStringLiteral(">=%1us").arg(Q_INT64_C(1) << (i - 1));
+            buckets << QStringLiteral("%1:%2").arg(bound).arg(m_buckets[i]);
+        }
+    }
+    return QStringLiteral("n=%1 mean=%2us p50=%3us p99=%4us max=%5us [%6]")
+        .arg(m_count)
+        .arg(m_count > 0 ? m_totalUsecs / static_cast<qint64>(m_count) : 0)
+        .arg(percentileUsecs(50))
+        .arg(percentileUsecs(99))
+        .arg(m_maxUsecs)
+        .arg(buckets.join(QStringLiteral(" ")));
+}
+
+} // namespace scopes_ng
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NG_LATENCY_HISTOGRAM_H
+#define NG_LATENCY_HISTOGRAM_H
+
+#include <QString>
+
+namespace scopes_ng
+{
+
+/*
+ * Histogram of durations with power-of-two microsecond buckets:
+ * bucket 0 counts samples below 1us, bucket i samples in [2^(i-1), 2^i) us,
+ * the last bucket everything above. Not thread-safe.
+ */
+class Q_DECL_EXPORT LatencyHistogram
+{
+public:
+    static const int BUCKETS = 24;
+
+    LatencyHistogram();
+
+    void add(qint64 nsecs);
+    void reset();
+
+    quint64 count() const;
+    quint64 bucket(int index) const;
+    qint64 maxUsecs() const;
+    qint64 totalUsecs() const;
+    // upper bound of the bucket the given percentile (0-100) falls into
+    qint64 percentileUsecs(double percentile) const;
+
+    QString toString() const;
+
+private:
+    quint64 m_buckets[BUCKETS];
+    quint64 m_count;
+    qint64 m_maxUsecs;
+    qint64 m_totalUsecs;
+};
+
+} // namespace scopes_ng
+
+#endif // NG_LATENCY_HISTOGRAM_H
@@ -20,20 +20,225 @@
 #ifndef NG_MODEL_UPDATE_H
 #define NG_MODEL_UPDATE_H
 
-#include <QSet>
+#include <QHash>
+#include <QModelIndex>
+#include <QVector>
+#include <algorithm>
 #include <functional>
 
+namespace scopes_ng
+{
+
+// indices of the longest strictly increasing subsequence of values
+inline QVector<int> longestIncreasingSubsequence(QVector<int> const& values)
+{
+    QVector<int> tails; // tails[i] is the index of the smallest tail of a subsequence of length i + 1
+    QVector<int> prev(values.size(), -1);
+    for (int i = 0; i < values.size(); ++i) {
+        auto it = std::lower_bound(tails.begin(), tails.end(), values[i], [&values](int idx, int value) {
+            return values[idx] < value;
+        });
+        if (it != tails.begin()) {
+            prev[i] = *(it - 1);
+        }
+        if (it == tails.end()) {
+            tails.append(i);
+        } else {
+            *it = i;
+        }
+    }
+
+    QVector<int> result(tails.size());
+    int k = tails.size() - 1;
+    for (int i = tails.isEmpty() ? -1 : tails.last(); i >= 0; i = prev[i]) {
+        result[k--] = i;
+    }
+    return result;
+}
+
+// moves count items starting at from in front of the item at destination (index before the move),
+// the same way beginMoveRows() describes it
+template<typename List>
+void moveRange(List& list, int from, int count, int destination)
+{
+    if (destination > from) {
+        std::rotate(list.begin() + from, list.begin() + from + count, list.begin() + destination);
+    } else {
+        std::rotate(list.begin() + destination, list.begin() + from, list.begin() + from + count);
+    }
+}
+
+// inserts the items of [first, last) in front of the item at destination
+template<typename List, typename Iterator>
+void insertRange(List& list, int destination, Iterator first, Iterator last)
+{
+    const int oldSize = list.size();
+    for (auto it = first; it != last; ++it) {
+        list.append(*it);
+    }
+    std::rotate(list.begin() + destination, list.begin() + oldSize, list.end());
+}
+
+// Fenwick tree of counts, for positions of rows while they're being moved around
+class RowCounter
+{
+public:
+    explicit RowCounter(int size): m_tree(size + 1, 0) {}
+
+    void add(int index, int delta)
+    {
+        for (++index; index < m_tree.size(); index += index & -index) {
+            m_tree[index] += delta;
+        }
+    }
+
+    // sum of the counts at positions before index
+    int before(int index) const
+    {
+        int sum = 0;
+        for (; index > 0; index -= index & -index) {
+            sum += m_tree[index];
+        }
+        return sum;
+    }
+
+private:
+    QVector<int> m_tree;
+};
+
+/*
+ * Puts the rows of a model into their new order; targets has the new position of every current
+ * row, matched tells which of the new positions are taken by a current row. Rows on the longest
+ * increasing subsequence of targets stay where they are, every other row is moved once and the
+ * other positions are filled by insertRows(destination, position, count), which returns the number
+ * of rows it inserted. moveRows(from, count, destination) gets beginMoveRows() arguments.
+ *
+ * The rows placed so far are at the top of the model, the rest follow in their original order;
+ * rows that had to make way for a row staying in place are left among the placed ones until their
+ * turn comes. Current positions are counted with a RowCounter for each of the two parts, so every
+ * lookup is O(log n) and contiguous rows go with a single insert or move.
+ */
+template<typename InsertFunc, typename MoveFunc>
+void placeRows(QVector<int> const& targets, QVector<bool> const& matched, InsertFunc insertRows, MoveFunc moveRows)
+{
+    const int rows = targets.size();
+    const int positions = matched.size();
+
+    QVector<int> rowAt(positions, -1); // inverse of targets
+    for (int row = 0; row < rows; ++row) {
+        rowAt[targets[row]] = row;
+    }
+    QVector<bool> stays(positions, false);
+    for (int idx: longestIncreasingSubsequence(targets)) {
+        stays[targets[idx]] = true;
+    }
+
+    // rows not placed yet, by their original row
+    RowCounter pending(rows);
+    QVector<bool> isPending(rows, true);
+    for (int row = 0; row < rows; ++row) {
+        pending.add(row, 1);
+    }
+    int nextPending = 0;
+
+    // placed rows by the order they were placed in, deferred rows included
+    RowCounter placed(rows * 2 + positions);
+    QVector<int> slotOf(rows, -1);
+    int slots = 0;
+    int at = 0; // number of placed rows
+
+    auto place = [&](int row) {
+        if (isPending[row]) {
+            isPending[row] = false;
+            pending.add(row, -1);
+        } else {
+            placed.add(slotOf[row], -1);
+        }
+        slotOf[row] = slots;
+        placed.add(slots++, 1);
+    };
+    // current position of a matched row
+    auto positionOf = [&](int row) {
+        return isPending[row] ? at + pending.before(row) : placed.before(slotOf[row]);
+    };
+
+    for (int pos = 0; pos < positions; ) {
+        if (!matched[pos]) {
+            int count = 1;
+            while (pos + count < positions && !matched[pos + count]) {
+                ++count;
+            }
+            const int inserted = insertRows(at, pos, count);
+            for (int i = 0; i < inserted; ++i) {
+                placed.add(slots++, 1);
+            }
+            at += inserted;
+            pos += count;
+            continue;
+        }
+
+        const int row = rowAt[pos];
+        if (stays[pos]) {
+            // pending rows above it are placed later; they wait among the placed rows
+            for (; nextPending < row; ++nextPending) {
+                if (isPending[nextPending]) {
+                    place(nextPending);
+                    ++at;
+                }
+            }
+            place(row);
+            ++at;
+            ++pos;
+            continue;
+        }
+
+        const int from = positionOf(row);
+        const bool wasPending = isPending[row];
+        int count = 1;
+        while (pos + count < positions && matched[pos + count] && !stays[pos + count] &&
+               isPending[rowAt[pos + count]] == wasPending && positionOf(rowAt[pos + count]) == from + count) {
+            ++count;
+        }
+        // pending rows go up to the end of the placed ones, deferred rows go down to it
+        if (from != at && from + count != at) {
+            moveRows(from, count, at);
+        }
+        for (int i = 0; i < count; ++i) {
+            place(rowAt[pos + i]);
+        }
+        if (wasPending) {
+            at += count;
+        }
+        pos += count;
+    }
+}
+
+} // namespace scopes_ng
+
 template <class ModelBase, class InputContainer, class OutputContainer, class KeyType=QString>
 class ModelUpdate: public ModelBase
 {
 public:
+    // what UpdateFunc did with an existing object
+    enum UpdateResult {
+        Unchanged,  // nothing to notify
+        Changed,    // object updated in place, roles to notify are in changedRoles (empty means all)
+        Recreate    // object can't be updated and gets recreated with CreateFunc
+    };
+
     using InputKeyFunc = std::function<KeyType(typename InputContainer::value_type)>;
     using OutputKeyFunc = std::function<KeyType(typename OutputContainer::value_type)>;
     using CreateFunc = std::function<typename OutputContainer::value_type(typename InputContainer::value_type const&)>;
-    using UpdateFunc = std::function<bool(int, typename InputContainer::value_type const&, typename OutputContainer::value_type const&)>;
+    using UpdateFunc = std::function<UpdateResult(typename InputContainer::value_type const&, typename OutputContainer::value_type const&, QVector<int>& changedRoles)>;
 
     ModelUpdate(QObject *parent = nullptr): ModelBase(parent) {}
 
+    /*
+     * Syncs model with input using the minimal number of model signals: objects which are not present
+     * anymore are removed, objects on the longest increasing subsequence of their new rows stay
+     * in place, every other object is moved once. Contiguous rows are removed, inserted, moved and
+     * reported as changed with a single signal.
+     */
     void syncModel(InputContainer const& input,
             OutputContainer &model,
             const InputKeyFunc& inKeyFunc,
@@ -41,102 +246,132 @@ public:
             const CreateFunc& createFunc,
             const UpdateFunc& updateFunc)
     {
-        QMap<KeyType, int> newItems; // lookup for recevied objects and their desired rows in the model
-        QSet<KeyType> oldItems; // lookup for objects that were already displayed
-
+        QVector<typename InputContainer::value_type> items; // input with random access
+        QHash<KeyType, int> newItems; // lookup for received objects and their desired rows in the model
+        for (auto const& item: input)
         {
-            int pos = 0;
-            for (auto item: input)
-            {
-                newItems[inKeyFunc(item)] = pos++;
-            }
+            newItems.insert(inKeyFunc(item), items.size());
+            items.append(item);
         }
 
-        // iterate over old objects, remove objects that are not present anymore
+        // desired row of every object currently in the model, -1 if it's not present anymore
+        QVector<int> targets(model.size());
+        QVector<bool> matched(items.size(), false);
         {
             int row = 0;
-            for (auto it = model.begin(); it != model.end();)
+            for (auto const& obj: model)
             {
-                const KeyType id = outKeyFunc(*it);
-                if (!newItems.contains(id))
+                auto it = newItems.constFind(outKeyFunc(obj));
+                if (it != newItems.constEnd() && !matched[it.value()])
                 {
-                    this->beginRemoveRows(QModelIndex(), row, row);
-                    it = model.erase(it);
-                    this->endRemoveRows();
+                    matched[it.value()] = true;
+                    targets[row] = it.value();
                 }
                 else
                 {
-                    oldItems.insert(id);
-                    ++it;
-                    ++row;
+                    targets[row] = -1;
                 }
+                ++row;
             }
         }
 
-        // iterate over new objects and insert them in the model
+        // remove objects that are not present anymore
+        for (int last = model.size() - 1; last >= 0; )
         {
-            int row = 0;
-            for (auto const& item: input)
+            if (targets[last] >= 0)
             {
-                if (!oldItems.contains(inKeyFunc(item)))
-                {
-                    auto obj = createFunc(item);
-                    if (obj)
-                    {
-                        this->beginInsertRows(QModelIndex(), row, row);
-                        model.insert(row, obj);
-                        this->endInsertRows();
-                    }
-                }
-                row++;
-            }
-        }
-
-        // move objects if position changed
-        for (int i = 0; i<model.size(); )
-        {
-            auto const id = outKeyFunc(model[i]);
-            int pos = newItems.value(id, -1);
-            if (pos >= 0 && pos != i) {
-                this->beginMoveRows(QModelIndex(), i, i, QModelIndex(), pos + (pos > i ? 1 : 0));
-                model.move(i, pos);
-                this->endMoveRows();
+                --last;
                 continue;
             }
-            i++;
+            int first = last;
+            while (first > 0 && targets[first - 1] < 0)
+            {
+                --first;
+            }
+            this->beginRemoveRows(QModelIndex(), first, last);
+            model.erase(model.begin() + first, model.begin() + last + 1);
+            this->endRemoveRows();
+            last = first - 1;
         }
+        targets.erase(std::remove(targets.begin(), targets.end(), -1), targets.end());
 
-        // check if any of the existing objects which didn't change position needs updating
-        /*{
-            int row = 0;
-            for (auto const& in: input)
+        // rows end up in the order of items, less the ones createFunc didn't create an object for
+        QVector<bool> present(matched);
+        scopes_ng::placeRows(targets, matched, [this, &model, &items, &present, &createFunc](int at, int pos, int count)
+        {
+            QVector<typename OutputContainer::value_type> objs;
+            for (int i = pos; i < pos + count; ++i)
             {
-                if (oldItems.contains(inKeyFunc(in)))
+                auto obj = createFunc(items[i]);
+                if (obj)
                 {
-                    if (!updateFunc(in, model[row]))
-                    {
-                        model[row] = createFunc(in);
-                        Q_EMIT this->dataChanged(this->index(row, 0), this->index(row, 0)); // or beginRemoveRows & beginInsertRows ?
-                    }
+                    objs.append(obj);
+                    present[i] = true;
                 }
-                ++row;
             }
-        }*/
+            if (!objs.isEmpty())
+            {
+                this->beginInsertRows(QModelIndex(), at, at + objs.size() - 1);
+                scopes_ng::insertRange(model, at, objs.begin(), objs.end());
+                this->endInsertRows();
+            }
+            return objs.size();
+        }, [this, &model](int from, int count, int destination)
+        {
+            this->beginMoveRows(QModelIndex(), from, from + count - 1, QModelIndex(), destination);
+            scopes_ng::moveRange(model, from, count, destination);
+            this->endMoveRows();
+        });
 
-        // call updateFunc for all objects to synchornize changes to properties
+        // call updateFunc for objects which were already there to synchronize changes to properties
         {
-            int row = 0;
-            for (auto const& in: input)
+            int first = -1;
+            QVector<int> rangeRoles;
+            auto notify = [&](int last) {
+                if (first >= 0)
+                {
+                    Q_EMIT this->dataChanged(this->index(first, 0), this->index(last, 0), rangeRoles);
+                    first = -1;
+                }
+            };
+
+            int row = -1;
+            for (int pos = 0; pos < items.size(); ++pos)
             {
-                if (!updateFunc(row, in, model[row]))
+                if (!present[pos])
                 {
-                    model[row] = createFunc(in);
-                    Q_EMIT this->dataChanged(this->index(row, 0), this->index(row, 0)); // or beginRemoveRows & beginInsertRows ?
+                    continue;
                 }
                 ++row;
+                UpdateResult result = Unchanged;
+                QVector<int> roles;
+                if (matched[pos])
+                {
+                    result = updateFunc(items[pos], model[row], roles);
+                    if (result == Recreate)
+                    {
+                        model[row] = createFunc(items[pos]);
+                        roles.clear();
+                    }
+                }
+
+                if (result == Unchanged)
+                {
+                    notify(row - 1);
+                    continue;
+                }
+                if (first >= 0 && roles != rangeRoles)
+                {
+                    notify(row - 1);
+                }
+                if (first < 0)
+                {
+                    first = row;
+                    rangeRoles = roles;
+                }
             }
+            notify(model.size() - 1);
         }
-
     }
 };
 
@@ -97,9 +97,6 @@ void OptionSelectorOptions::update(const std::set<unity::scopes::FilterOption::S
 
 void OptionSelectorOptions::update(const std::list<unity::scopes::FilterOption::SCPtr>& options)
 {
-    QVector<int> roles;
-    roles.append(unity::shell::scopes::OptionSelectorOptionsInterface::Roles::RoleOptionLabel);
-
     syncModel(options, m_options,
             // key function for scopes api filter option
             [](const unity::scopes::FilterOption::SCPtr& opt) -> QString { return QString::fromStdString(opt->id()); },
@@ -112,15 +109,16 @@ void OptionSelectorOptions::update(const std::list<unity::scopes::FilterOption::
                 return optObj;
             },
             // filter option update function
-            [&roles, this](int row, const unity::scopes::FilterOption::SCPtr& op1, const QSharedPointer<OptionSelectorOption>& op2) -> bool {
+            [](const unity::scopes::FilterOption::SCPtr& op1, const QSharedPointer<OptionSelectorOption>& op2, QVector<int>& roles) -> UpdateResult {
                 if (op2->id != QString::fromStdString(op1->id())) {
-                    return false;
+                    return Recreate;
                 }
                 if (op2->label != QString::fromStdString(op1->label())) {
                     op2->label = QString::fromStdString(op1->label());
-                    Q_EMIT dataChanged(index(row, 0), index(row, 0), roles);
+                    roles.append(unity::shell::scopes::OptionSelectorOptionsInterface::Roles::RoleOptionLabel);
+                    return Changed;
                 }
-                return true;
+                return Unchanged;
             });
 }
 
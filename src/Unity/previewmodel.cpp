@@ -28,6 +28,9 @@
 #include "resultsmodel.h"
 #include "utils.h"
 #include "logintoaccount.h"
+#include "previewprefetcher.h"
+#include "querydispatcher.h"
+#include "tracing.h"
 
 // Qt
 #include <QJsonDocument>
@@ -45,6 +48,7 @@ using namespace unity;
 PreviewModel::PreviewModel(QObject* parent) :
     unity::shell::scopes::PreviewModelInterface (parent),
     m_loaded(false),
+    m_revalidating(false),
     m_processingAction(false),
     m_widgetColumnCount(1)
 {
@@ -136,6 +140,7 @@ void PreviewModel::processPreviewChunk(PushEvent* pushEvent)
                     model->removeWidget(widget);
                 }
                 m_previewWidgetsOrdered.removeOne(widget);
+                unindexWidget(widget);
                 it = m_previewWidgets.erase(it);
             } else {
                 ++it;
@@ -146,6 +151,12 @@ void PreviewModel::processPreviewChunk(PushEvent* pushEvent)
         qDebug() << "PreviewModel::processPreviewChunk(): preview complete";
 #endif
         Q_ASSERT(m_previewWidgets.size() == m_previewWidgetsOrdered.size());
+        if (Tracer::isEnabled()) {
+            const qint64 duration = pushEvent->msecsSinceStart() * 1000;
+            Tracer::complete("preview", "preview", Tracer::nowUsecs() - duration, duration,
+                    m_previewedResult ? QString::fromStdString(m_previewedResult->uri()) : QString());
+        }
+        m_revalidating = false;
         m_loaded = true;
         Q_EMIT loadedChanged();
     }
@@ -199,13 +210,32 @@ bool PreviewModel::loaded() const
     return m_loaded;
 }
 
-void PreviewModel::loadForResult(scopes::Result::SPtr const& result)
+void PreviewModel::loadForResult(scopes::Result::SPtr const& result, QSharedPointer<PrefetchedPreview> const& prefetched)
 {
+    if (m_previewedResult != result) {
+        // component values of existing widgets come from the previous result, don't reuse them
+        for (auto const& widget: m_previewWidgetsOrdered) {
+            widget->definition.clear();
+        }
+    }
     m_previewedResult = result;
     if (m_listener) {
         m_listener->invalidate(); // TODO: is this needed?
     }
 
+    m_revalidating = false;
+    if (prefetched) {
+        // show the prefetched preview right away, the scope is asked again to bring it up to date
+        setColumnLayouts(prefetched->columns);
+        addWidgetDefinitions(prefetched->widgets);
+        updatePreviewData(prefetched->data);
+        m_revalidating = true;
+        if (!m_loaded) {
+            m_loaded = true;
+            Q_EMIT loadedChanged();
+        }
+    }
+
     dispatchPreview();
 }
 
@@ -261,12 +291,12 @@ void PreviewModel::setColumnLayouts(scopes::ColumnLayoutList const& layouts)
 void PreviewModel::addWidgetDefinitions(scopes::PreviewWidgetList const& widgets)
 {
     processWidgetDefinitions(widgets, [this](QSharedPointer<PreviewWidgetData> widgetData) {
-            auto it = m_previewWidgets.find(widgetData->id);
-            if (it != m_previewWidgets.end()) {
-                it.value() = widgetData;
+            if (m_previewWidgets.contains(widgetData->id)) {
+                storeWidget(widgetData);
             } else {
                 m_previewWidgets.insert(widgetData->id, widgetData);
                 m_previewWidgetsOrdered.append(widgetData);
+                indexWidget(widgetData);
             }
             addWidgetToColumnModel(widgetData);
     });
@@ -275,9 +305,8 @@ void PreviewModel::addWidgetDefinitions(scopes::PreviewWidgetList const& widgets
 void PreviewModel::updateWidgetDefinitions(unity::scopes::PreviewWidgetList const& widgets)
 {
     processWidgetDefinitions(widgets, [this](QSharedPointer<PreviewWidgetData> widgetData) {
-            auto it = m_previewWidgets.find(widgetData->id);
-            if (it != m_previewWidgets.end()) {
-                it.value() = widgetData;
+            if (m_previewWidgets.contains(widgetData->id)) {
+                storeWidget(widgetData);
                 // Update widget with that id in all models
                 for (auto model: m_previewWidgetModels) {
                     model->updateWidget(widgetData);
@@ -286,11 +315,67 @@ void PreviewModel::updateWidgetDefinitions(unity::scopes::PreviewWidgetList cons
     });
 }
 
+// replaces the widget with the same id
+void PreviewModel::storeWidget(QSharedPointer<PreviewWidgetData> const& widgetData)
+{
+    auto it = m_previewWidgets.find(widgetData->id);
+    Q_ASSERT(it != m_previewWidgets.end());
+    QSharedPointer<PreviewWidgetData> oldWidget(it.value());
+    if (oldWidget == widgetData) {
+        return;
+    }
+
+    unindexWidget(oldWidget);
+    it.value() = widgetData;
+    const int pos = m_previewWidgetsOrdered.indexOf(oldWidget);
+    if (pos >= 0) {
+        m_previewWidgetsOrdered.replace(pos, widgetData);
+    }
+    indexWidget(widgetData);
+}
+
+void PreviewModel::indexWidget(QSharedPointer<PreviewWidgetData> const& widgetData)
+{
+    for (auto it = widgetData->component_map.constBegin(); it != widgetData->component_map.constEnd(); ++it) {
+        m_dataToWidgetMap.insert(it.value(), widgetData.data());
+    }
+    for (auto const& subwidget: widgetData->collapsedWidgets) {
+        for (auto it = subwidget->component_map.constBegin(); it != subwidget->component_map.constEnd(); ++it) {
+            m_dataToWidgetMap.insert(it.value(), subwidget.data());
+        }
+        m_collapsedWidgetParents.insert(subwidget.data(), widgetData.data());
+    }
+}
+
+void PreviewModel::unindexWidget(QSharedPointer<PreviewWidgetData> const& widgetData)
+{
+    for (auto it = widgetData->component_map.constBegin(); it != widgetData->component_map.constEnd(); ++it) {
+        m_dataToWidgetMap.remove(it.value(), widgetData.data());
+    }
+    for (auto const& subwidget: widgetData->collapsedWidgets) {
+        for (auto it = subwidget->component_map.constBegin(); it != subwidget->component_map.constEnd(); ++it) {
+            m_dataToWidgetMap.remove(it.value(), subwidget.data());
+        }
+        m_collapsedWidgetParents.remove(subwidget.data());
+    }
+}
+
 void PreviewModel::processWidgetDefinitions(unity::scopes::PreviewWidgetList const& widgets, std::function<void(QSharedPointer<PreviewWidgetData>)> const& processFunc)
 {
     for (auto it = widgets.begin(); it != widgets.end(); ++it) {
         scopes::PreviewWidget const& widget = *it;
         QString id(QString::fromStdString(widget.id()));
+
+        // widgets that didn't change since they were last received are kept as they are, data
+        // keys they depend on are applied by updatePreviewData()
+        std::string definition(widget.data());
+        auto existing = m_previewWidgets.constFind(id);
+        if (existing != m_previewWidgets.constEnd() && !existing.value()->definition.empty() && existing.value()->definition == definition) {
+            existing.value()->received = true;
+            processFunc(existing.value());
+            continue;
+        }
+
         QString widget_type(QString::fromStdString(widget.widget_type()));
         QHash<QString, QString> components;
         QVariantMap attributes;
@@ -327,9 +412,6 @@ void PreviewModel::processWidgetDefinitions(unity::scopes::PreviewWidgetList con
 
                     auto subWidgetData = QSharedPointer<PreviewWidgetData>(new PreviewWidgetData(QString::fromStdString(w.id()), QString::fromStdString(w.widget_type()),
                                 components2, attributes2));
-                    for (auto attr_it = components2.begin(); attr_it != components2.end(); ++attr_it) {
-                        m_dataToWidgetMap.insert(attr_it.value(), subWidgetData.data());
-                    }
 
                     collapsedWidgets.append(subWidgetData);
                     widgetData.append(subWidgetData);
@@ -344,9 +426,7 @@ void PreviewModel::processWidgetDefinitions(unity::scopes::PreviewWidgetList con
             if (collapsedWidgets.size()) {
                 preview_data->collapsedWidgets = collapsedWidgets;
             }
-            for (auto attr_it = components.begin(); attr_it != components.end(); ++attr_it) {
-                m_dataToWidgetMap.insert(attr_it.value(), preview_data);
-            }
+            preview_data->definition = std::move(definition);
             QSharedPointer<PreviewWidgetData> widgetData(preview_data);
 
             processFunc(widgetData);
@@ -466,46 +546,38 @@ void PreviewModel::addWidgetToColumnModel(QSharedPointer<PreviewWidgetData> cons
 
 void PreviewModel::updatePreviewData(QHash<QString, QVariant> const& data)
 {
-    QSet<PreviewWidgetData*> changedWidgets;
+    // only widgets depending on the received keys are touched
+    QList<PreviewWidgetData*> changedWidgets;
+    QSet<PreviewWidgetData*> seen;
     for (auto it = data.begin(); it != data.end(); ++it) {
         m_allData.insert(it.key(), it.value());
-        auto map_it = m_dataToWidgetMap.constFind(it.key());
-        while (map_it != m_dataToWidgetMap.constEnd() && map_it.key() == it.key()) {
-            changedWidgets.insert(map_it.value());
-            ++map_it;
+        for (auto map_it = m_dataToWidgetMap.constFind(it.key()); map_it != m_dataToWidgetMap.constEnd() && map_it.key() == it.key(); ++map_it) {
+            if (!seen.contains(map_it.value())) {
+                seen.insert(map_it.value());
+                changedWidgets.append(map_it.value());
+            }
         }
     }
 
-    for (auto it = m_previewWidgets.begin(); it != m_previewWidgets.end(); it++) {
-        PreviewWidgetData* widget = it.value().data();
-        if (changedWidgets.contains(widget)) {
-            // re-process attributes and emit dataChanged
-            processComponents(widget->component_map, widget->data);
-
-            for (int j = 0; j < m_previewWidgetModels.size(); j++) {
-                // returns true if the notification was emitted
-                if (m_previewWidgetModels[j]->widgetChanged(widget)) {
-                    break;
-                }
+    for (PreviewWidgetData* widget: changedWidgets) {
+        // re-process attributes and emit dataChanged
+        processComponents(widget->component_map, widget->data);
+
+        PreviewWidgetData* expandable = m_collapsedWidgetParents.value(widget);
+        if (expandable) {
+            auto const widgetsModelIt = expandable->data.constFind(QStringLiteral("widgets"));
+            if (widgetsModelIt != expandable->data.constEnd() && widgetsModelIt.value().canConvert<PreviewWidgetModel*>()) {
+                widgetsModelIt.value().value<PreviewWidgetModel*>()->widgetChanged(widget);
+            } else { // this should never happen
+                qWarning() << "Can't convert model to PreviewWidgetModel";
             }
-        } else { // check if it's expandable widget
-            if (widget->type == QLatin1String("expandable")) {
-                auto const widgetsModelIt = widget->data.find(QStringLiteral("widgets"));
-                if (widgetsModelIt!= widget->data.end() && widgetsModelIt.value().canConvert<PreviewWidgetModel*>()) {
-                    for (auto it = widget->collapsedWidgets.begin(); it != widget->collapsedWidgets.end(); it++) {
-                        auto subwidget = *it;
-                        if (changedWidgets.contains(subwidget.data())) {
-                            processComponents(subwidget->component_map, subwidget->data);
-                            auto model = widgetsModelIt.value().value<PreviewWidgetModel*>();
-                            // returns true if the notification was emitted
-                            if (model->widgetChanged(subwidget.data())) {
-                                break;
-                            }
-                        }
-                    }
-                } else { // this should never happen
-                    qWarning() << "Can't convert model to PreviewWidgetModel";
-                }
+            continue;
+        }
+
+        for (int j = 0; j < m_previewWidgetModels.size(); j++) {
+            // returns true if the notification was emitted
+            if (m_previewWidgetModels[j]->widgetChanged(widget)) {
+                break;
             }
         }
     }
@@ -543,28 +615,34 @@ QVariant PreviewModel::data(const QModelIndex& index, int role) const
     }
 }
 
+scopes::ActionMetadata PreviewModel::previewMetadata(scopes_ng::Scope* scope, QUuid const& session_id, QString const& userAgent, scopes::Variant const& extra_data)
+{
+    QString formFactor(scope ? scope->formFactor() : QStringLiteral("phone"));
+    scopes::ActionMetadata metadata(QLocale::system().name().toStdString(), formFactor.toStdString());
+    if (scope) {
+        metadata.set_internet_connectivity(scope->networkManager().isOnline() ? scopes::SearchMetadata::Connected : scopes::SearchMetadata::Disconnected);
+    }
+    if (!extra_data.is_null()) {
+        metadata.set_scope_data(extra_data);
+    }
+    if (!session_id.isNull()) {
+        metadata["session-id"] = uuidToString(session_id).toStdString();
+    }
+    if (!userAgent.isEmpty()) {
+        metadata["user-agent"] = userAgent.toStdString();
+    }
+    return metadata;
+}
+
 void PreviewModel::dispatchPreview(scopes::Variant const& extra_data)
 {
     qDebug() << "PreviewModel::dispatchPreview()";
+    TraceSpan trace("preview", "dispatchPreview", Tracer::isEnabled() && m_previewedResult ? QString::fromStdString(m_previewedResult->uri()) : QString());
     // TODO: figure out if the result can produce a preview without sending a request to the scope
     // if (m_previewedResult->has_early_preview()) { ... }
     try {
         auto proxy = m_associatedScope ? m_associatedScope->proxy_for_result(m_previewedResult) : m_previewedResult->target_scope_proxy();
-
-        QString formFactor(m_associatedScope ? m_associatedScope->formFactor() : QStringLiteral("phone"));
-        scopes::ActionMetadata metadata(QLocale::system().name().toStdString(), formFactor.toStdString());
-        if (m_associatedScope) {
-            metadata.set_internet_connectivity(m_associatedScope->networkManager().isOnline() ? scopes::SearchMetadata::Connected : scopes::SearchMetadata::Disconnected);
-        }
-        if (!extra_data.is_null()) {
-            metadata.set_scope_data(extra_data);
-        }
-        if (!m_session_id.isNull()) {
-            metadata["session-id"] = uuidToString(m_session_id).toStdString();
-        }
-        if (!m_userAgent.isEmpty()) {
-            metadata["user-agent"] = m_userAgent.toStdString();
-        }
+        scopes::ActionMetadata metadata(previewMetadata(m_associatedScope, m_session_id, m_userAgent, extra_data));
 
         std::shared_ptr<PreviewDataReceiver> listener(new PreviewDataReceiver(this));
         // invalidate previous listener (if any); TODO: is this needed?
@@ -573,7 +651,7 @@ void PreviewModel::dispatchPreview(scopes::Variant const& extra_data)
         }
         m_listener = listener;
 
-        if (m_loaded) {
+        if (m_loaded && !m_revalidating) {
             m_loaded = false;
             Q_EMIT loadedChanged();
         }
@@ -583,7 +661,14 @@ void PreviewModel::dispatchPreview(scopes::Variant const& extra_data)
             it.value()->received = false;
         }
 
-        m_lastPreviewQuery = proxy->preview(*(m_previewedResult.get()), metadata, listener);
+        scopes::Result result(*m_previewedResult);
+        QueryDispatcher::instance()->dispatch(this, "preview", [proxy, result, metadata, listener]() {
+            return proxy->preview(result, metadata, listener);
+        }, [this, listener](scopes::QueryCtrlProxy const& controller) {
+            if (m_listener == listener) {
+                m_lastPreviewQuery = controller;
+            }
+        });
     } catch (std::exception& e) {
         qWarning("Caught an error from preview(): %s", e.what());
     } catch (...) {
@@ -614,8 +699,16 @@ void PreviewModel::widgetTriggered(QString const& widgetId, QString const& actio
 
             setProcessingAction(true);
 
-            // FIXME: don't block
-            proxy->perform_action(*(m_previewedResult.get()), metadata, widgetId.toStdString(), actionId.toStdString(), listener);
+            scopes::Result result(*m_previewedResult);
+            std::string widget(widgetId.toStdString());
+            std::string action(actionId.toStdString());
+            QueryDispatcher::instance()->dispatch(this, "perform_action", [proxy, result, metadata, widget, action, listener]() {
+                return proxy->perform_action(result, metadata, widget, action, listener);
+            }, [this, listener](scopes::QueryCtrlProxy const& controller) {
+                if (!controller && m_lastActivation == listener) {
+                    setProcessingAction(false);
+                }
+            });
         } catch (std::exception& e) {
             qWarning("Caught an error from perform_action(%s, %s): %s", widgetId.toStdString().c_str(), actionId.toStdString().c_str(), e.what());
         } catch (...) {
@@ -24,9 +24,10 @@
 
 #include <unity/shell/scopes/PreviewModelInterface.h>
 
+#include <QHash>
 #include <QMap>
 #include <QSharedPointer>
-#include <QMultiMap>
+#include <QMultiHash>
 #include <QStringList>
 #include <QPointer>
 #include <QPair>
@@ -35,6 +36,7 @@
 #include <unity/scopes/PreviewWidget.h>
 #include <unity/scopes/Result.h>
 #include <unity/scopes/ColumnLayout.h>
+#include <unity/scopes/ActionMetadata.h>
 
 #include "collectors.h"
 
@@ -49,6 +51,7 @@ struct PreviewWidgetData
     QVariantMap data;
     QList<QSharedPointer<PreviewWidgetData>> collapsedWidgets; // only used if type == 'expandable'
     bool received; // reset to false when new preview is requested and set to true if same widget is received again; widgets not received again are removed
+    std::string definition; // serialized widget definition this data was built from
 
     PreviewWidgetData(QString const& id_, QString const& type_, QHash<QString, QString> const& components, QVariantMap const& data_): id(id_), type(type_),
         component_map(components), data(data_), received(true)
@@ -80,6 +83,7 @@ struct PreviewWidgetData
 class PreviewWidgetModel;
 class PushEvent;
 class Scope;
+struct PrefetchedPreview;
 
 class Q_DECL_EXPORT PreviewModel : public unity::shell::scopes::PreviewModelInterface
 {
@@ -104,13 +108,16 @@ public:
 
     void updateWidgetDefinitions(unity::scopes::PreviewWidgetList const&);
 
-    void loadForResult(unity::scopes::Result::SPtr const&);
+    void loadForResult(unity::scopes::Result::SPtr const&, QSharedPointer<PrefetchedPreview> const& prefetched = QSharedPointer<PrefetchedPreview>());
     void update(unity::scopes::PreviewWidgetList const&);
 
     void setAssociatedScope(scopes_ng::Scope*, QUuid const&, QString const&);
     scopes_ng::Scope* associatedScope() const;
     unity::scopes::Result::SPtr previewedResult() const;
 
+    static unity::scopes::ActionMetadata previewMetadata(scopes_ng::Scope* scope, QUuid const& session_id, QString const& userAgent,
+            unity::scopes::Variant const& extra_data = unity::scopes::Variant());
+
 private Q_SLOTS:
     void widgetTriggered(QString const&, QString const&, QVariantMap const&);
 
@@ -126,9 +133,13 @@ private:
     QPair<int, int> determinePositionFromLayout(QString const&) const;
     void addWidgetToColumnModel(QSharedPointer<PreviewWidgetData> const&);
     void processComponents(QHash<QString, QString> const& components, QVariantMap& out_attributes);
+    void storeWidget(QSharedPointer<PreviewWidgetData> const& widgetData);
+    void indexWidget(QSharedPointer<PreviewWidgetData> const& widgetData);
+    void unindexWidget(QSharedPointer<PreviewWidgetData> const& widgetData);
     void dispatchPreview(unity::scopes::Variant const& extra_data = unity::scopes::Variant());
 
     bool m_loaded;
+    bool m_revalidating; // showing a prefetched preview while the scope is asked again
     bool m_processingAction;
     int m_widgetColumnCount;
     QMap<QString, QVariant> m_allData; // attribute values (field name -> value)
@@ -137,7 +148,8 @@ private:
     QList<PreviewWidgetModel*> m_previewWidgetModels; // column models (number of columns is set by the shell at this point).
     QMap<QString, QSharedPointer<PreviewWidgetData>> m_previewWidgets; // all widgets, regardless of their columns
     QList<QSharedPointer<PreviewWidgetData>> m_previewWidgetsOrdered; // all widgets, in the order they were received
-    QMultiMap<QString, PreviewWidgetData*> m_dataToWidgetMap;
+    QMultiHash<QString, PreviewWidgetData*> m_dataToWidgetMap; // data key -> widgets with components mapped to it
+    QHash<PreviewWidgetData*, PreviewWidgetData*> m_collapsedWidgetParents; // widget of an expandable -> the expandable widget
 
     unity::scopes::QueryCtrlProxy m_lastPreviewQuery;
     QPointer<scopes_ng::Scope> m_associatedScope;
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// self
+#include "previewprefetcher.h"
+
+// local
+#include "collectors.h"
+#include "previewmodel.h"
+#include "querydispatcher.h"
+#include "resultsmap.h"
+#include "scope.h"
+
+// Qt
+#include <QDebug>
+#include <QEvent>
+#include <QSet>
+#include <QTimer>
+
+namespace scopes_ng
+{
+
+using namespace unity;
+
+// A single running preview query, receives the push events of its own listener
+class PrefetchQuery : public QObject
+{
+public:
+    PrefetchQuery(PreviewPrefetcher* prefetcher, scopes::Result::SPtr const& result_, quint64 fingerprint_):
+        QObject(prefetcher),
+        result(result_),
+        fingerprint(fingerprint_),
+        preview(new PrefetchedPreview),
+        m_prefetcher(prefetcher)
+    {
+    }
+
+    bool event(QEvent* ev) override
+    {
+        if (ev->type() != PushEvent::eventType) {
+            return QObject::event(ev);
+        }
+
+        PushEvent* pushEvent = static_cast<PushEvent*>(ev);
+        if (pushEvent->type() != PushEvent::PREVIEW) {
+            return false;
+        }
+
+        scopes::ColumnLayoutList columns;
+        scopes::PreviewWidgetList widgets;
+        QHash<QString, QVariant> data;
+        CollectorBase::Status status = pushEvent->collectPreviewData(columns, widgets, data);
+
+        if (!columns.empty()) {
+            preview->columns.swap(columns);
+        }
+        preview->widgets.insert(preview->widgets.end(), widgets.begin(), widgets.end());
+        for (auto it = data.constBegin(); it != data.constEnd(); ++it) {
+            preview->data.insert(it.key(), it.value());
+        }
+
+        m_prefetcher->queryChunk(this, status);
+        return true;
+    }
+
+    CollectionController controller;
+    scopes::Result::SPtr result;
+    quint64 fingerprint;
+    QSharedPointer<PrefetchedPreview> preview;
+
+private:
+    PreviewPrefetcher* m_prefetcher;
+};
+
+PreviewPrefetcher::PreviewPrefetcher(Scope* scope):
+    QObject(scope),
+    m_scope(scope),
+    m_issued(0),
+    m_hits(0),
+    m_misses(0),
+    m_wasted(0)
+{
+}
+
+PreviewPrefetcher::~PreviewPrefetcher()
+{
+    // the query controllers don't cancel on destruction, the runtime might be going away
+    for (auto query: m_running) {
+        delete query;
+    }
+}
+
+int PreviewPrefetcher::configuredDepth()
+{
+    if (!qEnvironmentVariableIsSet("UNITY_SCOPES_PREVIEW_PREFETCH")) {
+        return 0;
+    }
+    bool ok = false;
+    const int depth = qgetenv("UNITY_SCOPES_PREVIEW_PREFETCH").toInt(&ok);
+    return ok && depth > 0 ? depth : 0;
+}
+
+void PreviewPrefetcher::prefetch(QList<scopes::Result::SPtr> const& results, QUuid const& sessionId, QString const& userAgent)
+{
+    m_sessionId = sessionId;
+    m_userAgent = userAgent;
+
+    m_queue.clear();
+    QSet<quint64> queued;
+    for (auto const& result: results) {
+        const quint64 fp = ResultsMap::fingerprint(*result);
+        if (!isKnown(fp) && !queued.contains(fp)) {
+            queued.insert(fp);
+            m_queue.append(result);
+        }
+    }
+
+#ifdef VERBOSE_MODEL_UPDATES
+    qDebug() << "PreviewPrefetcher::prefetch(): queued" << m_queue.size() << "of" << results.size() << "results";
+#endif
+
+    startQueries();
+}
+
+bool PreviewPrefetcher::isKnown(quint64 fingerprint) const
+{
+    if (m_cache.contains(fingerprint)) {
+        return true;
+    }
+    for (auto query: m_running) {
+        if (query->fingerprint == fingerprint) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PreviewPrefetcher::startQueries()
+{
+    while (m_running.size() < MAX_RUNNING_QUERIES && !m_queue.isEmpty()) {
+        scopes::Result::SPtr result = m_queue.takeFirst();
+        PrefetchQuery* query = new PrefetchQuery(this, result, ResultsMap::fingerprint(*result));
+        // with UNITY_SCOPES_SYNC_DISPATCH the dispatch callback runs before dispatch() returns
+        m_issued++;
+        m_running.append(query);
+
+        try {
+            auto proxy = m_scope->proxy_for_result(result);
+            auto metadata = PreviewModel::previewMetadata(m_scope, m_sessionId, m_userAgent);
+            std::shared_ptr<PreviewDataReceiver> listener(new PreviewDataReceiver(query));
+            query->controller.setListener(listener);
+
+            scopes::Result res(*result);
+            QueryDispatcher::instance()->dispatch(query, "preview", [proxy, res, metadata, listener]() {
+                return proxy->preview(res, metadata, listener);
+            }, [this, query, listener](scopes::QueryCtrlProxy const& controller) {
+                if (controller) {
+                    query->controller.setController(listener, controller);
+                } else {
+                    // don't recurse into startQueries() from here, the loop above may still be running;
+                    // the call is dropped if the query gets cancelled in the meantime
+                    QTimer::singleShot(0, query, [this, query]() {
+                        queryChunk(query, CollectorBase::Status::UNKNOWN);
+                    });
+                }
+            });
+        } catch (std::exception& e) {
+            qWarning("PreviewPrefetcher: caught an error from preview(): %s", e.what());
+            m_running.removeOne(query);
+            m_wasted++;
+            delete query;
+        } catch (...) {
+            qWarning("PreviewPrefetcher: caught an error from preview()");
+            m_running.removeOne(query);
+            m_wasted++;
+            delete query;
+        }
+    }
+}
+
+void PreviewPrefetcher::queryChunk(PrefetchQuery* query, int status)
+{
+    if (status == CollectorBase::Status::INCOMPLETE) {
+        return;
+    }
+
+    m_running.removeOne(query);
+    if (status == CollectorBase::Status::FINISHED) {
+        query->preview->complete = true;
+        Entry entry;
+        entry.result = query->result;
+        entry.preview = query->preview;
+        cacheEntry(query->fingerprint, entry);
+    } else {
+        m_wasted++;
+    }
+    // we're inside the query's event handler
+    query->deleteLater();
+
+    startQueries();
+}
+
+void PreviewPrefetcher::cacheEntry(quint64 fingerprint, Entry const& entry)
+{
+    if (m_cache.contains(fingerprint)) {
+        m_cacheOrder.removeOne(fingerprint);
+    }
+    m_cache.insert(fingerprint, entry);
+    m_cacheOrder.append(fingerprint);
+
+    while (m_cacheOrder.size() > MAX_CACHED_PREVIEWS) {
+        dropEntry(m_cacheOrder.first());
+    }
+}
+
+void PreviewPrefetcher::dropEntry(quint64 fingerprint)
+{
+    if (m_cache.remove(fingerprint) > 0) {
+        m_cacheOrder.removeOne(fingerprint);
+        m_wasted++;
+    }
+}
+
+void PreviewPrefetcher::cancel()
+{
+    m_queue.clear();
+    for (auto query: m_running) {
+        query->controller.invalidate();
+        delete query;
+        m_wasted++;
+    }
+    m_running.clear();
+}
+
+void PreviewPrefetcher::clear()
+{
+    cancel();
+    while (!m_cacheOrder.isEmpty()) {
+        dropEntry(m_cacheOrder.first());
+    }
+}
+
+QSharedPointer<PrefetchedPreview> PreviewPrefetcher::take(scopes::Result const& result)
+{
+    const quint64 fp = ResultsMap::fingerprint(result);
+    auto it = m_cache.find(fp);
+    if (it == m_cache.end() || !(it->result->uri() == result.uri() && *(it->result) == result)) {
+        m_misses++;
+        return QSharedPointer<PrefetchedPreview>();
+    }
+
+    QSharedPointer<PrefetchedPreview> preview = it->preview;
+    m_cache.erase(it);
+    m_cacheOrder.removeOne(fp);
+    m_hits++;
+
+    return preview;
+}
+
+int PreviewPrefetcher::runningQueries() const
+{
+    return m_running.size();
+}
+
+int PreviewPrefetcher::queuedResults() const
+{
+    return m_queue.size();
+}
+
+int PreviewPrefetcher::cachedPreviews() const
+{
+    return m_cache.size();
+}
+
+quint64 PreviewPrefetcher::issuedQueries() const
+{
+    return m_issued;
+}
+
+quint64 PreviewPrefetcher::hits() const
+{
+    return m_hits;
+}
+
+quint64 PreviewPrefetcher::misses() const
+{
+    return m_misses;
+}
+
+quint64 PreviewPrefetcher::wastedQueries() const
+{
+    return m_wasted;
+}
+
+double PreviewPrefetcher::hitRate() const
+{
+    const quint64 total = m_hits + m_misses;
+    return total > 0 ? static_cast<double>(m_hits) / total : 0.0;
+}
+
+} // namespace scopes_ng
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NG_PREVIEW_PREFETCHER_H
+#define NG_PREVIEW_PREFETCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QSharedPointer>
+#include <QString>
+#include <QUuid>
+#include <QVariant>
+
+#include <memory>
+
+#include <unity/scopes/ColumnLayout.h>
+#include <unity/scopes/PreviewWidget.h>
+#include <unity/scopes/Result.h>
+
+namespace scopes_ng
+{
+
+class Scope;
+class PrefetchQuery;
+
+// Output of a preview query, accumulated from all the chunks of PreviewDataCollector
+struct PrefetchedPreview
+{
+    PrefetchedPreview(): complete(false) {}
+
+    unity::scopes::ColumnLayoutList columns;
+    unity::scopes::PreviewWidgetList widgets;
+    QHash<QString, QVariant> data;
+    bool complete;
+};
+
+/*
+ * Runs preview queries for results the user is likely to open next (the first few
+ * results of the top categories), so that the preview can be shown right away.
+ * Only a couple of queries run at once, the rest wait in a queue; completed previews
+ * are kept in a small cache keyed by result fingerprint.
+ */
+class Q_DECL_EXPORT PreviewPrefetcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int MAX_RUNNING_QUERIES = 2;
+    static const int MAX_CACHED_PREVIEWS = 32;
+
+    explicit PreviewPrefetcher(Scope* scope);
+    ~PreviewPrefetcher();
+
+    // replaces the queue of results waiting for a preview query; cached or running results are skipped
+    void prefetch(QList<std::shared_ptr<unity::scopes::Result>> const& results, QUuid const& sessionId, QString const& userAgent);
+    // cancels running and queued queries, completed previews stay cached
+    void cancel();
+    // cancels everything and drops the cache
+    void clear();
+
+    // returns the cached preview of the result (if any) and removes it from the cache
+    QSharedPointer<PrefetchedPreview> take(unity::scopes::Result const& result);
+
+    int runningQueries() const;
+    int queuedResults() const;
+    int cachedPreviews() const;
+
+    quint64 issuedQueries() const;
+    quint64 hits() const;
+    quint64 misses() const;
+    quint64 wastedQueries() const; // cancelled, failed or evicted before being used
+    double hitRate() const;
+
+    // number of results per category to prefetch, 0 if prefetching is disabled (see UNITY_SCOPES_PREVIEW_PREFETCH)
+    static int configuredDepth();
+
+private:
+    friend class PrefetchQuery;
+
+    struct Entry
+    {
+        std::shared_ptr<unity::scopes::Result> result;
+        QSharedPointer<PrefetchedPreview> preview;
+    };
+
+    void queryChunk(PrefetchQuery* query, int status);
+    void startQueries();
+    void cacheEntry(quint64 fingerprint, Entry const& entry);
+    void dropEntry(quint64 fingerprint);
+    bool isKnown(quint64 fingerprint) const;
+
+    Scope* m_scope;
+    QUuid m_sessionId;
+    QString m_userAgent;
+    QList<std::shared_ptr<unity::scopes::Result>> m_queue;
+    QList<PrefetchQuery*> m_running;
+    QHash<quint64, Entry> m_cache;
+    QList<quint64> m_cacheOrder; // oldest first
+    quint64 m_issued;
+    quint64 m_hits;
+    quint64 m_misses;
+    quint64 m_wasted;
+};
+
+} // namespace scopes_ng
+
+#endif // NG_PREVIEW_PREFETCHER_H
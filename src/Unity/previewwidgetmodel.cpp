@@ -84,7 +84,7 @@ void PreviewWidgetModel::addWidgets(QList<QSharedPointer<PreviewWidgetData>> con
     if (widgetList.size() == 0) return;
 
     beginInsertRows(QModelIndex(), m_previewWidgetsOrdered.count(), m_previewWidgetsOrdered.size() + widgetList.size() - 1);
-    int pos = 0;
+    int pos = m_previewWidgetsOrdered.size();
     Q_FOREACH(QSharedPointer<PreviewWidgetData> const& w, widgetList) {
         m_previewWidgetsOrdered.append(w);
         m_previewWidgetsIndex.insert(w->id, pos++);
@@ -134,18 +134,30 @@ void PreviewWidgetModel::clearWidgets()
 
 bool PreviewWidgetModel::widgetChanged(PreviewWidgetData* widget)
 {
-    for (int i = 0; i < m_previewWidgetsOrdered.size(); i++) {
-        if (m_previewWidgetsOrdered[i].data() == widget) {
-            QModelIndex changedIndex(index(i));
-            QVector<int> changedRoles;
-            changedRoles.append(PreviewWidgetModel::RoleProperties);
-            dataChanged(changedIndex, changedIndex, changedRoles);
-
-            return true;
+    int row = widgetIndex(widget->id);
+    if (row < 0) {
+        return false;
+    }
+    if (row >= m_previewWidgetsOrdered.size() || m_previewWidgetsOrdered[row].data() != widget) {
+        // the lookup is by id, fall back to a scan if another widget has the same id
+        row = -1;
+        for (int i = 0; i < m_previewWidgetsOrdered.size(); i++) {
+            if (m_previewWidgetsOrdered[i].data() == widget) {
+                row = i;
+                break;
+            }
+        }
+        if (row < 0) {
+            return false;
         }
     }
 
-    return false;
+    QModelIndex changedIndex(index(row));
+    QVector<int> changedRoles;
+    changedRoles.append(PreviewWidgetModel::RoleProperties);
+    dataChanged(changedIndex, changedIndex, changedRoles);
+
+    return true;
 }
 
 void PreviewWidgetModel::removeWidget(QSharedPointer<PreviewWidgetData> const& widget)
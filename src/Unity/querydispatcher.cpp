@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// self
+#include "querydispatcher.h"
+
+// Qt
+#include <QDebug>
+#include <QFutureWatcher>
+#include <QPointer>
+#include <QThread>
+#include <QtConcurrent>
+
+#include <string>
+
+#include <unity/scopes/QueryCtrl.h>
+
+namespace scopes_ng
+{
+
+using namespace unity;
+
+SearchRequest::SearchRequest(scopes::ScopeProxy const& proxy, std::string const& query, std::string const& departmentId,
+        scopes::FilterState const& filterState, scopes::Variant const* userData,
+        scopes::SearchMetadata const& metadata, scopes::SearchListenerBase::SPtr const& listener):
+    m_proxy(proxy),
+    m_query(query),
+    m_departmentId(departmentId),
+    m_filterState(filterState),
+    m_userData(userData ? std::make_shared<const scopes::Variant>(*userData) : nullptr),
+    m_metadata(metadata),
+    m_listener(listener)
+{
+}
+
+scopes::QueryCtrlProxy SearchRequest::run() const
+{
+    return m_userData ?
+        m_proxy->search(m_query, m_departmentId, m_filterState, *m_userData, m_metadata, m_listener) :
+        m_proxy->search(m_query, m_departmentId, m_filterState, m_metadata, m_listener);
+}
+
+QueryDispatcher::QueryDispatcher():
+    m_pending(0),
+    m_synchronous(isSynchronous())
+{
+    m_pool.setMaxThreadCount(configuredThreads());
+}
+
+QueryDispatcher* QueryDispatcher::instance()
+{
+    static QueryDispatcher dispatcher;
+    return &dispatcher;
+}
+
+int QueryDispatcher::configuredThreads()
+{
+    if (qEnvironmentVariableIsSet("UNITY_SCOPES_DISPATCH_THREADS")) {
+        const int threads = qgetenv("UNITY_SCOPES_DISPATCH_THREADS").toInt();
+        if (threads > 0) {
+            return threads;
+        }
+    }
+    return DEFAULT_THREADS;
+}
+
+bool QueryDispatcher::isSynchronous()
+{
+    return qEnvironmentVariableIsSet("UNITY_SCOPES_SYNC_DISPATCH");
+}
+
+void QueryDispatcher::dispatch(QObject* context, char const* what, Call const& call, Callback const& callback)
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+
+    QPointer<QObject> guard(context);
+    std::string name(what);
+
+    if (m_synchronous) {
+        scopes::QueryCtrlProxy controller;
+        try {
+            controller = call();
+        } catch (std::exception& e) {
+            qWarning("Caught an error from %s(): %s", name.c_str(), e.what());
+        } catch (...) {
+            qWarning("Caught an error from %s()", name.c_str());
+        }
+        callback(controller);
+        return;
+    }
+
+    auto watcher = new QFutureWatcher<scopes::QueryCtrlProxy>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, guard, callback]() {
+        m_pending--;
+        scopes::QueryCtrlProxy controller = watcher->result();
+        watcher->deleteLater();
+
+        if (guard) {
+            callback(controller);
+        } else if (controller) {
+            // nobody is interested in the results anymore
+            try {
+                controller->cancel();
+            } catch (...) {
+            }
+        }
+    });
+
+    m_pending++;
+    watcher->setFuture(QtConcurrent::run(&m_pool, [call, name]() -> scopes::QueryCtrlProxy {
+        try {
+            return call();
+        } catch (std::exception& e) {
+            qWarning("Caught an error from %s(): %s", name.c_str(), e.what());
+        } catch (...) {
+            qWarning("Caught an error from %s()", name.c_str());
+        }
+        return scopes::QueryCtrlProxy();
+    }));
+}
+
+int QueryDispatcher::pendingCalls() const
+{
+    return m_pending;
+}
+
+} // namespace scopes_ng
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NG_QUERY_DISPATCHER_H
+#define NG_QUERY_DISPATCHER_H
+
+#include <QObject>
+#include <QThreadPool>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <unity/scopes/FilterState.h>
+#include <unity/scopes/QueryCtrlProxyFwd.h>
+#include <unity/scopes/Scope.h>
+#include <unity/scopes/SearchListenerBase.h>
+#include <unity/scopes/SearchMetadata.h>
+#include <unity/scopes/Variant.h>
+
+namespace scopes_ng
+{
+
+// Snapshot of everything a search needs, taken on the UI thread so that the query can be created elsewhere
+class Q_DECL_EXPORT SearchRequest
+{
+public:
+    SearchRequest(unity::scopes::ScopeProxy const& proxy, std::string const& query, std::string const& departmentId,
+            unity::scopes::FilterState const& filterState, unity::scopes::Variant const* userData,
+            unity::scopes::SearchMetadata const& metadata, unity::scopes::SearchListenerBase::SPtr const& listener);
+
+    unity::scopes::QueryCtrlProxy run() const;
+
+private:
+    unity::scopes::ScopeProxy m_proxy;
+    std::string m_query;
+    std::string m_departmentId;
+    unity::scopes::FilterState m_filterState;
+    std::shared_ptr<const unity::scopes::Variant> m_userData;
+    unity::scopes::SearchMetadata m_metadata;
+    unity::scopes::SearchListenerBase::SPtr m_listener;
+};
+
+/*
+ * Issues scope queries (preview, activation, actions) from a small thread pool.
+ * Creating a query is a twoway call into the scope process, which would block
+ * the UI thread for as long as the scope takes to set the query up.
+ * The query controller is handed back on the UI thread.
+ */
+class Q_DECL_EXPORT QueryDispatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<unity::scopes::QueryCtrlProxy()> Call;
+    typedef std::function<void(unity::scopes::QueryCtrlProxy const&)> Callback;
+
+    static const int DEFAULT_THREADS = 4;
+
+    // must be first called from the UI thread
+    static QueryDispatcher* instance();
+
+    // Runs call on the dispatch pool; callback is invoked on the UI thread with the query controller,
+    // which is null if call threw. If context gets destroyed before that, the query is cancelled instead.
+    void dispatch(QObject* context, char const* what, Call const& call, Callback const& callback);
+
+    int pendingCalls() const;
+
+    // size of the pool, can be overridden with UNITY_SCOPES_DISPATCH_THREADS
+    static int configuredThreads();
+    // UNITY_SCOPES_SYNC_DISPATCH makes dispatch() run the calls right away on the calling thread
+    static bool isSynchronous();
+
+private:
+    QueryDispatcher();
+
+    QThreadPool m_pool;
+    int m_pending;
+    bool m_synchronous;
+};
+
+} // namespace scopes_ng
+
+#endif // NG_QUERY_DISPATCHER_H
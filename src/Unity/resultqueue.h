@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NG_RESULT_QUEUE_H
+#define NG_RESULT_QUEUE_H
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace scopes_ng
+{
+
+/*
+ * Lock-free multi-producer, single-consumer queue.
+ * Producers push individual items from any thread, the consumer takes
+ * everything that was pushed so far in one go (in push order).
+ * Nodes are carved out of chunks owned by the queue, so pushing doesn't
+ * allocate per item.
+ */
+template<typename T>
+class ResultQueue
+{
+public:
+    // number of nodes allocated at once; node storage is only released
+    // when the queue is destroyed (i.e. with the search that owns it)
+    static const int CHUNK_SIZE = 256;
+
+    ResultQueue(): m_head(nullptr), m_chunk(new Chunk(nullptr)), m_allocatedChunks(1)
+    {
+    }
+
+    ~ResultQueue()
+    {
+        Node* node = m_head.exchange(nullptr);
+        while (node) {
+            Node* next = node->next;
+            node->~Node();
+            node = next;
+        }
+
+        Chunk* chunk = m_chunk.load();
+        while (chunk) {
+            Chunk* prev = chunk->prev;
+            delete chunk;
+            chunk = prev;
+        }
+    }
+
+    ResultQueue(ResultQueue const&) = delete;
+    ResultQueue& operator=(ResultQueue const&) = delete;
+
+    // can be called from any number of threads concurrently
+    void push(T value)
+    {
+        Node* node = new (allocateNode()) Node(std::move(value));
+        node->next = m_head.load(std::memory_order_relaxed);
+        while (!m_head.compare_exchange_weak(node->next, node)) {
+        }
+    }
+
+    // only one consumer may call this at a time; returns number of items appended to out
+    template<typename Container>
+    int takeAll(Container& out)
+    {
+        Node* node = m_head.exchange(nullptr);
+
+        // the list is in LIFO order, reverse it first
+        Node* head = nullptr;
+        int count = 0;
+        while (node) {
+            Node* next = node->next;
+            node->next = head;
+            head = node;
+            node = next;
+            count++;
+        }
+
+        out.reserve(out.size() + count);
+        while (head) {
+            Node* next = head->next;
+            out.push_back(std::move(head->value));
+            head->~Node();
+            head = next;
+        }
+
+        return count;
+    }
+
+    bool isEmpty() const
+    {
+        return m_head.load() == nullptr;
+    }
+
+    int allocatedChunks() const
+    {
+        return m_allocatedChunks.load();
+    }
+
+private:
+    struct Node
+    {
+        explicit Node(T&& v): value(std::move(v)), next(nullptr) {}
+
+        T value;
+        Node* next;
+    };
+
+    struct Chunk
+    {
+        explicit Chunk(Chunk* prev_): used(0), prev(prev_) {}
+
+        typename std::aligned_storage<sizeof(Node), alignof(Node)>::type nodes[CHUNK_SIZE];
+        std::atomic<int> used;
+        Chunk* prev;
+    };
+
+    void* allocateNode()
+    {
+        for (;;) {
+            Chunk* chunk = m_chunk.load();
+            const int index = chunk->used.fetch_add(1);
+            if (index < CHUNK_SIZE) {
+                return &chunk->nodes[index];
+            }
+
+            // chunk exhausted, only one of the producers gets to replace it
+            std::lock_guard<std::mutex> lock(m_chunkMutex);
+            if (m_chunk.load() == chunk) {
+                m_chunk.store(new Chunk(chunk));
+                m_allocatedChunks++;
+            }
+        }
+    }
+
+    std::atomic<Node*> m_head;
+    std::atomic<Chunk*> m_chunk;
+    std::atomic<int> m_allocatedChunks;
+    std::mutex m_chunkMutex;
+};
+
+} // namespace scopes_ng
+
+#endif // NG_RESULT_QUEUE_H
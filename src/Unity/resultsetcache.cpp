@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// self
+#include "resultsetcache.h"
+
+#include <algorithm>
+
+namespace scopes_ng
+{
+
+using namespace unity;
+
+namespace
+{
+
+// rough per-result overhead of the Result object and its attribute map
+const qint64 RESULT_OVERHEAD = 256;
+
+void appendField(QByteArray& key, std::string const& value)
+{
+    key.append(QByteArray::number(static_cast<qulonglong>(value.size())));
+    key.append(':');
+    key.append(value.data(), static_cast<int>(value.size()));
+}
+
+}
+
+ResultSetCache::ResultSetCache(qint64 maxBytes):
+    m_maxBytes(maxBytes),
+    m_usedBytes(0),
+    m_hits(0),
+    m_misses(0),
+    m_expired(0),
+    m_evictions(0)
+{
+    m_clock.start();
+}
+
+qint64 ResultSetCache::configuredMaxBytes()
+{
+    if (qEnvironmentVariableIsSet("UNITY_SCOPES_RESULT_CACHE_SIZE")) {
+        return std::max(qgetenv("UNITY_SCOPES_RESULT_CACHE_SIZE").toLongLong(), Q_INT64_C(0)) * 1024;
+    }
+    return DEFAULT_MAX_KBYTES * 1024;
+}
+
+QByteArray ResultSetCache::key(std::string const& query, std::string const& departmentId, scopes::FilterState const& filterState,
+        QString const& formFactor, QString const& locale, scopes::Variant const* userData)
+{
+    // length-prefixed, so that the fields can't run into each other
+    QByteArray key;
+    appendField(key, query);
+    appendField(key, departmentId);
+    appendField(key, scopes::Variant(filterState.serialize()).serialize_json());
+    appendField(key, formFactor.toStdString());
+    appendField(key, locale.toStdString());
+    appendField(key, userData ? userData->serialize_json() : std::string());
+    return key;
+}
+
+qint64 ResultSetCache::estimateSize(CachedResultSet const& resultSet)
+{
+    qint64 bytes = 0;
+    for (auto const& result: resultSet.results) {
+        bytes += RESULT_OVERHEAD + result->uri().size() + result->title().size() + result->art().size() + result->dnd_uri().size();
+    }
+    return bytes;
+}
+
+void ResultSetCache::insert(QByteArray const& key, QSharedPointer<const CachedResultSet> const& resultSet, qint64 ttl)
+{
+    remove(key);
+
+    Entry entry;
+    entry.resultSet = resultSet;
+    entry.bytes = estimateSize(*resultSet) + key.size();
+    entry.expiresAt = ttl > 0 ? m_clock.elapsed() + ttl : -1;
+    if (entry.bytes > m_maxBytes) {
+        return;
+    }
+
+    m_entries.insert(key, entry);
+    m_order.append(key);
+    m_usedBytes += entry.bytes;
+    shrink();
+}
+
+QSharedPointer<const CachedResultSet> ResultSetCache::lookup(QByteArray const& key)
+{
+    auto it = m_entries.constFind(key);
+    if (it == m_entries.constEnd()) {
+        m_misses++;
+        return QSharedPointer<const CachedResultSet>();
+    }
+
+    if (it->expiresAt >= 0 && it->expiresAt <= m_clock.elapsed()) {
+        m_expired++;
+        m_misses++;
+        remove(key);
+        return QSharedPointer<const CachedResultSet>();
+    }
+
+    QSharedPointer<const CachedResultSet> resultSet = it->resultSet;
+    m_order.removeOne(key);
+    m_order.append(key);
+    m_hits++;
+    return resultSet;
+}
+
+void ResultSetCache::remove(QByteArray const& key)
+{
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        m_usedBytes -= it->bytes;
+        m_entries.erase(it);
+        m_order.removeOne(key);
+    }
+}
+
+void ResultSetCache::shrink()
+{
+    while (m_usedBytes > m_maxBytes && !m_order.isEmpty()) {
+        const QByteArray oldest = m_order.first();
+        remove(oldest);
+        m_evictions++;
+    }
+}
+
+void ResultSetCache::clear()
+{
+    m_entries.clear();
+    m_order.clear();
+    m_usedBytes = 0;
+}
+
+void ResultSetCache::setMaxBytes(qint64 maxBytes)
+{
+    m_maxBytes = maxBytes;
+    shrink();
+}
+
+qint64 ResultSetCache::maxBytes() const
+{
+    return m_maxBytes;
+}
+
+qint64 ResultSetCache::usedBytes() const
+{
+    return m_usedBytes;
+}
+
+int ResultSetCache::size() const
+{
+    return m_entries.size();
+}
+
+quint64 ResultSetCache::hits() const
+{
+    return m_hits;
+}
+
+quint64 ResultSetCache::misses() const
+{
+    return m_misses;
+}
+
+quint64 ResultSetCache::expired() const
+{
+    return m_expired;
+}
+
+quint64 ResultSetCache::evictions() const
+{
+    return m_evictions;
+}
+
+} // namespace scopes_ng
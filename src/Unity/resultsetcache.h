@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NG_RESULT_SET_CACHE_H
+#define NG_RESULT_SET_CACHE_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+#include <memory>
+#include <string>
+
+#include <unity/scopes/CategorisedResult.h>
+#include <unity/scopes/Department.h>
+#include <unity/scopes/FilterBase.h>
+#include <unity/scopes/FilterState.h>
+#include <unity/scopes/Variant.h>
+
+namespace scopes_ng
+{
+
+// Final state of a finished search
+struct CachedResultSet
+{
+    QVector<std::shared_ptr<unity::scopes::CategorisedResult>> results; // in category order
+    unity::scopes::Department::SCPtr rootDepartment;
+    QList<unity::scopes::FilterBase::SCPtr> filters;
+};
+
+/*
+ * LRU cache of finished searches of a single scope, so that going back to
+ * a query shown not long ago can display its results right away.
+ * Entries expire after the results TTL of the scope; the total (estimated)
+ * size of the cached results is bounded.
+ */
+class Q_DECL_EXPORT ResultSetCache
+{
+public:
+    static const int DEFAULT_MAX_KBYTES = 1024;
+
+    explicit ResultSetCache(qint64 maxBytes);
+
+    static QByteArray key(std::string const& query, std::string const& departmentId, unity::scopes::FilterState const& filterState,
+            QString const& formFactor, QString const& locale, unity::scopes::Variant const* userData = nullptr);
+
+    // ttl in milliseconds, 0 means the entry doesn't expire
+    void insert(QByteArray const& key, QSharedPointer<const CachedResultSet> const& resultSet, qint64 ttl);
+    QSharedPointer<const CachedResultSet> lookup(QByteArray const& key);
+    void clear();
+
+    void setMaxBytes(qint64 maxBytes);
+    qint64 maxBytes() const;
+    qint64 usedBytes() const;
+    int size() const;
+
+    quint64 hits() const;
+    quint64 misses() const;
+    quint64 expired() const;
+    quint64 evictions() const;
+
+    // UNITY_SCOPES_RESULT_CACHE_SIZE (in kB) overrides the default, 0 disables the cache
+    static qint64 configuredMaxBytes();
+    static qint64 estimateSize(CachedResultSet const& resultSet);
+
+private:
+    struct Entry
+    {
+        QSharedPointer<const CachedResultSet> resultSet;
+        qint64 bytes;
+        qint64 expiresAt; // on m_clock, -1 if the entry doesn't expire
+    };
+
+    void remove(QByteArray const& key);
+    void shrink();
+
+    QHash<QByteArray, Entry> m_entries;
+    QList<QByteArray> m_order; // least recently used first
+    QElapsedTimer m_clock;
+    qint64 m_maxBytes;
+    qint64 m_usedBytes;
+    quint64 m_hits;
+    quint64 m_misses;
+    quint64 m_expired;
+    quint64 m_evictions;
+};
+
+} // namespace scopes_ng
+
+#endif // NG_RESULT_SET_CACHE_H
@@ -20,58 +20,205 @@
 #include "resultsmap.h"
 #include <QDebug>
 
-ResultsMap::ResultsMap(QList<std::shared_ptr<unity::scopes::CategorisedResult>> &results)
+#include <cstring>
+
+namespace
+{
+
+const quint64 FNV_OFFSET = 14695981039346656037ULL;
+const quint64 FNV_PRIME = 1099511628211ULL;
+
+inline quint64 hashWord(quint64 hash, quint64 value)
+{
+    return (hash ^ value) * FNV_PRIME;
+}
+
+inline quint64 hashString(quint64 hash, std::string const& str)
+{
+    for (unsigned char c: str) {
+        hash = (hash ^ c) * FNV_PRIME;
+    }
+    return hashWord(hash, str.size());
+}
+
+quint64 hashVariant(quint64 hash, unity::scopes::Variant const& variant)
 {
+    hash = hashWord(hash, static_cast<quint64>(variant.which()));
+    switch (variant.which()) {
+        case unity::scopes::Variant::Type::Null:
+            return hash;
+        case unity::scopes::Variant::Type::Int:
+            return hashWord(hash, static_cast<quint64>(variant.get_int()));
+        case unity::scopes::Variant::Type::Bool:
+            return hashWord(hash, variant.get_bool());
+        case unity::scopes::Variant::Type::String:
+            return hashString(hash, variant.get_string());
+        case unity::scopes::Variant::Type::Double: {
+            const double value = variant.get_double();
+            quint64 bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return hashWord(hash, bits);
+        }
+        case unity::scopes::Variant::Type::Dict:
+            for (auto const& kv: variant.get_dict()) {
+                hash = hashString(hash, kv.first);
+                hash = hashVariant(hash, kv.second);
+            }
+            return hash;
+        case unity::scopes::Variant::Type::Array:
+            for (auto const& element: variant.get_array()) {
+                hash = hashVariant(hash, element);
+            }
+            return hash;
+        default:
+            return hashString(hash, variant.serialize_json());
+    }
+}
+
+}
+
+FingerprintedResult::FingerprintedResult(unity::scopes::CategorisedResult&& result)
+    : unity::scopes::CategorisedResult(std::move(result)),
+      m_fingerprint(0),
+      m_hasFingerprint(false)
+{
+}
+
+ResultsMap::ResultsMap(QVector<std::shared_ptr<unity::scopes::CategorisedResult>> &results)
+{
+    reserve(results.size());
     update(results, 0);
 }
 
+quint64 ResultsMap::fingerprint(unity::scopes::Result const& result)
+{
+    auto fingerprinted = dynamic_cast<FingerprintedResult const*>(&result);
+    if (!fingerprinted) {
+        return computeFingerprint(result);
+    }
+    if (!fingerprinted->m_hasFingerprint) {
+        fingerprinted->m_fingerprint = computeFingerprint(result);
+        fingerprinted->m_hasFingerprint = true;
+    }
+    return fingerprinted->m_fingerprint;
+}
+
+quint64 ResultsMap::computeFingerprint(unity::scopes::Result const& result)
+{
+    // only attributes are hashed; anything else Result::operator== looks at is
+    // covered by the full comparison done on fingerprint match
+    auto const serialized = result.serialize();
+    auto const it = serialized.find("attrs");
+    quint64 hash = hashString(FNV_OFFSET, result.uri());
+    return hashVariant(hash, it != serialized.end() ? it->second : unity::scopes::Variant(serialized));
+}
+
 void ResultsMap::rebuild(QList<std::shared_ptr<unity::scopes::Result>> &results)
 {
-    m_results.clear();
+    clear();
+    reserve(results.size());
     update(results, 0);
 }
 
+int ResultsMap::findSlot(unity::scopes::Result const& result, quint64 fingerprint) const
+{
+    if (m_slots.empty()) {
+        return -1;
+    }
+
+    const size_t mask = m_slots.size() - 1;
+    for (size_t i = fingerprint & mask; m_slots[i].result; i = (i + 1) & mask) {
+        Slot const& slot = m_slots[i];
+        if (slot.fingerprint == fingerprint &&
+            (slot.result.get() == &result || (slot.result->uri() == result.uri() && *(slot.result) == result))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 int ResultsMap::find(std::shared_ptr<unity::scopes::Result> const& result) const
 {
     Q_ASSERT(result != nullptr);
-    auto it = m_results.find(result->uri());
-    if (it != m_results.end()) {
-        Q_ASSERT(it->second.result != nullptr);
-        while (it != m_results.end() && it->second.result->uri() == result->uri())
-        {
-            if (*(it->second.result) == *result) {
-                return it->second.index;
+    return find(result, fingerprint(*result));
+}
+
+int ResultsMap::find(std::shared_ptr<unity::scopes::Result> const& result, quint64 fingerprint) const
+{
+    Q_ASSERT(result != nullptr);
+    const int slot = findSlot(*result, fingerprint);
+    return slot >= 0 ? m_slots[slot].index : -1;
+}
+
+void ResultsMap::insert(std::shared_ptr<unity::scopes::Result> const& result, quint64 fingerprint, int index)
+{
+    reserve(m_count + 1);
+
+    const size_t mask = m_slots.size() - 1;
+    size_t i = fingerprint & mask;
+    while (m_slots[i].result) {
+        i = (i + 1) & mask;
+    }
+    m_slots[i].result = result;
+    m_slots[i].fingerprint = fingerprint;
+    m_slots[i].index = index;
+    m_count++;
+}
+
+void ResultsMap::reserve(int count)
+{
+    // keep the load factor at or below 0.5
+    size_t capacity = 16;
+    while (capacity < static_cast<size_t>(count) * 2) {
+        capacity *= 2;
+    }
+    if (capacity <= m_slots.size()) {
+        return;
+    }
+
+    std::vector<Slot> old(capacity);
+    old.swap(m_slots);
+
+    const size_t mask = m_slots.size() - 1;
+    for (auto& slot: old) {
+        if (slot.result) {
+            size_t i = slot.fingerprint & mask;
+            while (m_slots[i].result) {
+                i = (i + 1) & mask;
             }
-            ++it;
+            m_slots[i] = std::move(slot);
         }
     }
-    return -1;
 }
 
 void ResultsMap::updateIndices(QList<std::shared_ptr<unity::scopes::Result>> const &results, int start, int end)
 {
     for (int i = start; (i<=end && i<results.size()); i++) {
-        auto const result = results[i];
-        auto it = m_results.find(result->uri());
-        while (it != m_results.end() && it->second.result->uri() == result->uri())
-        {
-            if (*(it->second.result) == *result) {
-                it->second.index = i;
-            }
-            ++it;
+        auto const& result = results[i];
+        const int slot = findSlot(*result, fingerprint(*result));
+        if (slot >= 0) {
+            m_slots[slot].index = i;
         }
     }
 }
 
 void ResultsMap::clear()
 {
-    m_results.clear();
+    m_slots.clear();
+    m_count = 0;
+}
+
+int ResultsMap::size() const
+{
+    return m_count;
 }
 
 void ResultsMap::dump(QString const& msg)
 {
     qDebug() << "--- ResultsMap" << msg << "---";
-    for (auto it = m_results.begin(); it != m_results.end(); it++) {
-        qDebug() << QString::fromStdString(it->first) << "->" << QString::fromStdString(it->second.result->uri()) << "@" << it->second.index;
+    for (auto const& slot: m_slots) {
+        if (slot.result) {
+            qDebug() << QString::fromStdString(slot.result->uri()) << "@" << slot.index << "fingerprint" << slot.fingerprint;
+        }
     }
 }
@@ -21,34 +21,55 @@
 #define NG_RESULTS_MAP_H
 
 #include <QList>
+#include <QVector>
 #include <memory>
 #include <unity/scopes/CategorisedResult.h>
-#include <map>
+#include <vector>
 
 /**
-  Helper class for Result -> row lookups, maintains a multimap internally
-  allowing for duplicated Result uris.
+  CategorisedResult that keeps its ResultsMap fingerprint, so that it's computed
+  only once; results aren't modified once they have been received.
 */
-class ResultsMap
+class Q_DECL_EXPORT FingerprintedResult : public unity::scopes::CategorisedResult
+{
+    public:
+        explicit FingerprintedResult(unity::scopes::CategorisedResult&& result);
+
+    private:
+        friend class ResultsMap;
+
+        // set by ResultsMap::fingerprint() on first use, on the UI thread
+        mutable quint64 m_fingerprint;
+        mutable bool m_hasFingerprint;
+};
+
+/**
+  Helper class for Result -> row lookups. Results are kept in a flat open-addressing
+  hash table keyed by a 64-bit fingerprint of the result (uri + attributes); results
+  with colliding fingerprints are told apart by their uri and full comparison.
+  Duplicated Result uris are allowed.
+*/
+class Q_DECL_EXPORT ResultsMap
 {
     public:
         ResultsMap() = default;
 
         // note: this constructor modifies the input results list (de-duplicates it).
-        ResultsMap(QList<std::shared_ptr<unity::scopes::CategorisedResult>> &results);
+        ResultsMap(QVector<std::shared_ptr<unity::scopes::CategorisedResult>> &results);
         int find(std::shared_ptr<unity::scopes::Result> const& result) const;
+        int find(std::shared_ptr<unity::scopes::Result> const& result, quint64 fingerprint) const;
 
         void rebuild(QList<std::shared_ptr<unity::scopes::Result>> &results);
 
-        template <typename ResultType>
-        void update(QList<std::shared_ptr<ResultType>> &results, int start)
+        template <typename ResultList>
+        void update(ResultList &results, int start)
         {
             int pos = start;
             for (auto it = results.begin() + start; it != results.end(); ) {
-                std::shared_ptr<ResultType> result = *it;
-                if (find(result) < 0) {
-                    const ResultPos rpos { result, pos++ };
-                    m_results.insert({result->uri(), rpos });
+                typename ResultList::value_type result = *it;
+                const quint64 fp = fingerprint(*result);
+                if (find(result, fp) < 0) {
+                    insert(result, fp, pos++);
                     ++it;
                 } else {
                     // remove duplicate from the input results array
@@ -59,14 +80,26 @@ class ResultsMap
 
         void updateIndices(QList<std::shared_ptr<unity::scopes::Result>> const &results, int start, int end);
         void clear();
+        int size() const;
         void dump(QString const& msg);
 
+        // remembered by FingerprintedResult instances
+        static quint64 fingerprint(unity::scopes::Result const& result);
+        static quint64 computeFingerprint(unity::scopes::Result const& result);
+
     private:
-        struct ResultPos {
-            std::shared_ptr<unity::scopes::Result> result;
+        struct Slot {
+            std::shared_ptr<unity::scopes::Result> result; // nullptr for empty slot
+            quint64 fingerprint;
             int index;
         };
-        std::multimap<std::string, ResultPos> m_results;
+
+        int findSlot(unity::scopes::Result const& result, quint64 fingerprint) const;
+        void insert(std::shared_ptr<unity::scopes::Result> const& result, quint64 fingerprint, int index);
+        void reserve(int count);
+
+        std::vector<Slot> m_slots; // size is always a power of 2
+        int m_count = 0;
 };
 
 #endif
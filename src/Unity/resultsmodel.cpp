@@ -23,8 +23,9 @@
 // local
 #include "utils.h"
 #include "iconutils.h"
+#include "modelupdate.h"
 
-#include <map>
+#include <algorithm>
 #include <QDebug>
 
 namespace scopes_ng {
@@ -34,16 +35,16 @@ using namespace unity;
 void SearchContext::reset()
 {
     newResultsMap.clear();
-    oldResultsMap.clear();
     lastResultIndex = 0;
 }
 
 ResultsModel::ResultsModel(QObject* parent)
  : unity::shell::scopes::ResultsModelInterface(parent)
+ , m_dataCacheHits(0)
  , m_maxAttributes(2)
  , m_purge(true)
 {
-    m_componentMapping.resize(RoleSocialActions + 1);
+    m_componentFields.resize(RoleSocialActions + 1);
 }
 
 QString ResultsModel::categoryId() const
@@ -61,54 +62,66 @@ void ResultsModel::setCategoryId(QString const& id)
 
 void ResultsModel::setComponentsMapping(QHash<QString, QString> const& mapping)
 {
-    QVector<std::string> newMapping(RoleSocialActions + 1);
+    static const QHash<QString, Roles> componentRoles {
+        { QStringLiteral("title"), RoleTitle },
+        { QStringLiteral("attributes"), RoleAttributes },
+        { QStringLiteral("art"), RoleArt },
+        { QStringLiteral("subtitle"), RoleSubtitle },
+        { QStringLiteral("mascot"), RoleMascot },
+        { QStringLiteral("emblem"), RoleEmblem },
+        { QStringLiteral("summary"), RoleSummary },
+        { QStringLiteral("background"), RoleBackground },
+        { QStringLiteral("overlay-color"), RoleOverlayColor },
+        { QStringLiteral("quick-preview-data"), RoleQuickPreviewData },
+        { QStringLiteral("social-actions"), RoleSocialActions }
+    };
+
+    QVector<ComponentField> newFields(RoleSocialActions + 1);
     for (auto it = mapping.begin(); it != mapping.end(); ++it) {
-        Roles field;
-        const QString fieldName = it.key();
-        if (fieldName == QLatin1String("title")) {
-            field = RoleTitle;
-        } else if (fieldName == QLatin1String("attributes")) {
-            field = RoleAttributes;
-        } else if (fieldName == QLatin1String("art")) {
-            field = RoleArt;
-        } else if (fieldName == QLatin1String("subtitle")) {
-            field = RoleSubtitle;
-        } else if (fieldName == QLatin1String("mascot")) {
-            field = RoleMascot;
-        } else if (fieldName == QLatin1String("emblem")) {
-            field = RoleEmblem;
-        } else if (fieldName == QLatin1String("summary")) {
-            field = RoleSummary;
-        } else if (fieldName == QLatin1String("background")) {
-            field = RoleBackground;
-        } else if (fieldName == QLatin1String("overlay-color")) {
-            field = RoleOverlayColor;
-        } else if (fieldName == QLatin1String("quick-preview-data")) {
-            field = RoleQuickPreviewData;
-        } else if (fieldName == QLatin1String("social-actions")) {
-            field = RoleSocialActions;
-        } else {
-            qDebug() << "Unknown components field" << fieldName;
-            break;
+        auto role = componentRoles.constFind(it.key());
+        if (role == componentRoles.constEnd()) {
+            qDebug() << "Unknown components field" << it.key();
+            continue;
+        }
+        if (it.value().isEmpty()) {
+            continue;
+        }
+
+        ComponentField& field = newFields[role.value()];
+        field.key = it.value().toStdString();
+        switch (role.value()) {
+            case RoleAttributes:
+                field.convert = &ResultsModel::attributesValue;
+                break;
+            case RoleBackground:
+                field.convert = &ResultsModel::backgroundValue;
+                break;
+            default:
+                field.convert = &ResultsModel::plainValue;
+                break;
         }
-        newMapping[field] = it.value().toStdString();
     }
 
     if (rowCount() > 0) {
         beginResetModel();
-        m_componentMapping = newMapping;
+        m_componentFields = newFields;
+        m_dataCache.clear();
         endResetModel();
     } else {
-        m_componentMapping = newMapping;
+        m_componentFields = newFields;
+        m_dataCache.clear();
     }
 }
 
 void ResultsModel::setMaxAtrributesCount(int count)
 {
-    m_maxAttributes = count;
+    if (m_maxAttributes != count) {
+        m_maxAttributes = count;
+        m_dataCache.clear();
+    }
 }
 
-void ResultsModel::addUpdateResults(QList<std::shared_ptr<unity::scopes::CategorisedResult>>& results)
+void ResultsModel::addUpdateResults(QVector<std::shared_ptr<unity::scopes::CategorisedResult>>& results)
 {
     if (results.count() == 0) {
         return;
@@ -123,62 +136,28 @@ void ResultsModel::addUpdateResults(QList<std::shared_ptr<unity::scopes::Categor
     }
 
     const int oldCount = m_results.count();
+    const int lastResultIndex = m_search_ctx.lastResultIndex;
 
-    // update result -> index mappings with a subset of current result set, starting from lastResultIndex.
-    m_search_ctx.newResultsMap.update(results, m_search_ctx.lastResultIndex);
+    // update result -> index mappings with a subset of current result set, starting from lastResultIndex;
+    // this de-duplicates the new results.
+    m_search_ctx.newResultsMap.update(results, lastResultIndex);
   
 #ifdef VERBOSE_MODEL_UPDATES
-    qDebug() << "Last result index=" << m_search_ctx.lastResultIndex << "category" << m_categoryId;
+    qDebug() << "Last result index=" << lastResultIndex << "category" << m_categoryId;
 #endif  
-    
-    int row = 0;
-    // iterate over currently visible results, remove results which are no longer present in new set.
-    // this needs to be done only once on first run of the new search, since in consecutive runs there
-    // we will only by appending or moving.
-    if (m_search_ctx.lastResultIndex == 0) {
-        for (auto it = m_results.begin(); it != m_results.end(); ) {
-            int newPos = m_search_ctx.newResultsMap.find(*it);
-            bool haveNow = (newPos >= 0);
-            if (!haveNow) {
-                // delete row
-                beginRemoveRows(QModelIndex(), row, row);
-                it = m_results.erase(it);
-                endRemoveRows();
-            } else {
-                ++it;
-                ++row;
-            }
-        }
-        // called only once on new search - it's cheaper to rebuild than to update
-        // indices of all rows below removed row.
-        m_search_ctx.oldResultsMap.rebuild(m_results);
-    }
-    
-    // iterate over new results
-    for (row = m_search_ctx.lastResultIndex; row<results.count(); ++row) {
-        const int oldPos = m_search_ctx.oldResultsMap.find(results[row]);
-        const bool hadBefore = (oldPos >= 0);
-        if (hadBefore) {
-            if (row != oldPos) {
-                // move row
-                beginMoveRows(QModelIndex(), oldPos, oldPos, QModelIndex(), row + (row > oldPos ? 1 : 0));
-                m_results.move(oldPos, row);
-                if (row < oldPos) {
-                    m_search_ctx.oldResultsMap.updateIndices(m_results, row, oldPos);                    
-                } else {
-                    // This should never actually happen - as incoming results are iterated
-                    // we should only be facing results which had greater position previously.
-                    m_search_ctx.oldResultsMap.updateIndices(m_results, oldPos, row);
-                }
-                endMoveRows();
+
+    if (lastResultIndex > 0 && oldCount == lastResultIndex) {
+        // consecutive run of the same search; current rows match results[0, lastResultIndex)
+        // already, so the rest is just appended.
+        if (results.count() > oldCount) {
+            beginInsertRows(QModelIndex(), oldCount, results.count() - 1);
+            for (int row = oldCount; row < results.count(); ++row) {
+                m_results.append(results[row]);
             }
-        } else {
-            // insert row
-            beginInsertRows(QModelIndex(), row, row);
-            m_results.insert(row, results[row]);
-            m_search_ctx.oldResultsMap.updateIndices(m_results, row + 1, m_results.size());
             endInsertRows();
         }
+    } else {
+        applyResultsDiff(results);
     }
 
     m_search_ctx.lastResultIndex = results.count();
@@ -192,7 +171,85 @@ void ResultsModel::addUpdateResults(QList<std::shared_ptr<unity::scopes::Categor
     }
 }
 
-void ResultsModel::addResults(QList<std::shared_ptr<unity::scopes::CategorisedResult>>& results)
+/*
+ * Turns current rows into the results list with a minimal number of model operations:
+ * rows which are not present anymore are removed, rows on the longest increasing
+ * subsequence of their new positions stay where they are and every other row is
+ * moved exactly once. Contiguous runs are removed, inserted or moved as one range;
+ * see placeRows() for how rows are tracked while they move.
+ */
+void ResultsModel::applyResultsDiff(QVector<std::shared_ptr<unity::scopes::CategorisedResult>> const& results)
+{
+    const int newCount = results.count();
+
+    // new position of every current row, -1 if the row is going away
+    QVector<int> targets(m_results.count());
+    QVector<bool> matched(newCount, false);
+    QVector<int> adopted;
+    for (int i = 0; i < m_results.count(); ++i) {
+        const int pos = m_search_ctx.newResultsMap.find(m_results[i]);
+        if (pos >= 0 && pos < newCount && !matched[pos]) {
+            matched[pos] = true;
+            targets[i] = pos;
+            // equal, but the new one carries the live proxy (rows may come from a cache or snapshot)
+            if (m_results[i] != results[pos]) {
+                auto cached = m_dataCache.find(m_results[i].get());
+                if (cached != m_dataCache.end()) {
+                    const RowCache row = cached.value();
+                    m_dataCache.erase(cached);
+                    m_dataCache.insert(results[pos].get(), row);
+                }
+                m_results[i] = results[pos];
+                adopted.append(i);
+            }
+        } else {
+            targets[i] = -1;
+        }
+    }
+
+    // the result object of adopted rows changed, everything else about them is the same
+    const QVector<int> resultRole {RoleResult};
+    for (int i = 0; i < adopted.count(); ) {
+        int count = 1;
+        while (i + count < adopted.count() && adopted[i + count] == adopted[i] + count) {
+            ++count;
+        }
+        Q_EMIT dataChanged(index(adopted[i], 0), index(adopted[i] + count - 1, 0), resultRole);
+        i += count;
+    }
+
+    for (int last = m_results.count() - 1; last >= 0; ) {
+        if (targets[last] >= 0) {
+            --last;
+            continue;
+        }
+        int first = last;
+        while (first > 0 && targets[first - 1] < 0) {
+            --first;
+        }
+        beginRemoveRows(QModelIndex(), first, last);
+        for (int row = first; row <= last; ++row) {
+            m_dataCache.remove(m_results[row].get());
+        }
+        m_results.erase(m_results.begin() + first, m_results.begin() + last + 1);
+        endRemoveRows();
+        last = first - 1;
+    }
+    targets.erase(std::remove(targets.begin(), targets.end(), -1), targets.end());
+
+    placeRows(targets, matched, [this, &results](int at, int pos, int count) {
+        beginInsertRows(QModelIndex(), at, at + count - 1);
+        insertRange(m_results, at, results.begin() + pos, results.begin() + pos + count);
+        endInsertRows();
+        return count;
+    }, [this](int from, int count, int destination) {
+        beginMoveRows(QModelIndex(), from, from + count - 1, QModelIndex(), destination);
+        moveRange(m_results, from, count, destination);
+        endMoveRows();
+    });
+}
+
+void ResultsModel::addResults(QVector<std::shared_ptr<unity::scopes::CategorisedResult>>& results)
 {
 #ifdef VERBOSE_MODEL_UPDATES
     qDebug() << "Adding #" << results.count() << "results to category" << m_categoryId;
@@ -211,7 +268,6 @@ void ResultsModel::addResults(QList<std::shared_ptr<unity::scopes::CategorisedRe
     }
     endInsertRows();
 
-    m_search_ctx.oldResultsMap = m_search_ctx.newResultsMap;
     m_search_ctx.lastResultIndex = m_results.count();
 
     Q_EMIT countChanged();
@@ -227,6 +283,7 @@ void ResultsModel::clearResults()
 
     beginRemoveRows(QModelIndex(), 0, m_results.count() - 1);
     m_results.clear();
+    m_dataCache.clear();
     endRemoveRows();
 
     m_search_ctx.reset();
@@ -246,52 +303,58 @@ int ResultsModel::count() const
     return m_results.count();
 }
 
+std::shared_ptr<unity::scopes::Result> ResultsModel::resultAt(int row) const
+{
+    return m_results.at(row);
+}
+
 QVariant
 ResultsModel::componentValue(scopes::Result const* result, Roles field) const
 {
-    std::string const& realFieldName = m_componentMapping[field];
-    if (realFieldName.empty())
-        return QVariant();
-    try {
-        scopes::Variant const& v = result->value(realFieldName);
-        return scopeVariantToQVariant(v);
-    } catch (...) {
-        // value() throws if realFieldName is empty or the result
-        // doesn't have a value for it
+    ComponentField const& component = m_componentFields[field];
+    if (!component.convert || !result->contains(component.key)) {
         return QVariant();
     }
+    return (this->*component.convert)(result->value(component.key));
 }
 
 QVariant
-ResultsModel::attributesValue(scopes::Result const* result) const
+ResultsModel::plainValue(scopes::Variant const& v) const
 {
-    try {
-        std::string const& realFieldName = m_componentMapping[RoleAttributes];
-        scopes::Variant const& v = result->value(realFieldName);
-        if (v.which() != scopes::Variant::Type::Array) {
-            return QVariant();
-        }
+    return scopeVariantToQVariant(v);
+}
 
-        QVariantList attributes;
-        scopes::VariantArray arr(v.get_array());
-        for (size_t i = 0; i < arr.size(); i++) {
-            if (arr[i].which() != scopes::Variant::Type::Dict) {
-                continue;
-            }
-            QVariantMap attribute(scopeVariantToQVariant(arr[i]).toMap());
-            attributes << QVariant(attribute);
-            // we'll limit the number of attributes
-            if (attributes.size() >= m_maxAttributes) {
-                break;
-            }
+QVariant
+ResultsModel::attributesValue(scopes::Variant const& v) const
+{
+    if (v.which() != scopes::Variant::Type::Array) {
+        return QVariant();
+    }
+
+    QVariantList attributes;
+    attributes.reserve(m_maxAttributes);
+    for (auto const& attribute: v.get_array()) {
+        if (attribute.which() != scopes::Variant::Type::Dict) {
+            continue;
+        }
+        attributes << scopeVariantToQVariant(attribute);
+        // we'll limit the number of attributes
+        if (attributes.size() >= m_maxAttributes) {
+            break;
         }
+    }
 
-        return attributes;
-    } catch (...) {
-        // value() throws if realFieldName is empty or the result
-        // doesn't have a value for it
-        return QVariant();
+    return attributes;
+}
+
+QVariant
+ResultsModel::backgroundValue(scopes::Variant const& v) const
+{
+    QVariant backgroundVariant(scopeVariantToQVariant(v));
+    if (backgroundVariant.isNull()) {
+        return backgroundVariant;
     }
+    return backgroundUriToVariant(backgroundVariant.toString());
 }
 
 QHash<int, QByteArray> ResultsModel::roleNames() const
@@ -310,6 +373,7 @@ void ResultsModel::updateResult(scopes::Result const& result, scopes::Result con
         if (result.uri() == res->uri() && result.serialize() == res->serialize())
         {
             qDebug() << "Updated result with uri '" << QString::fromStdString(res->uri()) << "'";
+            m_dataCache.remove(res.get());
             m_results[i] = std::make_shared<scopes::Result>(updatedResult);
             auto const idx = index(i, 0);
             Q_EMIT dataChanged(idx, idx);
@@ -321,6 +385,17 @@ void ResultsModel::updateResult(scopes::Result const& result, scopes::Result con
         << "', category '" << categoryId() << "'";
 }
 
+int ResultsModel::cacheSlot(int role)
+{
+    if (role == RoleScopeId) {
+        return CachedRoleCount - 1;
+    }
+    if (role < 0 || role > RoleSocialActions || role == RoleCategoryId || role == RoleResult) {
+        return -1;
+    }
+    return role;
+}
+
 QVariant
 ResultsModel::data(const QModelIndex& index, int role) const
 {
@@ -332,17 +407,41 @@ ResultsModel::data(const QModelIndex& index, int role) const
         return QVariant();
     }
 
-    scopes::Result* result = m_results.at(row).get();
+    switch (role) {
+        case RoleCategoryId:
+            return categoryId();
+        case RoleResult:
+            return QVariant::fromValue(std::static_pointer_cast<unity::scopes::Result>(m_results.at(row)));
+        default:
+            break;
+    }
+
+    const int slot = cacheSlot(role);
+    if (slot < 0) {
+        return QVariant();
+    }
+
+    scopes::Result const* result = m_results.at(row).get();
+    RowCache& cache = m_dataCache[result];
+    const quint32 bit = 1u << slot;
+    if (cache.filled & bit) {
+        m_dataCacheHits++;
+        return cache.values[slot];
+    }
+
+    cache.values[slot] = roleValue(result, role);
+    cache.filled |= bit;
+    return cache.values[slot];
+}
 
+QVariant
+ResultsModel::roleValue(scopes::Result const* result, int role) const
+{
     switch (role) {
         case RoleUri:
             return QString::fromStdString(result->uri());
-        case RoleCategoryId:
-            return categoryId();
         case RoleDndUri:
             return QString::fromStdString(result->dnd_uri());
-        case RoleResult:
-            return QVariant::fromValue(std::static_pointer_cast<unity::scopes::Result>(m_results.at(row)));
         case RoleArt: {
             QString image(componentValue(result, RoleArt).toString());
             if (image.isEmpty()) {
@@ -368,16 +467,9 @@ ResultsModel::data(const QModelIndex& index, int role) const
         case RoleOverlayColor:
         case RoleQuickPreviewData:
         case RoleSocialActions:
-            return componentValue(result, Roles(role));
         case RoleAttributes:
-            return attributesValue(result);
-        case RoleBackground: {
-            QVariant backgroundVariant(componentValue(result, RoleBackground));
-            if (backgroundVariant.isNull()) {
-                return backgroundVariant;
-            }
-            return backgroundUriToVariant(backgroundVariant.toString());
-        }
+        case RoleBackground:
+            return componentValue(result, Roles(role));
         case RoleScopeId:
             if (result->uri().compare(0, 8, "scope://") == 0) {
                 try {
@@ -405,4 +497,9 @@ bool ResultsModel::needsPurging() const
     return m_purge;
 }
 
+quint64 ResultsModel::dataCacheHits() const
+{
+    return m_dataCacheHits;
+}
+
 } // namespace scopes_ng
@@ -34,7 +34,6 @@ namespace scopes_ng {
 struct SearchContext
 {
     ResultsMap newResultsMap;
-    ResultsMap oldResultsMap;
     int lastResultIndex;
 
     void reset();
@@ -54,13 +53,14 @@ public:
     int rowCount(const QModelIndex& parent = QModelIndex()) const override;
     QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
 
-    void addResults(QList<std::shared_ptr<unity::scopes::CategorisedResult>>&);
-    void addUpdateResults(QList<std::shared_ptr<unity::scopes::CategorisedResult>>&);
+    void addResults(QVector<std::shared_ptr<unity::scopes::CategorisedResult>>&);
+    void addUpdateResults(QVector<std::shared_ptr<unity::scopes::CategorisedResult>>&);
     void clearResults();
 
     /* getters */
     QString categoryId() const override;
     int count() const override;
+    std::shared_ptr<unity::scopes::Result> resultAt(int row) const;
 
     /* setters */
     void setCategoryId(QString const& id) override;
@@ -72,11 +72,44 @@ public:
     void markNewSearch();
     bool needsPurging() const;
 
+    quint64 dataCacheHits() const;
+
 private:
+    enum {
+        CachedRoleCount = RoleSocialActions + 2 // all the interface roles + RoleScopeId
+    };
+
+    // converted values of a single result, filled lazily by data()
+    struct RowCache
+    {
+        RowCache(): filled(0) {}
+
+        quint32 filled;
+        QVariant values[CachedRoleCount];
+    };
+
+    // result field a component role is mapped to and the conversion of its value, compiled by setComponentsMapping()
+    struct ComponentField
+    {
+        typedef QVariant (ResultsModel::*Converter)(unity::scopes::Variant const&) const;
+
+        ComponentField(): convert(nullptr) {}
+
+        std::string key;
+        Converter convert; // null if the role is not mapped
+    };
+
+    static int cacheSlot(int role);
+    void applyResultsDiff(QVector<std::shared_ptr<unity::scopes::CategorisedResult>> const& results);
+    QVariant roleValue(unity::scopes::Result const* result, int role) const;
     QVariant componentValue(unity::scopes::Result const* result, Roles field) const;
-    QVariant attributesValue(unity::scopes::Result const* result) const;
+    QVariant plainValue(unity::scopes::Variant const& v) const;
+    QVariant attributesValue(unity::scopes::Variant const& v) const;
+    QVariant backgroundValue(unity::scopes::Variant const& v) const;
 
-    QVector<std::string> m_componentMapping;
+    QVector<ComponentField> m_componentFields; // indexed by role
+    mutable QHash<unity::scopes::Result const*, RowCache> m_dataCache;
+    mutable quint64 m_dataCacheHits;
     QList<std::shared_ptr<unity::scopes::Result>> m_results;
     QString m_categoryId;
     int m_maxAttributes;
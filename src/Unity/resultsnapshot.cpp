@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// self
+#include "resultsnapshot.h"
+
+// local
+#include "resultsmap.h"
+#include "utils.h"
+
+// Qt
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QVariantMap>
+
+#include <unity/scopes/Category.h>
+#include <unity/scopes/Variant.h>
+
+namespace scopes_ng
+{
+
+using namespace unity;
+
+namespace
+{
+
+const QDataStream::Version STREAM_VERSION = QDataStream::Qt_5_0;
+
+// Category can only be created from its serialized form by subclasses
+class SnapshotCategory : public scopes::Category
+{
+public:
+    explicit SnapshotCategory(scopes::VariantMap const& data)
+        : scopes::Category(data)
+    {
+    }
+};
+
+}
+
+bool ResultSnapshot::isEnabled()
+{
+    return !qEnvironmentVariableIsSet("UNITY_SCOPES_NO_RESULT_SNAPSHOT");
+}
+
+QString ResultSnapshot::path(QString const& scopeId)
+{
+    return QDir(configDir()).filePath(QStringLiteral("snapshots/%1.snapshot").arg(scopeId));
+}
+
+QByteArray ResultSnapshot::serialize(QString const& scopeId, QString const& locale,
+        QVector<std::shared_ptr<scopes::CategorisedResult>> const& results)
+{
+    QList<QVariantMap> categories;
+    QHash<QString, quint32> categoryIndex;
+
+    struct SerializedResult
+    {
+        quint32 category;
+        bool interceptActivation;
+        QVariantMap result; // attrs and internal (origin, flags, stored result)
+    };
+    QVector<SerializedResult> serializedResults;
+    serializedResults.reserve(results.size());
+
+    for (auto const& result: results) {
+        try {
+            auto const category = result->category();
+            const QString categoryId = QString::fromStdString(category->id());
+            auto it = categoryIndex.constFind(categoryId);
+            if (it == categoryIndex.constEnd()) {
+                it = categoryIndex.insert(categoryId, categories.size());
+                categories.append(scopeVariantToQVariant(scopes::Variant(category->serialize())).toMap());
+            }
+
+            auto const serialized = result->serialize();
+            if (serialized.find("attrs") == serialized.end()) {
+                continue;
+            }
+            serializedResults.append({it.value(), !result->direct_activation(), scopeVariantToQVariant(scopes::Variant(serialized)).toMap()});
+        } catch (std::exception const& e) {
+            qWarning() << "ResultSnapshot: skipping result:" << e.what();
+        }
+    }
+
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(STREAM_VERSION);
+    stream << MAGIC << VERSION << scopeId << locale << QDateTime::currentMSecsSinceEpoch();
+    stream << static_cast<quint32>(categories.size());
+    for (auto const& category: categories) {
+        stream << category;
+    }
+    stream << static_cast<quint32>(serializedResults.size());
+    for (auto const& result: serializedResults) {
+        stream << result.category << result.interceptActivation << result.result;
+    }
+    return data;
+}
+
+QSharedPointer<CachedResultSet> ResultSnapshot::deserialize(QByteArray const& data, QString const& scopeId, QString const& locale)
+{
+    QDataStream stream(data);
+    stream.setVersion(STREAM_VERSION);
+
+    quint32 magic, version;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != MAGIC || version != VERSION) {
+        return QSharedPointer<CachedResultSet>();
+    }
+
+    QString snapshotScopeId, snapshotLocale;
+    qint64 savedAt;
+    stream >> snapshotScopeId >> snapshotLocale >> savedAt;
+    if (snapshotScopeId != scopeId || snapshotLocale != locale) {
+        return QSharedPointer<CachedResultSet>();
+    }
+
+    QSharedPointer<CachedResultSet> resultSet(new CachedResultSet);
+    try {
+        quint32 count;
+        stream >> count;
+        QVector<scopes::Category::SCPtr> categories;
+        for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+            QVariantMap category;
+            stream >> category;
+            categories.append(std::make_shared<SnapshotCategory>(qVariantToScopeVariant(category).get_dict()));
+        }
+
+        stream >> count;
+        for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+            quint32 category;
+            bool interceptActivation;
+            QVariantMap serialized;
+            stream >> category >> interceptActivation >> serialized;
+            if (category >= static_cast<quint32>(categories.size())) {
+                return QSharedPointer<CachedResultSet>();
+            }
+
+            // CategorisedResult can't be created from its serialized form, so the internal part is only
+            // kept on disk; the row adopts the live result (and its origin) once the search replaces it
+            const QVariantMap attrs = serialized.value(QStringLiteral("attrs")).toMap();
+            scopes::CategorisedResult result(categories[category]);
+            for (auto it = attrs.constBegin(); it != attrs.constEnd(); ++it) {
+                result[it.key().toStdString()] = qVariantToScopeVariant(it.value());
+            }
+            if (interceptActivation) {
+                result.set_intercept_activation();
+            }
+            resultSet->results.append(std::make_shared<FingerprintedResult>(std::move(result)));
+        }
+    } catch (std::exception const& e) {
+        qWarning() << "ResultSnapshot: invalid snapshot of" << scopeId << ":" << e.what();
+        return QSharedPointer<CachedResultSet>();
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        return QSharedPointer<CachedResultSet>();
+    }
+    return resultSet;
+}
+
+bool ResultSnapshot::save(QString const& path, QString const& scopeId, QString const& locale,
+        QVector<std::shared_ptr<scopes::CategorisedResult>> const& results)
+{
+    const QByteArray data = serialize(scopeId, locale, results);
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    // written to a temporary file and renamed, so that a crash can't leave a truncated snapshot behind
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        qWarning() << "ResultSnapshot: failed to write" << path << ":" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+QSharedPointer<CachedResultSet> ResultSnapshot::load(QString const& path, QString const& scopeId, QString const& locale)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+        return QSharedPointer<CachedResultSet>();
+    }
+
+    uchar* mapped = file.map(0, file.size());
+    if (!mapped) {
+        return QSharedPointer<CachedResultSet>();
+    }
+
+    // results copy everything they need out of the mapping, which goes away with the file
+    auto resultSet = deserialize(QByteArray::fromRawData(reinterpret_cast<char const*>(mapped), static_cast<int>(file.size())),
+            scopeId, locale);
+    file.unmap(mapped);
+
+    if (!resultSet) {
+        qWarning() << "ResultSnapshot: ignoring stale or damaged snapshot" << path;
+    }
+    return resultSet;
+}
+
+} // namespace scopes_ng
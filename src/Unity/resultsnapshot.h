@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NG_RESULT_SNAPSHOT_H
+#define NG_RESULT_SNAPSHOT_H
+
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+#include <memory>
+
+#include <unity/scopes/CategorisedResult.h>
+
+#include "resultsetcache.h"
+
+namespace scopes_ng
+{
+
+/*
+ * On-disk copy of the surfacing results of a favorite scope, used to render
+ * the first scope on cold start before the registry has been listed and the
+ * first query has finished. Only the results and their categories are kept;
+ * departments and filters arrive with the live search that replaces the snapshot.
+ *
+ * The file is written atomically and read through a memory mapping.
+ */
+class Q_DECL_EXPORT ResultSnapshot
+{
+public:
+    static const quint32 MAGIC = 0x55535253; // "USRS"
+    static const quint32 VERSION = 2;
+
+    // disabled with UNITY_SCOPES_NO_RESULT_SNAPSHOT
+    static bool isEnabled();
+    static QString path(QString const& scopeId);
+
+    static QByteArray serialize(QString const& scopeId, QString const& locale,
+            QVector<std::shared_ptr<unity::scopes::CategorisedResult>> const& results);
+    // returns null if the data is damaged or doesn't match scope id and locale
+    static QSharedPointer<CachedResultSet> deserialize(QByteArray const& data, QString const& scopeId, QString const& locale);
+
+    // thread-safe, so that snapshots can be written off the UI thread
+    static bool save(QString const& path, QString const& scopeId, QString const& locale,
+            QVector<std::shared_ptr<unity::scopes::CategorisedResult>> const& results);
+    static QSharedPointer<CachedResultSet> load(QString const& path, QString const& scopeId, QString const& locale);
+};
+
+} // namespace scopes_ng
+
+#endif // NG_RESULT_SNAPSHOT_H
@@ -26,6 +26,12 @@
 #include "collectors.h"
 #include "locationaccesshelper.h"
 #include "previewmodel.h"
+#include "previewprefetcher.h"
+#include "querydispatcher.h"
+#include "latencyhistogram.h"
+#include "resultsetcache.h"
+#include "resultsnapshot.h"
+#include "tracing.h"
 #include "utils.h"
 #include "scopes.h"
 #include "settingsmodel.h"
@@ -69,11 +75,11 @@ namespace scopes_ng
 using namespace unity;
 
 const int TYPING_TIMEOUT = 700;
-const int SEARCH_PROCESSING_DELAY = 1000;
 const int RESULTS_TTL_SMALL = 30000; // 30 seconds
 const int RESULTS_TTL_MEDIUM = 300000; // 5 minutes
 const int RESULTS_TTL_LARGE = 3600000; // 1 hour
 const int SEARCH_CARDINALITY = 300; // maximum number of results accepted from a single scope
+const int PREFETCH_CATEGORIES = 2; // number of top categories whose results get their previews prefetched
 
 Scope::Ptr Scope::newInstance(scopes_ng::Scopes* parent, bool favorite)
 {
@@ -83,6 +89,7 @@ Scope::Ptr Scope::newInstance(scopes_ng::Scopes* parent, bool favorite)
 
 Scope::Scope(scopes_ng::Scopes* parent, bool favorite) :
       m_query_id(0)
+    , m_searchGeneration(0)
     , m_formFactor(QStringLiteral("phone"))
     , m_activeFiltersCount(0)
     , m_isActive(false)
@@ -93,10 +100,12 @@ Scope::Scope(scopes_ng::Scopes* parent, bool favorite) :
     , m_hasNavigation(false)
     , m_favorite(favorite)
     , m_initialQueryDone(false)
+    , m_awaitingFirstPushEvent(false)
     , m_childScopesDirty(true)
     , m_searchController(new CollectionController)
     , m_activationController(new CollectionController)
     , m_status(Status::Okay)
+    , m_snapshotFingerprint(0)
 {
     QQmlEngine::setObjectOwnership(this, QQmlEngine::CppOwnership);
     m_categories.reset(new Categories(this));
@@ -129,6 +138,14 @@ Scope::Scope(scopes_ng::Scopes* parent, bool favorite) :
     m_invalidateTimer.setSingleShot(true);
     m_invalidateTimer.setTimerType(Qt::CoarseTimer);
     QObject::connect(&m_invalidateTimer, &QTimer::timeout, [this]() { invalidateResults(); });
+
+    if (PreviewPrefetcher::configuredDepth() > 0) {
+        m_previewPrefetcher.reset(new PreviewPrefetcher(this));
+    }
+    const qint64 resultSetCacheSize = ResultSetCache::configuredMaxBytes();
+    if (resultSetCacheSize > 0) {
+        m_resultSetCache.reset(new ResultSetCache(resultSetCacheSize));
+    }
 }
 
 Scope::~Scope()
@@ -138,7 +155,7 @@ Scope::~Scope()
 void Scope::processSearchChunk(PushEvent* pushEvent)
 {
     CollectorBase::Status status;
-    QList<std::shared_ptr<scopes::CategorisedResult>> results;
+    QVector<std::shared_ptr<scopes::CategorisedResult>> results;
     scopes::Department::SCPtr rootDepartment;
     QList<scopes::FilterBase::SCPtr> filters;
 
@@ -147,21 +164,35 @@ void Scope::processSearchChunk(PushEvent* pushEvent)
         return;
     }
 
+    if (Tracer::isEnabled()) {
+        const qint64 duration = pushEvent->msecsSinceStart() * 1000;
+        if (m_awaitingFirstPushEvent) {
+            Tracer::complete("search", "firstPushEvent", Tracer::nowUsecs() - duration, duration, id());
+        }
+        if (status != CollectorBase::Status::INCOMPLETE) {
+            Tracer::complete("search", "search", Tracer::nowUsecs() - duration, duration, id());
+        }
+    }
+    m_awaitingFirstPushEvent = false;
+
     m_rootDepartment = rootDepartment;
     m_receivedFilters = filters;
 
+    const int received = results.size();
     if (m_cachedResults.empty()) {
         m_cachedResults.swap(results);
     } else {
-        m_cachedResults.append(results);
+        m_cachedResults += results;
     }
 
     if (status == CollectorBase::Status::INCOMPLETE) {
-        if (!m_searchProcessingDelayTimer.isActive()) {
-            // the longer we've been waiting for the results, the shorter the timeout
-            qint64 inProgressMs = pushEvent->msecsSinceStart();
-            double mult = 1.0 / std::max(1, static_cast<int>((inProgressMs / 150) + 1));
-            m_searchProcessingDelayTimer.start(SEARCH_PROCESSING_DELAY * mult);
+        const int remaining = m_searchProcessingDelayTimer.isActive() ? m_searchProcessingDelayTimer.remainingTime() : -1;
+        const int delay = flushScheduler().resultsReceived(received, m_cachedResults.size(), pushEvent->msecsSinceStart(), remaining);
+        if (delay == 0) {
+            m_searchProcessingDelayTimer.stop();
+            flushUpdates();
+        } else if (delay > 0) {
+            m_searchProcessingDelayTimer.start(delay);
         }
     } else { // status in [FINISHED, ERROR]
         m_searchProcessingDelayTimer.stop();
@@ -170,6 +201,12 @@ void Scope::processSearchChunk(PushEvent* pushEvent)
 
         setSearchInProgress(false);
 
+        if (status == CollectorBase::Status::FINISHED) {
+            cacheResultSet();
+            saveSnapshot();
+            prefetchPreviews();
+        }
+
         switch (status) {
             case CollectorBase::Status::FINISHED:
             case CollectorBase::Status::CANCELLED:
@@ -358,6 +395,7 @@ void Scope::typingFinished()
 
 void Scope::flushUpdates(bool finalize)
 {
+    TraceSpan trace("search", "flushUpdates", Tracer::isEnabled() ? id() : QString());
     if (m_delayedSearchProcessing) {
         m_delayedSearchProcessing = false;
     }
@@ -377,6 +415,7 @@ void Scope::flushUpdates(bool finalize)
 #endif
 
     processResultSet(m_cachedResults); // clears the result list
+    flushScheduler().flushed();
 
     if (finalize) {
         m_category_results.clear();
@@ -562,7 +601,7 @@ scopes::Department::SCPtr Scope::findDepartmentById(scopes::Department::SCPtr co
     return nullptr;
 }
 
-void Scope::processResultSet(QList<std::shared_ptr<scopes::CategorisedResult>>& result_set)
+void Scope::processResultSet(QVector<std::shared_ptr<scopes::CategorisedResult>>& result_set)
 {
     if (result_set.count() == 0) return;
 
@@ -572,13 +611,13 @@ void Scope::processResultSet(QList<std::shared_ptr<scopes::CategorisedResult>>&
     // split the result_set by category_id; note that processResultSet may get called more than once
     // for single search request, all the contents of m_category_results accumulate until new search
     // is requested, so that addUpdateResults() can properly update affected models.
-    while (!result_set.empty()) {
-        auto result = result_set.takeFirst();
+    for (auto& result: result_set) {
         if (!categories.contains(result->category())) {
             categories.append(result->category());
         }
         m_category_results[result->category()->id()].append(std::move(result));
     }
+    result_set.clear();
 
     Q_FOREACH(scopes::Category::SCPtr const& category, categories) {
         QSharedPointer<ResultsModel> category_model = m_categories->lookupCategory(category->id());
@@ -613,12 +652,55 @@ void Scope::invalidateLastSearch()
     }
     m_cachedResults.clear();
     m_category_results.clear();
+    if (m_previewPrefetcher) {
+        m_previewPrefetcher->cancel();
+    }
 }
 
-void Scope::startTtlTimer()
+void Scope::prefetchPreviews()
+{
+    if (!m_previewPrefetcher || !m_isActive) {
+        return;
+    }
+
+    const int depth = PreviewPrefetcher::configuredDepth();
+    QList<scopes::Result::SPtr> results;
+    int categories = 0;
+    for (int i = 0; i < m_categories->rowCount() && categories < PREFETCH_CATEGORIES; i++) {
+        auto model = m_categories->resultsModelAt(i);
+        if (!model || model->count() == 0) {
+            continue;
+        }
+        categories++;
+        for (int j = 0; j < std::min(depth, model->count()); j++) {
+            auto result = model->resultAt(j);
+            // scope:// results don't have a preview
+            if (result->uri().find("scope://") != 0) {
+                results.append(result);
+            }
+        }
+    }
+
+    m_previewPrefetcher->prefetch(results, m_session_id, m_scopesInstance ? m_scopesInstance->userAgentString() : QString());
+}
+
+PreviewPrefetcher* Scope::previewPrefetcher() const
+{
+    return m_previewPrefetcher.data();
+}
+
+FlushScheduler& Scope::flushScheduler()
+{
+    if (!m_flushScheduler) {
+        m_flushScheduler = FlushScheduler::create(FlushScheduler::policyForScope(id()));
+    }
+    return *m_flushScheduler;
+}
+
+int Scope::resultsTtl() const
 {
+    int ttl = 0;
     if (m_scopeMetadata) {
-        int ttl = 0;
         switch (m_scopeMetadata->results_ttl_type()) {
         case (scopes::ScopeMetadata::ResultsTtlType::None):
             break;
@@ -637,9 +719,135 @@ void Scope::startTtlTimer()
                 ttl = QString::fromUtf8(
                         qgetenv("UNITY_SCOPES_RESULTS_TTL_OVERRIDE")).toInt();
             }
-            m_invalidateTimer.start(ttl);
         }
     }
+    return ttl;
+}
+
+void Scope::startTtlTimer()
+{
+    const int ttl = resultsTtl();
+    if (ttl > 0) {
+        m_invalidateTimer.start(ttl);
+    }
+}
+
+bool Scope::showCachedResults()
+{
+    auto resultSet = m_resultSetCache->lookup(m_resultSetKey);
+    if (!resultSet) {
+        return false;
+    }
+
+#ifdef VERBOSE_MODEL_UPDATES
+    qDebug() << id() << ": showing" << resultSet->results.size() << "cached results";
+#endif
+
+    showResultSet(*resultSet);
+    return true;
+}
+
+bool Scope::showSnapshot(QSharedPointer<const CachedResultSet> const& snapshot)
+{
+    // never replace results of a real search
+    if (m_initialQueryDone || !snapshot) {
+        return false;
+    }
+
+    qDebug() << id() << ": showing" << snapshot->results.size() << "results from snapshot";
+    showResultSet(*snapshot);
+    m_snapshotFingerprint = snapshotFingerprint(QLocale::system().name(), snapshot->results);
+    return true;
+}
+
+void Scope::showResultSet(CachedResultSet const& resultSet)
+{
+    m_cachedResults = resultSet.results;
+    m_rootDepartment = resultSet.rootDepartment;
+    m_receivedFilters = resultSet.filters;
+    flushUpdates(true);
+
+    // live results get diffed against the shown ones as they arrive
+    m_category_results.clear();
+    m_categories->markNewSearch();
+}
+
+QVector<std::shared_ptr<scopes::CategorisedResult>> Scope::shownResults() const
+{
+    QVector<std::shared_ptr<scopes::CategorisedResult>> results;
+    for (int i = 0; i < m_categories->rowCount(); i++) {
+        auto model = m_categories->resultsModelAt(i);
+        if (!model) {
+            continue;
+        }
+        for (int j = 0; j < model->count(); j++) {
+            // results updated by activation aren't categorised anymore
+            auto result = std::dynamic_pointer_cast<scopes::CategorisedResult>(model->resultAt(j));
+            if (result) {
+                results.append(result);
+            }
+        }
+    }
+    return results;
+}
+
+void Scope::cacheResultSet()
+{
+    if (!m_resultSetCache || m_resultSetKey.isEmpty()) {
+        return;
+    }
+
+    QSharedPointer<CachedResultSet> resultSet(new CachedResultSet);
+    resultSet->results = shownResults();
+    resultSet->rootDepartment = m_rootDepartment;
+    resultSet->filters = m_receivedFilters;
+
+    m_resultSetCache->insert(m_resultSetKey, resultSet, resultsTtl());
+}
+
+void Scope::saveSnapshot()
+{
+    // only the surfacing results of the first favorite are shown on startup
+    if (!m_favorite || !ResultSnapshot::isEnabled() || !m_searchQuery.isEmpty() || !m_currentNavigationId.isEmpty() ||
+            m_activeFiltersCount > 0 || m_queryUserData) {
+        return;
+    }
+    if (!m_scopesInstance || m_scopesInstance->getFavoriteIds().value(0) != id()) {
+        return;
+    }
+
+    auto const results = shownResults();
+    if (results.isEmpty()) {
+        return;
+    }
+
+    // refreshes mostly get the same results again
+    const QString locale = QLocale::system().name();
+    const quint64 fingerprint = snapshotFingerprint(locale, results);
+    if (fingerprint == m_snapshotFingerprint) {
+        return;
+    }
+    m_snapshotFingerprint = fingerprint;
+
+    const QString scopeId = id();
+    QtConcurrent::run([scopeId, locale, results]() {
+        ResultSnapshot::save(ResultSnapshot::path(scopeId), scopeId, locale, results);
+    });
+}
+
+quint64 Scope::snapshotFingerprint(QString const& locale, QVector<std::shared_ptr<scopes::CategorisedResult>> const& results)
+{
+    quint64 hash = qHash(locale);
+    for (auto const& result: results) {
+        hash = hash * 31 + ResultsMap::fingerprint(*result);
+        hash = hash * 31 + std::hash<std::string>()(result->category()->id());
+    }
+    return hash;
+}
+
+ResultSetCache* Scope::resultSetCache() const
+{
+    return m_resultSetCache.data();
 }
 
 void Scope::setScopesInstance(Scopes* scopes)
@@ -696,16 +904,35 @@ void Scope::setFilterState(scopes::FilterState const& filterState)
     m_filterState = filterState;
 }
 
+LatencyHistogram& Scope::searchDispatchLatency()
+{
+    static LatencyHistogram histogram;
+    return histogram;
+}
+
 void Scope::dispatchSearch(bool programmaticSearch)
 {
+    QElapsedTimer dispatchTimer;
+    dispatchTimer.start();
+    TraceSpan trace("search", "dispatchSearch", Tracer::isEnabled() ? id() : QString());
+
     m_initialQueryDone = true;
+    m_awaitingFirstPushEvent = true;
 
     invalidateLastSearch();
-    m_delayedSearchProcessing = true;
     m_category_results.clear();
     m_categories->markNewSearch();
 
-    m_searchProcessingDelayTimer.start(SEARCH_PROCESSING_DELAY);
+    m_resultSetKey.clear();
+    if (m_resultSetCache) {
+        m_resultSetKey = ResultSetCache::key(m_searchQuery.toStdString(), m_currentNavigationId.toStdString(), m_filterState,
+                m_formFactor, QLocale::system().name(), m_queryUserData.get());
+        // show the results we got for the same query last time right away
+        showCachedResults();
+    }
+    m_delayedSearchProcessing = true;
+
+    m_searchProcessingDelayTimer.start(flushScheduler().searchStarted());
     /* There are a few objects associated with searches:
      * 1) SearchResultReceiver    2) ResultCollector    3) PushEvent
      *
@@ -732,8 +959,7 @@ void Scope::dispatchSearch(bool programmaticSearch)
 
     setSearchInProgress(true);
 
-    // If applicable, update this scope's child scopes now, as part of the search process
-    // (i.e. while the loading bar is visible).
+    // If applicable, update this scope's child scopes now; the listing runs in parallel with the search.
     update_child_scopes();
 
     // handle the case where single scope is refreshed multiple times without switching
@@ -779,29 +1005,36 @@ void Scope::dispatchSearch(bool programmaticSearch)
         scopes::SearchListenerBase::SPtr listener(new SearchResultReceiver(this));
         m_searchController->setListener(listener);
 
-        try {
-            qDebug() << id() << ": Dispatching search:" << m_searchQuery << m_currentNavigationId << "(programmatic:" << programmaticSearch << ")";
-            scopes::QueryCtrlProxy controller = m_queryUserData ?
-                m_proxy->search(m_searchQuery.toStdString(), m_currentNavigationId.toStdString(), m_filterState, *m_queryUserData, meta, listener) :
-                m_proxy->search(m_searchQuery.toStdString(), m_currentNavigationId.toStdString(), m_filterState, meta, listener);
-            m_searchController->setController(controller);
-        } catch (std::exception& e) {
-            qWarning("Caught an error from create_query(): %s", e.what());
-        } catch (...) {
-            qWarning("Caught an error from create_query()");
-        }
-    }
-
-    if (!m_searchController->isValid()) {
-        // something went wrong, reset search state
+        qDebug() << id() << ": Dispatching search:" << m_searchQuery << m_currentNavigationId << "(programmatic:" << programmaticSearch << ")";
+        const quint64 generation = ++m_searchGeneration;
+        SearchRequest request(m_proxy, m_searchQuery.toStdString(), m_currentNavigationId.toStdString(), m_filterState,
+                m_queryUserData.get(), meta, listener);
+        QueryDispatcher::instance()->dispatch(this, "create_query", [request]() {
+            return request.run();
+        }, [this, generation, listener](scopes::QueryCtrlProxy const& controller) {
+            if (!controller) {
+                // something went wrong, reset search state
+                if (generation == m_searchGeneration) {
+                    setSearchInProgress(false);
+                }
+                return;
+            }
+            // cancels the query if another search was dispatched in the meantime
+            m_searchController->setController(listener, controller);
+        });
+    } else {
         setSearchInProgress(false);
     }
+
+    searchDispatchLatency().add(dispatchTimer.nsecsElapsed());
 }
 
 void Scope::setScopeData(scopes::ScopeMetadata const& data)
 {
     m_scopeMetadata = std::make_shared<scopes::ScopeMetadata>(data);
     m_proxy = data.proxy();
+    // the policy may be different for the new id
+    m_flushScheduler.reset();
 
     QVariant converted(scopeVariantToQVariant(scopes::Variant(m_scopeMetadata->appearance_attributes())));
     m_customizations = converted.toMap();
@@ -816,15 +1049,7 @@ void Scope::createSettingsModel()
     {
         scopes::Variant settings_definitions;
         settings_definitions = m_scopeMetadata->settings_definitions();
-        QDir shareDir;
-        if(qEnvironmentVariableIsSet("UNITY_SCOPES_CONFIG_DIR"))
-        {
-            shareDir = qgetenv("UNITY_SCOPES_CONFIG_DIR");
-        }
-        else
-        {
-            shareDir = QDir::home().filePath(QStringLiteral(".config/unity-scopes"));
-        }
+        QDir shareDir(configDir());
 
         Q_ASSERT(m_scopesInstance);
 
@@ -834,7 +1059,12 @@ void Scope::createSettingsModel()
                         !m_scopesInstance->locationAccessHelper()->isLocationAccessDenied(),
                         this));
 
-        QObject::connect(m_settingsModel.data(), &SettingsModel::settingsChanged, [this]() { invalidateResults(); });
+        QObject::connect(m_settingsModel.data(), &SettingsModel::settingsChanged, [this]() {
+            if (m_resultSetCache) {
+                m_resultSetCache->clear();
+            }
+            invalidateResults();
+        });
 
         // If the scope needs location, then changes to global location access need to be monitored.
         if (m_scopeMetadata->location_data_needed()) {
@@ -1203,8 +1433,15 @@ void Scope::activate(QVariant const& result_var, QString const& categoryId)
 
                 auto proxy = proxy_for_result(result);
                 unity::scopes::ActionMetadata metadata(QLocale::system().name().toStdString(), m_formFactor.toStdString());
-                scopes::QueryCtrlProxy controller = proxy->activate(*(result.get()), metadata, listener);
-                m_activationController->setController(controller);
+                scopes::Result res(*result);
+                QueryDispatcher::instance()->dispatch(this, "activate", [proxy, res, metadata, listener]() {
+                    return proxy->activate(res, metadata, listener);
+                }, [this, listener](scopes::QueryCtrlProxy const& controller) {
+                    if (!controller && m_activationController->isCurrent(listener)) {
+                        setActivationInProgress(false);
+                    }
+                    m_activationController->setController(listener, controller);
+                });
             } catch (std::exception& e) {
                 setActivationInProgress(false);
                 qWarning("Caught an error from activate(): %s", e.what());
@@ -1272,8 +1509,13 @@ void Scope::activateAction(QVariant const& result_var, QString const& categoryId
 
         auto proxy = proxy_for_result(result);
         unity::scopes::ActionMetadata metadata(QLocale::system().name().toStdString(), m_formFactor.toStdString());
-        scopes::QueryCtrlProxy controller = proxy->activate_result_action(*(result.get()), metadata, actionId.toStdString(), listener);
-        m_activationController->setController(controller);
+        scopes::Result res(*result);
+        std::string action(actionId.toStdString());
+        QueryDispatcher::instance()->dispatch(this, "activate_result_action", [proxy, res, metadata, action, listener]() {
+            return proxy->activate_result_action(res, metadata, action, listener);
+        }, [this, listener](scopes::QueryCtrlProxy const& controller) {
+            m_activationController->setController(listener, controller);
+        });
     } catch (std::exception& e) {
         qWarning("Caught an error from activate_result_action(): %s", e.what());
     } catch (...) {
@@ -1303,7 +1545,7 @@ unity::shell::scopes::PreviewModelInterface* Scope::preview(QVariant const& resu
     QObject::connect(previewModel, &QObject::destroyed, this, &Scope::previewModelDestroyed);
     m_previewModels.append(previewModel);
     previewModel->setAssociatedScope(this, m_session_id, m_scopesInstance->userAgentString());
-    previewModel->loadForResult(result);
+    previewModel->loadForResult(result, m_previewPrefetcher ? m_previewPrefetcher->take(*result) : QSharedPointer<PrefetchedPreview>());
     return previewModel;
 }
 
@@ -40,6 +40,7 @@
 
 #include "filters.h"
 #include "collectors.h"
+#include "flushscheduler.h"
 #include "departmentnode.h"
 #include "department.h"
 #include "ubuntulocationservice.h"
@@ -51,6 +52,10 @@ namespace scopes_ng
 class Categories;
 class PushEvent;
 class PreviewModel;
+class PreviewPrefetcher;
+class LatencyHistogram;
+class ResultSetCache;
+struct CachedResultSet;
 class SettingsModel;
 class Scopes;
 
@@ -96,6 +101,22 @@ public:
         m_controller = controller;
     }
 
+    bool isCurrent(unity::scopes::ListenerBase::SPtr const& listener) const
+    {
+        return m_listener && m_listener == listener;
+    }
+
+    // for controllers which arrive after the query was dispatched asynchronously;
+    // if the collection was invalidated in the meantime, the query gets cancelled
+    void setController(unity::scopes::ListenerBase::SPtr const& listener, unity::scopes::QueryCtrlProxy const& controller)
+    {
+        if (isCurrent(listener)) {
+            m_controller = controller;
+        } else if (controller) {
+            controller->cancel();
+        }
+    }
+
 private:
     unity::scopes::ListenerBase::SPtr m_listener;
     std::shared_ptr<ScopeDataReceiverBase> m_receiver;
@@ -180,6 +201,13 @@ public:
     void setSearchQueryString(const QString& search_query);
 
     const QNetworkConfigurationManager& networkManager() const;
+    PreviewPrefetcher* previewPrefetcher() const;
+    ResultSetCache* resultSetCache() const;
+    // shows results of the last session until the first search finishes
+    bool showSnapshot(QSharedPointer<const CachedResultSet> const& snapshot);
+
+    // UI thread time spent in dispatchSearch(), for all scopes
+    static LatencyHistogram& searchDispatchLatency();
 
 public Q_SLOTS:
     void invalidateChildScopes();
@@ -228,14 +256,24 @@ private:
     void setCannedQuery(unity::scopes::CannedQuery const& query);
     void executeCannedQuery(unity::scopes::CannedQuery const& query, bool allowDelayedActivation);
     void handlePreviewUpdate(unity::scopes::Result::SPtr const& result, unity::scopes::PreviewWidgetList const& widgets);
-
-    void processResultSet(QList<std::shared_ptr<unity::scopes::CategorisedResult>>& result_set);
+    void prefetchPreviews();
+    FlushScheduler& flushScheduler();
+    int resultsTtl() const;
+    bool showCachedResults();
+    void showResultSet(CachedResultSet const& resultSet);
+    QVector<std::shared_ptr<unity::scopes::CategorisedResult>> shownResults() const;
+    void cacheResultSet();
+    void saveSnapshot();
+    static quint64 snapshotFingerprint(QString const& locale, QVector<std::shared_ptr<unity::scopes::CategorisedResult>> const& results);
+
+    void processResultSet(QVector<std::shared_ptr<unity::scopes::CategorisedResult>>& result_set);
 
     static unity::scopes::Department::SCPtr findDepartmentById(unity::scopes::Department::SCPtr const& root, std::string const& id);
     unity::scopes::Department::SCPtr findUpdateNode(DepartmentNode* node, unity::scopes::Department::SCPtr const& scopeNode);
 
     QUuid m_session_id;
     int m_query_id;
+    quint64 m_searchGeneration; // id of the last dispatched search
     QString m_searchQuery;
     QString m_noResultsHint;
     QString m_formFactor;
@@ -252,11 +290,12 @@ private:
     bool m_hasNavigation;
     bool m_favorite;
     bool m_initialQueryDone;
+    bool m_awaitingFirstPushEvent; // since the last dispatchSearch(), for tracing
     int m_cardinality;
 
     bool m_childScopesDirty;
 
-    QMap<std::string, QList<std::shared_ptr<unity::scopes::CategorisedResult>>> m_category_results;
+    QMap<std::string, QVector<std::shared_ptr<unity::scopes::CategorisedResult>>> m_category_results;
     std::unique_ptr<CollectionController> m_searchController;
     std::unique_ptr<CollectionController> m_activationController;
     unity::scopes::ScopeProxy m_proxy;
@@ -270,11 +309,16 @@ private:
     QScopedPointer<Filters> m_filters;
 
     QScopedPointer<SettingsModel> m_settingsModel;
+    QScopedPointer<PreviewPrefetcher> m_previewPrefetcher; // only created if UNITY_SCOPES_PREVIEW_PREFETCH is set
+    QScopedPointer<ResultSetCache> m_resultSetCache; // null if disabled with UNITY_SCOPES_RESULT_CACHE_SIZE=0
+    QByteArray m_resultSetKey; // cache key of the current search
+    quint64 m_snapshotFingerprint; // of the results last written to or shown from the snapshot
     QSharedPointer<DepartmentNode> m_departmentTree;
     QTimer m_typingTimer;
     QTimer m_searchProcessingDelayTimer;
+    FlushScheduler::Ptr m_flushScheduler; // created on first use, for the policy of the scope id
     QTimer m_invalidateTimer;
-    QList<std::shared_ptr<unity::scopes::CategorisedResult>> m_cachedResults;
+    QVector<std::shared_ptr<unity::scopes::CategorisedResult>> m_cachedResults;
     QMultiMap<QString, Department*> m_departmentModels;
     QMap<Department*, QString> m_inverseDepartments;
     QMetaObject::Connection m_metadataConnection;
@@ -25,13 +25,16 @@
 #include "overviewscope.h"
 #include "ubuntulocationservice.h"
 #include "favorites.h"
+#include "resultsnapshot.h"
+#include "tracing.h"
 
 // Qt
 #include <QDebug>
 #include <QGSettings>
 #include <QTimer>
 #include <QDBusConnection>
-#include <QProcess>
+#include <QElapsedTimer>
+#include <QLocale>
 #include <QFile>
 #include <QUrlQuery>
 #include <QTextStream>
@@ -49,9 +52,11 @@ using namespace unity;
 #define SCOPES_SCOPE_ID "scopes"
 #define PARTNER_ID_FILE "/custom/partner-id"
 #define CLICK_SCOPE_ID "clickscope"
+#define LSB_RELEASE_FILE "/etc/lsb-release"
 
 void ScopeListWorker::run()
 {
+    TraceSpan trace("startup", "listRegistry");
     try
     {
         // m_runtimeConfig should be null in most cases, and empty string is for system-wide fallback
@@ -108,9 +113,13 @@ Scopes::Scopes(QObject *parent)
     , m_listThread(nullptr)
     , m_loaded(false)
     , m_prepopulateFirstScope(true)
+    , m_userAgentReady(false)
+    , m_waitingForLocation(false)
     , m_locationAccessHelper(new LocationAccessHelper(nullptr))
     , m_priv(new Priv())
 {
+    m_startupTimer.start();
+
     QByteArray noFav = qgetenv("UNITY_SCOPES_NO_FAVORITES");
     if (!noFav.isNull()) {
         m_noFavorites = true;
@@ -129,6 +138,7 @@ Scopes::Scopes(QObject *parent)
     m_dashSettings = QGSettings::isSchemaInstalled("com.canonical.Unity.Dash") ? new QGSettings("com.canonical.Unity.Dash", QByteArray(), this) : nullptr;
     m_favoriteScopes = new Favorites(this, m_dashSettings);
     QObject::connect(m_favoriteScopes, &Favorites::favoritesChanged, this, &Scopes::favoritesChanged);
+    loadStartupSnapshot();
 
     m_overviewScope = OverviewScope::newInstance(this);
 
@@ -142,7 +152,28 @@ Scopes::Scopes(QObject *parent)
     QObject::connect(m_locationService.data(), &UbuntuLocationService::geoIpLookupFinished, m_locationAccessHelper.data(), &LocationAccessHelper::geoIpLookupFinished);
     m_locationAccessHelper->init();
 
-    createUserAgentString();
+    // startup phases run concurrently: the user agent string is computed from files, the registry is
+    // listed by a worker thread and location is being acquired; only the first search waits for
+    // what it needs (see startFirstSearch())
+    if (!m_locationService->hasLocation() && !qEnvironmentVariableIsSet("UNITY_SCOPES_NO_WAIT_LOCATION"))
+    {
+        m_waitingForLocation = true;
+        connect(m_locationService.data(), &UbuntuLocationService::locationChanged,
+                this, &Scopes::initialLocationWaitFinished);
+        connect(m_locationService.data(), &UbuntuLocationService::accessDenied,
+                this, &Scopes::initialLocationWaitFinished);
+        connect(m_locationService.data(), &UbuntuLocationService::locationTimeout,
+                this, &Scopes::initialLocationWaitFinished);
+        connect(&m_startupQueryTimeout, &QTimer::timeout, this,
+                &Scopes::initialLocationWaitFinished);
+        m_startupQueryTimeout.setSingleShot(true);
+        m_startupQueryTimeout.setInterval(LOCATION_STARTUP_TIMEOUT);
+        m_startupQueryTimeout.start();
+    }
+
+    // queued, so that readPartnerId() overrides are in effect
+    QMetaObject::invokeMethod(this, "createUserAgentString", Qt::QueuedConnection);
+    initPopulateScopes();
 
     m_scopesToDeleteTimer.setSingleShot(true);
     m_scopesToDeleteTimer.setInterval(1000 * SCOPE_DELETE_DELAY);
@@ -184,40 +215,51 @@ int Scopes::count() const
     return m_scopes.count();
 }
 
-void Scopes::createUserAgentString()
+QString Scopes::readReleaseVersion()
 {
-    QProcess *lsb_release = new QProcess(this);
-    connect(lsb_release, SIGNAL(finished(int, QProcess::ExitStatus)), this, SLOT(lsbReleaseFinished()));
-    connect(lsb_release, SIGNAL(error(QProcess::ProcessError)), this, SLOT(initPopulateScopes()));
-    lsb_release->start(QStringLiteral("lsb_release -r"), QIODevice::ReadOnly);
+    // same as 'lsb_release -r', without spawning a process
+    QFile lsbRelease(QStringLiteral(LSB_RELEASE_FILE));
+    if (lsbRelease.open(QIODevice::ReadOnly))
+    {
+        QTextStream str(&lsbRelease);
+        while (!str.atEnd())
+        {
+            const QString line = str.readLine().trimmed();
+            if (line.startsWith(QLatin1String("DISTRIB_RELEASE="))) {
+                QString release = line.mid(line.indexOf(QLatin1Char('=')) + 1);
+                if (release.size() >= 2 && release.startsWith(QLatin1Char('"')) && release.endsWith(QLatin1Char('"'))) {
+                    release = release.mid(1, release.size() - 2);
+                }
+                return release;
+            }
+        }
+    }
+    return QString();
 }
 
-void Scopes::lsbReleaseFinished()
+void Scopes::createUserAgentString()
 {
-    QProcess *lsb_release = qobject_cast<QProcess *>(sender());
-    if (lsb_release) {
-        const QString out = lsb_release->readAllStandardOutput();
-        const QStringList parts = out.split(QRegExp(QStringLiteral("\\s+")), QString::SkipEmptyParts);
-        if (parts.size() == 2) {
-            m_versions.push_back(qMakePair(QStringLiteral("release"), parts.at(1)));
-        }
-        lsb_release->deleteLater();
+    QList<QPair<QString, QString>> versions;
+
+    const QString release = readReleaseVersion();
+    if (!release.isEmpty()) {
+        versions.push_back(qMakePair(QStringLiteral("release"), release));
     }
 
     // map package version to a simple name we send to SSS
-    const QMap<QString, QString> versions({
+    const QMap<QString, QString> packages({
         {QStringLiteral("unity-plugin-scopes"), QStringLiteral("plugin")},
         {QStringLiteral("unity8"), QStringLiteral("unity8")},
         {QStringLiteral("libunity-scopes"), QStringLiteral("scopes-api")}});
 
     // determine versions of unity8, unity-plugin-scopes and libunity-scopes1.0
-    for (QMap<QString, QString>::const_iterator pkg = versions.constBegin(); pkg != versions.constEnd(); pkg++) {
+    for (QMap<QString, QString>::const_iterator pkg = packages.constBegin(); pkg != packages.constEnd(); pkg++) {
         QFile versionFile("/var/lib/" + pkg.key() + "/version");
         if (versionFile.open(QIODevice::ReadOnly)) {
             QTextStream str(&versionFile);
             QString ver;
             str >> ver;
-            m_versions.push_back(qMakePair(pkg.value(), ver));
+            versions.push_back(qMakePair(pkg.value(), ver));
         } else {
             qWarning() << "Couldn't determine the version of" << pkg.key();
         }
@@ -228,21 +270,22 @@ void Scopes::lsbReleaseFinished()
         QTextStream str(&buildFile);
         QString bld;
         str >> bld;
-        m_versions.push_back(qMakePair(QStringLiteral("build"), bld));
+        versions.push_back(qMakePair(QStringLiteral("build"), bld));
     }
 
     const QString partnerId = readPartnerId();
     if (!partnerId.isEmpty()) {
-        m_versions.push_back(qMakePair(QStringLiteral("partner"), partnerId));
+        versions.push_back(qMakePair(QStringLiteral("partner"), partnerId));
     }
 
     QUrlQuery q;
-    q.setQueryItems(m_versions);
-    m_versions.clear();
+    q.setQueryItems(versions);
     m_userAgent = q.toString();
+    m_userAgentReady = true;
 
     qDebug() << "User agent string:" << m_userAgent;
-    initPopulateScopes();
+    traceStartupPhase(QStringLiteral("user-agent"));
+    startFirstSearch();
 }
 
 QString Scopes::readPartnerId()
@@ -265,6 +308,43 @@ QString Scopes::readPartnerId()
     return partnerId;
 }
 
+void Scopes::loadStartupSnapshot()
+{
+    // the first scope is shown with its results from last session until discovery
+    // and the first search finish
+    if (m_noFavorites || !m_prepopulateFirstScope || !ResultSnapshot::isEnabled()) {
+        return;
+    }
+
+    auto const favorites = m_favoriteScopes->getFavorites();
+    if (favorites.isEmpty()) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const QString scopeId = favorites.first();
+    m_startupSnapshot = ResultSnapshot::load(ResultSnapshot::path(scopeId), scopeId, QLocale::system().name());
+    if (m_startupSnapshot) {
+        m_startupSnapshotScopeId = scopeId;
+        qDebug() << "Loaded snapshot of" << scopeId << "with" << m_startupSnapshot->results.size() << "results in" << timer.elapsed() << "ms";
+        traceStartupPhase(QStringLiteral("snapshot"));
+    }
+}
+
+void Scopes::traceStartupPhase(QString const& phase)
+{
+    const qint64 elapsed = m_startupTimer.elapsed();
+    m_startupPhases.append(qMakePair(phase, elapsed));
+    Tracer::instant("startup", "phase", phase);
+    qDebug() << "Startup phase" << phase << "finished after" << elapsed << "ms";
+}
+
+QList<QPair<QString, qint64>> Scopes::startupPhases() const
+{
+    return m_startupPhases;
+}
+
 void Scopes::initPopulateScopes()
 {
     // initiate scopes
@@ -281,6 +361,7 @@ void Scopes::initPopulateScopes()
 // In any other circumstance, use refreshScopeMetadata() to invalidate results.
 void Scopes::populateScopes()
 {
+    TraceSpan trace("startup", "populateScopes");
     auto thread = new ScopeListWorker;
     QByteArray runtimeConfig = qgetenv("UNITY_SCOPES_RUNTIME_PATH");
     thread->setRuntimeConfig(QString::fromLocal8Bit(runtimeConfig));
@@ -293,6 +374,7 @@ void Scopes::populateScopes()
 
 void Scopes::discoveryFinished()
 {
+    TraceSpan trace("startup", "discoveryFinished");
     qDebug() << "Scopes discovery finished";
 
     ScopeListWorker* thread = qobject_cast<ScopeListWorker*>(sender());
@@ -335,47 +417,18 @@ void Scopes::discoveryFinished()
         m_cachedMetadata[QString::fromStdString(it->first)] = std::make_shared<unity::scopes::ScopeMetadata>(it->second);
     }
 
-    if (m_locationService->hasLocation() || qEnvironmentVariableIsSet("UNITY_SCOPES_NO_WAIT_LOCATION"))
-    {
-        // If we already have a location just query the scopes now
-        completeDiscoveryFinished();
-    }
-    else
-    {
-        qDebug() << "Waiting for initial location update";
-
-        // Otherwise we have to wait for location data
-        // Either the the location data needs to change, or the timeout happens
-        connect(m_locationService.data(), &UbuntuLocationService::locationChanged,
-                this, &Scopes::completeDiscoveryFinished);
-        connect(m_locationService.data(), &UbuntuLocationService::accessDenied,
-                this, &Scopes::completeDiscoveryFinished);
-        connect(m_locationService.data(), &UbuntuLocationService::locationTimeout,
-                this, &Scopes::completeDiscoveryFinished);
-        connect(&m_startupQueryTimeout, &QTimer::timeout, this,
-                &Scopes::completeDiscoveryFinished);
-        m_startupQueryTimeout.setSingleShot(true);
-        m_startupQueryTimeout.setInterval(LOCATION_STARTUP_TIMEOUT);
-        m_startupQueryTimeout.start();
-    }
+    traceStartupPhase(QStringLiteral("registry"));
+    completeDiscoveryFinished();
 }
 
 void Scopes::completeDiscoveryFinished()
 {
+    TraceSpan trace("startup", "completeDiscoveryFinished");
     qDebug() << "Scopes discovery completed";
-    // Kill off everything that could potentially trigger the startup queries
-    m_startupQueryTimeout.stop();
-    disconnect(&m_startupQueryTimeout, &QTimer::timeout, this,
-               &Scopes::completeDiscoveryFinished);
-    disconnect(m_locationService.data(), &UbuntuLocationService::locationChanged,
-               this, &Scopes::completeDiscoveryFinished);
-    disconnect(m_locationService.data(), &UbuntuLocationService::accessDenied,
-               this, &Scopes::completeDiscoveryFinished);
-    disconnect(m_locationService.data(), &UbuntuLocationService::locationTimeout,
-               this, &Scopes::completeDiscoveryFinished);
 
     processFavoriteScopes();
     endResetModel();
+    m_startupSnapshot.reset();
 
     m_loaded = true;
     Q_EMIT loadedChanged();
@@ -385,10 +438,46 @@ void Scopes::completeDiscoveryFinished()
 
     m_listThread = nullptr;
 
-    if (m_prepopulateFirstScope) {
-        m_prepopulateFirstScope = false;
-        prepopulateFirstScope();
+    traceStartupPhase(QStringLiteral("model"));
+    startFirstSearch();
+}
+
+void Scopes::initialLocationWaitFinished()
+{
+    // Kill off everything that could potentially end the wait again
+    m_startupQueryTimeout.stop();
+    disconnect(&m_startupQueryTimeout, &QTimer::timeout, this,
+               &Scopes::initialLocationWaitFinished);
+    disconnect(m_locationService.data(), &UbuntuLocationService::locationChanged,
+               this, &Scopes::initialLocationWaitFinished);
+    disconnect(m_locationService.data(), &UbuntuLocationService::accessDenied,
+               this, &Scopes::initialLocationWaitFinished);
+    disconnect(m_locationService.data(), &UbuntuLocationService::locationTimeout,
+               this, &Scopes::initialLocationWaitFinished);
+
+    m_waitingForLocation = false;
+    traceStartupPhase(QStringLiteral("location"));
+    startFirstSearch();
+}
+
+void Scopes::startFirstSearch()
+{
+    if (!m_prepopulateFirstScope || !m_loaded || !m_userAgentReady) {
+        return;
     }
+
+    // only scopes which use location wait for the initial location update
+    if (m_waitingForLocation && !m_scopes.isEmpty()) {
+        auto const metadata = m_cachedMetadata.value(m_scopes.front()->id());
+        if (metadata && metadata->location_data_needed()) {
+            qDebug() << "Waiting for initial location update";
+            return;
+        }
+    }
+
+    m_prepopulateFirstScope = false;
+    prepopulateFirstScope();
+    traceStartupPhase(QStringLiteral("first-search"));
 }
 
 void Scopes::prepopulateFirstScope()
@@ -493,6 +582,10 @@ void Scopes::processFavoriteScopes()
                     Scope::Ptr scope = Scope::newInstance(this, true);
                     connect(scope.data(), SIGNAL(isActiveChanged()), this, SLOT(prepopulateNextScopes()));
                     scope->setScopeData(*(it.value()));
+                    if (m_startupSnapshot && fv == m_startupSnapshotScopeId) {
+                        scope->showSnapshot(m_startupSnapshot);
+                        m_startupSnapshot.reset();
+                    }
                     beginInsertRows(QModelIndex(), row, row);
                     m_scopes.insert(row, scope);
                     endInsertRows();
@@ -23,9 +23,12 @@
 #include <unity/shell/scopes/ScopesInterface.h>
 #include "scope.h"
 #include "locationaccesshelper.h"
+#include "resultsetcache.h"
 
 // Qt
+#include <QElapsedTimer>
 #include <QList>
+#include <QPair>
 #include <QThread>
 #include <QTimer>
 #include <QStringList>
@@ -85,12 +88,15 @@ public:
     void addTempScope(Scope::Ptr const& scope);
     Q_INVOKABLE void closeScope(unity::shell::scopes::ScopeInterface* scope) override;
     QSharedPointer<LocationAccessHelper> locationAccessHelper() const;
+    // startup phases in the order they finished, with milliseconds since construction
+    QList<QPair<QString, qint64>> startupPhases() const;
 
 Q_SIGNALS:
     void metadataRefreshed();
 
 protected:
     virtual QString readPartnerId();
+    virtual QString readReleaseVersion();
 
 private Q_SLOTS:
     void favoritesChanged();
@@ -103,13 +109,16 @@ private Q_SLOTS:
     void prepopulateNextScopes();
 
     void initPopulateScopes();
-    void lsbReleaseFinished();
+    void createUserAgentString();
     void completeDiscoveryFinished();
+    void initialLocationWaitFinished();
     void purgeScopesToDelete();
     void scopeRegistryChanged();
 
 private:
-    void createUserAgentString();
+    void loadStartupSnapshot();
+    void startFirstSearch();
+    void traceStartupPhase(QString const& phase);
 
     static int LIST_DELAY;
     static const int SCOPE_DELETE_DELAY;
@@ -123,10 +132,15 @@ private:
     QMap<QString, unity::scopes::ScopeMetadata::SPtr> m_cachedMetadata;
     QSharedPointer<OverviewScope> m_overviewScope;
     QThread* m_listThread;
-    QList<QPair<QString, QString>> m_versions;
     QString m_userAgent;
     bool m_loaded;
     bool m_prepopulateFirstScope;
+    bool m_userAgentReady;
+    bool m_waitingForLocation; // for the initial location update, or LOCATION_STARTUP_TIMEOUT
+    QElapsedTimer m_startupTimer;
+    QList<QPair<QString, qint64>> m_startupPhases;
+    QString m_startupSnapshotScopeId;
+    QSharedPointer<const CachedResultSet> m_startupSnapshot; // results of the first favorite from last session
 
     QSharedPointer<UbuntuLocationService> m_locationService;
     QTimer m_startupQueryTimeout;
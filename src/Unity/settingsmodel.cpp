@@ -19,6 +19,7 @@
 
 #include "settingsmodel.h"
 #include "localization.h"
+#include "querydispatcher.h"
 #include "utils.h"
 
 #include <unity/util/ResourcePtr.h>
@@ -26,10 +27,15 @@
 
 #include <QDebug>
 #include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
 #include <QTextCodec>
 #include <QTimer>
+#include <QtConcurrent>
 
 #include <fcntl.h>
+#include <stdio.h>
 #include <unistd.h>
 
 using namespace scopes_ng;
@@ -78,22 +84,14 @@ SettingsModel::SettingsModel(const QDir& configDir, const QString& scopeId,
         QObject* parent,
         int settingsTimeout)
         : SettingsModelInterface(parent), m_scopeId(scopeId), m_settingsTimeout(settingsTimeout),
-          m_requireChildScopesRefresh(false)
+          m_loaded(false), m_fileSize(-1), m_fileReads(0), m_fileWrites(0),
+          m_childScopesGeneration(0), m_requireChildScopesRefresh(false)
 {
     configDir.mkpath(scopeId);
     QDir databaseDir = configDir.filePath(scopeId);
 
     m_settings_path = databaseDir.filePath(QStringLiteral("settings.ini"));
 
-    try
-    {
-        tryLoadSettings(true);
-    }
-    catch(const unity::FileException&)
-    {
-        // No settings file found, at this point we'll just have to continue with a null m_settings.
-    }
-
     for (const auto &it : settingsDefinitions.toList())
     {
         QVariantMap data = it.toMap();
@@ -138,15 +136,6 @@ SettingsModel::SettingsModel(const QDir& configDir, const QString& scopeId,
             properties[QStringLiteral("defaultValue")] = defaultValue;
         }
 
-        QSharedPointer<QTimer> timer(new QTimer());
-        timer->setProperty("setting_id", id);
-        timer->setSingleShot(true);
-        timer->setInterval(m_settingsTimeout);
-        timer->setTimerType(Qt::VeryCoarseTimer);
-        connect(timer.data(), SIGNAL(timeout()), this,
-                SLOT(settings_timeout()));
-        m_timers[id] = timer;
-
         QSharedPointer<Data> setting(
                 new Data(id, displayName, type, properties, defaultValue,
                         variantType));
@@ -154,10 +143,31 @@ SettingsModel::SettingsModel(const QDir& configDir, const QString& scopeId,
         m_data << setting;
         m_data_by_id[id] = setting;
     }
+
+    // all changes made within the timeout are committed together
+    m_commitTimer.setSingleShot(true);
+    m_commitTimer.setInterval(m_settingsTimeout);
+    m_commitTimer.setTimerType(Qt::VeryCoarseTimer);
+    connect(&m_commitTimer, SIGNAL(timeout()), this, SLOT(settings_timeout()));
+
+}
+
+SettingsModel::~SettingsModel()
+{
+    if (!m_dirty.isEmpty())
+    {
+        writeSettings();
+    }
+    if (!m_dirty_child_scopes.isEmpty() && m_scopeProxy)
+    {
+        sendChildScopes();
+    }
 }
 
 QVariant SettingsModel::data(const QModelIndex& index, int role) const
 {
+    ensureLoaded();
+
     int row = index.row();
     QVariant result;
 
@@ -180,41 +190,8 @@ QVariant SettingsModel::data(const QModelIndex& index, int role) const
                 result = data->properties;
                 break;
             case Roles::RoleValue:
-            {
-                try
-                {
-                    tryLoadSettings(true);
-                    switch (data->variantType)
-                    {
-                        case QVariant::Bool:
-                            result = m_settings->get_boolean(GROUP_NAME, data->id.toStdString());
-                            break;
-                        case QVariant::UInt:
-                            result = m_settings->get_int(GROUP_NAME, data->id.toStdString());
-                            break;
-                        case QVariant::Double:
-                            result = m_settings->get_double(GROUP_NAME, data->id.toStdString());
-                            break;
-                        case QVariant::String:
-                            result = m_settings->get_string(GROUP_NAME, data->id.toStdString()).c_str();
-                            break;
-                        default:
-                            result = data->defaultValue;
-                    }
-                }
-                catch(const unity::FileException& e)
-                {
-                    qWarning() << "SettingsModel::data: Failed to read settings file:" << e.what();
-                    result = data->defaultValue;
-                }
-                catch(const unity::LogicException&)
-                {
-                    qWarning() << "SettingsModel::data: Failed to get a value for setting:" << data->id;
-                    result = data->defaultValue;
-                }
-                result.convert(data->variantType);
+                result = cachedValue(*data);
                 break;
-            }
             default:
                 break;
         }
@@ -253,6 +230,8 @@ QVariant SettingsModel::data(const QModelIndex& index, int role) const
 
 QVariant SettingsModel::value(const QString& id) const
 {
+    ensureLoaded();
+
     // Check for the setting id in the child scopes list first, in case the
     // aggregator is incorrectly using a scope id as a settings as well.
     if (m_child_scopes_data_by_id.contains(id))
@@ -267,41 +246,7 @@ QVariant SettingsModel::value(const QString& id) const
     }
     else if (m_data_by_id.contains(id))
     {
-        QSharedPointer<Data> data = m_data_by_id[id];
-        QVariant result;
-        try
-        {
-            tryLoadSettings(true);
-            switch (data->variantType)
-            {
-                case QVariant::Bool:
-                    result = m_settings->get_boolean(GROUP_NAME, data->id.toStdString());
-                    break;
-                case QVariant::UInt:
-                    result = m_settings->get_int(GROUP_NAME, data->id.toStdString());
-                    break;
-                case QVariant::Double:
-                    result = m_settings->get_double(GROUP_NAME, data->id.toStdString());
-                    break;
-                case QVariant::String:
-                    result = m_settings->get_string(GROUP_NAME, data->id.toStdString()).c_str();
-                    break;
-                default:
-                    result = data->defaultValue;
-            }
-        }
-        catch(const unity::FileException& e)
-        {
-            qWarning() << "SettingsModel::value: Failed to read settings file:" << e.what();
-            result = data->defaultValue;
-        }
-        catch(const unity::LogicException&)
-        {
-            qWarning() << "SettingsModel::value: Failed to get a value for setting:" << data->id;
-            result = data->defaultValue;
-        }
-        result.convert(data->variantType);
-        return result;
+        return cachedValue(*m_data_by_id[id]);
     }
 
     return QVariant();
@@ -316,29 +261,69 @@ void SettingsModel::update_child_scopes(QMap<QString, sc::ScopeMetadata::SPtr> c
     }
 
     m_scopeProxy = scopes_metadata[m_scopeId]->proxy();
-    try
+
+    // listing the child scopes is a twoway call into the aggregator, so it's done off the UI thread
+    // and doesn't hold up the search that's dispatched alongside it
+    const quint64 generation = ++m_childScopesGeneration;
+    sc::ScopeProxy proxy = m_scopeProxy;
+    auto listChildScopes = [proxy]() -> QSharedPointer<sc::ChildScopeList>
     {
-        m_child_scopes = m_scopeProxy->child_scopes();
-    }
-    catch (std::exception const& e)
+        try
+        {
+            return QSharedPointer<sc::ChildScopeList>(new sc::ChildScopeList(proxy->child_scopes()));
+        }
+        catch (std::exception const& e)
+        {
+            qWarning("SettingsModel::update_child_scopes: Exception caught from child_scopes(): %s", e.what());
+        }
+        return QSharedPointer<sc::ChildScopeList>();
+    };
+
+    if (QueryDispatcher::isSynchronous())
     {
-        qWarning("SettingsModel::update_child_scopes: Exception caught from m_scopeProxy->child_scopes_ordered(): %s", e.what());
+        auto child_scopes = listChildScopes();
+        if (child_scopes)
+        {
+            applyChildScopes(*child_scopes, scopes_metadata);
+        }
         return;
     }
 
-    const bool reset = m_requireChildScopesRefresh;
-    if (reset) {
-        // Reset the settings model to fix LP: #1484299, where a new child scope just finished installing
-        // while settings view is created (and we crash); since this is really a corner case, just
-        // resetting the model is fine.
-        beginResetModel();
-    }
+    auto watcher = new QFutureWatcher<QSharedPointer<sc::ChildScopeList>>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation, scopes_metadata]()
+    {
+        watcher->deleteLater();
+        auto child_scopes = watcher->result();
+        // a later update supersedes this one
+        if (child_scopes && generation == m_childScopesGeneration)
+        {
+            applyChildScopes(*child_scopes, scopes_metadata);
+        }
+    });
+    watcher->setFuture(QtConcurrent::run(listChildScopes));
+}
+
+void SettingsModel::applyChildScopes(sc::ChildScopeList const& child_scopes, QMap<QString, sc::ScopeMetadata::SPtr> const& scopes_metadata)
+{
+    // the child scope rows are replaced as a whole; this also covers LP: #1484299, where a new child
+    // scope just finished installing while settings view is created (and we crash)
+    beginResetModel();
 
+    m_child_scopes = child_scopes;
     m_requireChildScopesRefresh = false;
 
+    // toggles the aggregator hasn't been told about yet still apply
+    for (sc::ChildScope& child_scope : m_child_scopes)
+    {
+        auto it = m_dirty_child_scopes.constFind(QString::fromStdString(child_scope.id));
+        if (it != m_dirty_child_scopes.constEnd())
+        {
+            child_scope.enabled = it.value();
+        }
+    }
+
     m_child_scopes_data.clear();
     m_child_scopes_data_by_id.clear();
-    m_child_scopes_timers.clear();
 
     for (sc::ChildScope const& child_scope : m_child_scopes)
     {
@@ -359,9 +344,7 @@ void SettingsModel::update_child_scopes(QMap<QString, sc::ScopeMetadata::SPtr> c
         m_child_scopes_data_by_id[id] = setting;
     }
 
-    if (reset) {
-        endResetModel();
-    }
+    endResetModel();
 
     Q_EMIT countChanged();
 }
@@ -369,6 +352,8 @@ void SettingsModel::update_child_scopes(QMap<QString, sc::ScopeMetadata::SPtr> c
 bool SettingsModel::setData(const QModelIndex &index, const QVariant &value,
         int role)
 {
+    ensureLoaded();
+
     int row = index.row();
     QVariant result;
 
@@ -380,10 +365,14 @@ bool SettingsModel::setData(const QModelIndex &index, const QVariant &value,
         {
             case Roles::RoleValue:
             {
-                QSharedPointer<QTimer> timer = m_timers[data->id];
-                timer->setProperty("value", value);
-                timer->start();
-
+                // shown right away, written to disk when the timer fires
+                m_values[data->id] = value;
+                m_dirty.insert(data->id);
+                m_commitTimer.start();
+
+                QVector<int> roles;
+                roles.append(Roles::RoleValue);
+                Q_EMIT dataChanged(index, index, roles);
                 return true;
             }
             default:
@@ -398,23 +387,14 @@ bool SettingsModel::setData(const QModelIndex &index, const QVariant &value,
         {
             case Roles::RoleValue:
             {
-                if (!m_child_scopes_timers.contains(data->id))
-                {
-                    QSharedPointer<QTimer> timer(new QTimer());
-                    timer->setProperty("setting_id", data->id);
-                    timer->setSingleShot(true);
-                    timer->setInterval(m_settingsTimeout);
-                    timer->setTimerType(Qt::VeryCoarseTimer);
-                    connect(timer.data(), SIGNAL(timeout()), this,
-                            SLOT(settings_timeout()));
-                    m_child_scopes_timers[data->id] = timer;
-                }
-
-                QSharedPointer<QTimer> timer = m_child_scopes_timers[data->id];
-                timer->setProperty("index", row - m_data.size());
-                timer->setProperty("value", value);
-                timer->start();
+                auto it = std::next(m_child_scopes.begin(), row - m_data.size());
+                it->enabled = value.toBool();
+                m_dirty_child_scopes[data->id] = it->enabled;
+                m_commitTimer.start();
 
+                QVector<int> roles;
+                roles.append(Roles::RoleValue);
+                Q_EMIT dataChanged(index, index, roles);
                 return true;
             }
             default:
@@ -442,100 +422,271 @@ bool SettingsModel::require_child_scopes_refresh() const
 
 void SettingsModel::settings_timeout()
 {
-    QObject *timer = sender();
-    if (!timer)
+    const bool written = !m_dirty.isEmpty() && writeSettings();
+
+    if (m_dirty_child_scopes.isEmpty() || !m_scopeProxy)
     {
+        m_dirty_child_scopes.clear();
+        if (written)
+        {
+            Q_EMIT settingsChanged();
+        }
         return;
     }
 
-    QString setting_id = timer->property("setting_id").toString();
-    QVariant value = timer->property("value");
+    // one invalidation of the scope's results for the whole batch, once the aggregator
+    // knows about the new child scopes
+    auto watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, written]()
+    {
+        watcher->deleteLater();
+        if (watcher->result() || written)
+        {
+            Q_EMIT settingsChanged();
+        }
+    });
+    watcher->setFuture(sendChildScopes());
+}
+
+QFuture<bool> SettingsModel::sendChildScopes()
+{
+    m_dirty_child_scopes.clear();
+    // a listing that's still running predates the change and would bring back the old state
+    ++m_childScopesGeneration;
 
-    // Check for the setting id in the child scopes list first, in case the
-    // aggregator is incorrectly using a scope id as a settings as well.
-    if (m_child_scopes_data_by_id.contains(setting_id))
+    sc::ScopeProxy proxy = m_scopeProxy;
+    sc::ChildScopeList child_scopes = m_child_scopes;
+    return QtConcurrent::run([proxy, child_scopes]()
+    {
+        try
+        {
+            proxy->set_child_scopes(child_scopes);
+            return true;
+        }
+        catch (std::exception const& e)
+        {
+            qWarning("SettingsModel::sendChildScopes: Exception caught from set_child_scopes(): %s", e.what());
+        }
+        return false;
+    });
+}
+
+QVariant SettingsModel::cachedValue(Data const& data) const
+{
+    auto it = m_values.constFind(data.id);
+    QVariant result = (it != m_values.constEnd()) ? it.value() : data.defaultValue;
+    result.convert(data.variantType);
+    return result;
+}
+
+quint64 SettingsModel::fileReads() const
+{
+    return m_fileReads;
+}
+
+quint64 SettingsModel::fileWrites() const
+{
+    return m_fileWrites;
+}
+
+void SettingsModel::ensureLoaded() const
+{
+    if (!m_loaded)
     {
-        int setting_index = timer->property("index").toInt();
-        auto it = std::next(m_child_scopes.begin(), setting_index);
-        it->enabled = value.toBool();
+        // most settings pages are never opened, so the file is only parsed and watched once
+        // the values are needed; loading doesn't change anything visible from outside
+        const_cast<SettingsModel*>(this)->startWatching();
+    }
+}
+
+void SettingsModel::startWatching()
+{
+    m_loaded = true;
+
+    // values are served from memory; the scope may change the file too, so it's watched
+    loadSettings();
+    m_watcher.reset(new QFileSystemWatcher);
+    m_watcher->addPath(QFileInfo(m_settings_path).absolutePath());
+    watchSettingsFile();
+    connect(m_watcher.data(), &QFileSystemWatcher::fileChanged, this, &SettingsModel::settingsFileChanged);
+    connect(m_watcher.data(), &QFileSystemWatcher::directoryChanged, this, &SettingsModel::settingsFileChanged);
+}
+
+void SettingsModel::rememberFileState()
+{
+    QFileInfo info(m_settings_path);
+    m_fileModified = info.exists() ? info.lastModified() : QDateTime();
+    m_fileSize = info.exists() ? info.size() : -1;
+}
 
-        if (m_scopeProxy)
+void SettingsModel::watchSettingsFile()
+{
+    // replacing the file drops it from the watcher
+    if (m_watcher && !m_watcher->files().contains(m_settings_path) && QFileInfo(m_settings_path).isFile())
+    {
+        m_watcher->addPath(m_settings_path);
+    }
+}
+
+void SettingsModel::loadSettings()
+{
+    // settings not written yet win over the file
+    QHash<QString, QVariant> values;
+    for (auto const& id : m_dirty)
+    {
+        values[id] = m_values[id];
+    }
+
+    QFileInfo checkFile(m_settings_path);
+    if (checkFile.exists() && checkFile.isFile())
+    {
+        try
         {
-            try
-            {
-                m_scopeProxy->set_child_scopes(m_child_scopes);
+            FileLock lock = unixLock(m_settings_path, false);
+            unity::util::IniParser parser(m_settings_path.toUtf8());
+            m_fileReads++;
 
-                Q_EMIT settingsChanged();
-            }
-            catch (std::exception const& e)
+            for (auto const& data : m_data)
             {
-                qWarning("SettingsModel::settings_timeout: Exception caught from m_scopeProxy->set_child_scopes(): %s", e.what());
-                return;
+                if (m_dirty.contains(data->id))
+                {
+                    continue;
+                }
+                try
+                {
+                    switch (data->variantType)
+                    {
+                        case QVariant::Bool:
+                            values[data->id] = parser.get_boolean(GROUP_NAME, data->id.toStdString());
+                            break;
+                        case QVariant::UInt:
+                            values[data->id] = parser.get_int(GROUP_NAME, data->id.toStdString());
+                            break;
+                        case QVariant::Double:
+                            values[data->id] = parser.get_double(GROUP_NAME, data->id.toStdString());
+                            break;
+                        case QVariant::String:
+                            values[data->id] = QString::fromStdString(parser.get_string(GROUP_NAME, data->id.toStdString()));
+                            break;
+                        default:
+                            break;
+                    }
+                }
+                catch(const unity::LogicException&)
+                {
+                    // not set, the default value applies
+                }
             }
         }
+        catch(const unity::FileException& e)
+        {
+            qWarning() << "SettingsModel::loadSettings: Failed to read settings file:" << e.what();
+            return;
+        }
     }
-    else if (m_data_by_id.contains(setting_id))
+
+    m_values = values;
+    rememberFileState();
+}
+
+bool SettingsModel::writeSettings()
+{
+    // written to a copy which then replaces the file, so that readers never see a partial file
+    const QString tempPath = m_settings_path + QStringLiteral(".new");
+    try
     {
-        try
+        if (!QFileInfo(m_settings_path).exists() && !QFile(m_settings_path).open(QFile::WriteOnly))
         {
-            tryLoadSettings(false);
-            switch (value.type())
-            {
-                case QVariant::Bool:
-                    m_settings->set_boolean(GROUP_NAME, setting_id.toStdString(), value.toBool());
-                    break;
-                case QVariant::Int:
-                case QVariant::UInt:
-                    m_settings->set_int(GROUP_NAME, setting_id.toStdString(), value.toUInt());
-                    break;
-                case QVariant::Double:
-                    m_settings->set_double(GROUP_NAME, setting_id.toStdString(), value.toDouble());
-                    break;
-                case QVariant::String:
-                    m_settings->set_string(GROUP_NAME, setting_id.toStdString(), value.toString().toStdString());
-                    break;
-                default:
-                    qWarning() << "SettingsModel::settings_timeout: Invalid value type for setting:" << setting_id;
-            }
-            FileLock lock = unixLock(m_settings_path, true);
-            m_settings->sync(); // make sure the change to setting value is synced to fs
+            throw unity::FileException("Could not create an empty settings file at: " + m_settings_path.toStdString(), -1);
+        }
 
-            Q_EMIT settingsChanged();
+        FileLock lock = unixLock(m_settings_path, true);
+
+        // start from what's on disk, the scope may have changed other keys
+        QFile::remove(tempPath);
+        if (!QFile::copy(m_settings_path, tempPath))
+        {
+            throw unity::FileException("Could not create " + tempPath.toStdString(), -1);
         }
-        catch(const unity::FileException& e)
+
         {
-            qWarning() << "SettingsModel::settings_timeout: Failed to write settings file:" << e.what();
+            unity::util::IniParser parser(tempPath.toUtf8());
+            for (auto const& id : m_dirty)
+            {
+                QVariant const value = m_values[id];
+                switch (m_data_by_id[id]->variantType)
+                {
+                    case QVariant::Bool:
+                        parser.set_boolean(GROUP_NAME, id.toStdString(), value.toBool());
+                        break;
+                    case QVariant::UInt:
+                        parser.set_int(GROUP_NAME, id.toStdString(), value.toUInt());
+                        break;
+                    case QVariant::Double:
+                        parser.set_double(GROUP_NAME, id.toStdString(), value.toDouble());
+                        break;
+                    case QVariant::String:
+                        parser.set_string(GROUP_NAME, id.toStdString(), value.toString().toStdString());
+                        break;
+                    default:
+                        qWarning() << "SettingsModel::writeSettings: Invalid value type for setting:" << id;
+                }
+            }
+            parser.sync();
         }
-        catch(const unity::LogicException&)
+
+        if (::rename(tempPath.toUtf8(), m_settings_path.toUtf8()) != 0)
         {
-            qWarning() << "SettingsModel::settings_timeout: Failed to set a value for setting:" << setting_id;
+            throw unity::FileException("Could not replace " + m_settings_path.toStdString(), errno);
         }
     }
-    else
+    catch(const unity::FileException& e)
+    {
+        qWarning() << "SettingsModel::writeSettings: Failed to write settings file:" << e.what();
+        QFile::remove(tempPath);
+        return false;
+    }
+    catch(const unity::LogicException& e)
     {
-        qWarning() << "No such setting:" << setting_id;
+        qWarning() << "SettingsModel::writeSettings: Failed to set settings values:" << e.what();
+        QFile::remove(tempPath);
+        return false;
     }
+
+    m_fileWrites++;
+    m_dirty.clear();
+    rememberFileState();
+    watchSettingsFile();
+    return true;
 }
 
-void SettingsModel::tryLoadSettings(bool read_only) const
+void SettingsModel::settingsFileChanged()
 {
-    if (!m_settings)
+    watchSettingsFile();
+
+    QFileInfo info(m_settings_path);
+    if ((info.exists() ? info.lastModified() : QDateTime()) == m_fileModified &&
+            (info.exists() ? info.size() : -1) == m_fileSize)
+    {
+        // our own write, or something else in the directory changed
+        return;
+    }
+
+    QVariantList oldValues;
+    for (auto const& data : m_data)
+    {
+        oldValues.append(cachedValue(*data));
+    }
+
+    loadSettings();
+
+    QVector<int> roles;
+    roles.append(Roles::RoleValue);
+    for (int i = 0; i < m_data.size(); i++)
     {
-        QFileInfo checkFile(m_settings_path);
-        if (!checkFile.exists() || !checkFile.isFile())
+        if (cachedValue(*m_data[i]) != oldValues[i])
         {
-            if (read_only)
-            {
-                throw unity::FileException("Could not locate a settings file at: " + m_settings_path.toStdString(), -1);
-            }
-            // Config file does not exist, so we create an empty one.
-            else if (!QFile(m_settings_path).open(QFile::WriteOnly))
-            {
-                throw unity::FileException("Could not create an empty settings file at: " + m_settings_path.toStdString(), -1);
-            }
+            Q_EMIT dataChanged(index(i), index(i), roles);
         }
-
-        FileLock lock = unixLock(m_settings_path, false);
-        m_settings.reset(new unity::util::IniParser(m_settings_path.toUtf8()));
     }
 }
@@ -28,12 +28,18 @@
 #include <unity/util/IniParser.h>
 
 #include <QAbstractListModel>
+#include <QDateTime>
+#include <QFileSystemWatcher>
+#include <QFuture>
+#include <QHash>
 #include <QList>
+#include <QScopedPointer>
+#include <QSet>
 #include <QSharedPointer>
+#include <QTimer>
 
 QT_BEGIN_NAMESPACE
 class QDir;
-class QTimer;
 QT_END_NAMESPACE
 
 namespace scopes_ng
@@ -67,6 +73,7 @@ public:
             const QVariant& settingsDefinitions, bool isLocationGloballyEnabled = true,
             QObject* parent = 0,
             int settingsTimeout = 300);
+    ~SettingsModel();
 
     QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const
             override;
@@ -84,14 +91,28 @@ public:
 
     bool require_child_scopes_refresh() const;
 
+    // number of times the settings file was parsed / replaced
+    quint64 fileReads() const;
+    quint64 fileWrites() const;
+
 Q_SIGNALS:
     void settingsChanged();
 
 protected Q_SLOTS:
     void settings_timeout();
+    void settingsFileChanged();
 
 private:
-    void tryLoadSettings(bool read_only) const;
+    QVariant cachedValue(Data const& data) const;
+    void ensureLoaded() const;
+    void startWatching();
+    void applyChildScopes(unity::scopes::ChildScopeList const& child_scopes,
+            QMap<QString, unity::scopes::ScopeMetadata::SPtr> const& scopes_metadata);
+    QFuture<bool> sendChildScopes();
+    void loadSettings();
+    bool writeSettings();
+    void rememberFileState();
+    void watchSettingsFile();
 
 protected:
     QString m_scopeId;
@@ -101,13 +122,22 @@ protected:
     QString m_settings_path;
     QList<QSharedPointer<Data>> m_data;
     QMap<QString, QSharedPointer<Data>> m_data_by_id;
-    mutable QScopedPointer<unity::util::IniParser> m_settings;
-    QMap<QString, QSharedPointer<QTimer>> m_timers;
+
+    QHash<QString, QVariant> m_values;
+    QSet<QString> m_dirty; // changed, not written yet
+    QMap<QString, bool> m_dirty_child_scopes; // toggled, not sent to the aggregator yet
+    QTimer m_commitTimer;
+    bool m_loaded; // the file is read on first use
+    QScopedPointer<QFileSystemWatcher> m_watcher;
+    QDateTime m_fileModified; // the file as last read or written by us
+    qint64 m_fileSize;
+    quint64 m_fileReads;
+    quint64 m_fileWrites;
 
     QList<QSharedPointer<Data>> m_child_scopes_data;
     QMap<QString, QSharedPointer<Data>> m_child_scopes_data_by_id;
     unity::scopes::ChildScopeList m_child_scopes;
-    QMap<QString, QSharedPointer<QTimer>> m_child_scopes_timers;
+    quint64 m_childScopesGeneration;
     bool m_requireChildScopesRefresh;
 };
 
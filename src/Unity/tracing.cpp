@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// self
+#include "tracing.h"
+
+// Qt
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+#include <QVector>
+
+namespace scopes_ng
+{
+
+namespace
+{
+
+struct TraceEvent
+{
+    char const* category;
+    char const* name;
+    char phase; // 'X' complete, 'i' instant
+    qint64 timestamp;
+    qint64 duration;
+    quintptr thread;
+    QString arg;
+};
+
+struct TraceBuffer
+{
+    TraceBuffer(): next(0), wrapped(false), exitHandlerInstalled(false)
+    {
+        events.resize(Tracer::CAPACITY);
+    }
+
+    QMutex mutex;
+    QVector<TraceEvent> events;
+    int next;
+    bool wrapped;
+    bool exitHandlerInstalled;
+};
+
+Q_GLOBAL_STATIC(TraceBuffer, traceBuffer)
+
+QElapsedTimer const& traceClock()
+{
+    static QElapsedTimer const clock = []() {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock;
+}
+
+void writeTraceAtExit()
+{
+    const QString path = QString::fromLocal8Bit(qgetenv("UNITY_SCOPES_TRACE"));
+    if (!path.isEmpty() && Tracer::writeChromeTrace(path)) {
+        qDebug() << "Trace written to" << path;
+    }
+}
+
+void record(char const* category, char const* name, char phase, qint64 timestamp, qint64 duration, QString const& arg)
+{
+    TraceBuffer* buffer = traceBuffer();
+    if (!buffer) {
+        return; // during shutdown
+    }
+
+    const quintptr thread = reinterpret_cast<quintptr>(QThread::currentThreadId());
+
+    QMutexLocker lock(&buffer->mutex);
+    if (!buffer->exitHandlerInstalled) {
+        buffer->exitHandlerInstalled = true;
+        qAddPostRoutine(writeTraceAtExit);
+    }
+
+    TraceEvent& event = buffer->events[buffer->next];
+    event.category = category;
+    event.name = name;
+    event.phase = phase;
+    event.timestamp = timestamp;
+    event.duration = duration;
+    event.thread = thread;
+    event.arg = arg;
+
+    if (++buffer->next == buffer->events.size()) {
+        buffer->next = 0;
+        buffer->wrapped = true;
+    }
+}
+
+}
+
+const int Tracer::CAPACITY;
+QAtomicInt Tracer::s_enabled(qEnvironmentVariableIsSet("UNITY_SCOPES_TRACE") ? 1 : 0);
+
+void Tracer::setEnabled(bool enabled)
+{
+    s_enabled.store(enabled ? 1 : 0);
+}
+
+qint64 Tracer::nowUsecs()
+{
+    return traceClock().nsecsElapsed() / 1000;
+}
+
+void Tracer::instant(char const* category, char const* name, QString const& arg)
+{
+    if (isEnabled()) {
+        record(category, name, 'i', nowUsecs(), 0, arg);
+    }
+}
+
+void Tracer::complete(char const* category, char const* name, qint64 startUsecs, qint64 durationUsecs, QString const& arg)
+{
+    if (isEnabled()) {
+        record(category, name, 'X', startUsecs, durationUsecs, arg);
+    }
+}
+
+int Tracer::eventCount()
+{
+    TraceBuffer* buffer = traceBuffer();
+    QMutexLocker lock(&buffer->mutex);
+    return buffer->wrapped ? buffer->events.size() : buffer->next;
+}
+
+void Tracer::clear()
+{
+    TraceBuffer* buffer = traceBuffer();
+    QMutexLocker lock(&buffer->mutex);
+    buffer->next = 0;
+    buffer->wrapped = false;
+}
+
+QByteArray Tracer::chromeTrace()
+{
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray events;
+
+    TraceBuffer* buffer = traceBuffer();
+    {
+        QMutexLocker lock(&buffer->mutex);
+        const int count = buffer->wrapped ? buffer->events.size() : buffer->next;
+        const int first = buffer->wrapped ? buffer->next : 0;
+        for (int i = 0; i < count; i++) {
+            TraceEvent const& event = buffer->events[(first + i) % buffer->events.size()];
+            QJsonObject obj;
+            obj[QStringLiteral("cat")] = QString::fromLatin1(event.category);
+            obj[QStringLiteral("name")] = QString::fromLatin1(event.name);
+            obj[QStringLiteral("ph")] = QString(QLatin1Char(event.phase));
+            obj[QStringLiteral("ts")] = static_cast<double>(event.timestamp);
+            if (event.phase == 'X') {
+                obj[QStringLiteral("dur")] = static_cast<double>(event.duration);
+            } else {
+                obj[QStringLiteral("s")] = QStringLiteral("t");
+            }
+            obj[QStringLiteral("pid")] = static_cast<double>(pid);
+            obj[QStringLiteral("tid")] = static_cast<double>(event.thread);
+            if (!event.arg.isEmpty()) {
+                obj[QStringLiteral("args")] = QJsonObject{{QStringLiteral("arg"), event.arg}};
+            }
+            events.append(obj);
+        }
+    }
+
+    QJsonObject trace;
+    trace[QStringLiteral("traceEvents")] = events;
+    trace[QStringLiteral("displayTimeUnit")] = QStringLiteral("ms");
+    return QJsonDocument(trace).toJson(QJsonDocument::Compact);
+}
+
+bool Tracer::writeChromeTrace(QString const& path)
+{
+    const QByteArray data = chromeTrace();
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        qWarning() << "Failed to write trace to" << path << ":" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+TraceSpan::TraceSpan(char const* category, char const* name, QString const& arg)
+    : m_category(category)
+    , m_name(name)
+    , m_start(-1)
+{
+    if (Tracer::isEnabled()) {
+        m_arg = arg;
+        m_start = Tracer::nowUsecs();
+    }
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (m_start >= 0) {
+        Tracer::complete(m_category, m_name, m_start, Tracer::nowUsecs() - m_start, m_arg);
+    }
+}
+
+bool TraceSpan::isActive() const
+{
+    return m_start >= 0;
+}
+
+} // namespace scopes_ng
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NG_TRACING_H
+#define NG_TRACING_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QString>
+
+namespace scopes_ng
+{
+
+/*
+ * Ring buffer of timing events, exported in the Chrome trace event format
+ * (load it in chrome://tracing).
+ *
+ * Enabled with UNITY_SCOPES_TRACE=<file>; the trace is written to the file
+ * when the application exits. When tracing is off, every tracepoint costs
+ * a single relaxed atomic load. Category and name must be string literals.
+ */
+class Q_DECL_EXPORT Tracer
+{
+public:
+    static const int CAPACITY = 16384; // events; the oldest ones get overwritten
+
+    static bool isEnabled()
+    {
+        return s_enabled.load() != 0;
+    }
+    static void setEnabled(bool enabled);
+
+    // microseconds on the trace clock
+    static qint64 nowUsecs();
+    static void instant(char const* category, char const* name, QString const& arg = QString());
+    static void complete(char const* category, char const* name, qint64 startUsecs, qint64 durationUsecs, QString const& arg = QString());
+
+    static int eventCount();
+    static void clear();
+    static QByteArray chromeTrace();
+    static bool writeChromeTrace(QString const& path);
+
+private:
+    static QAtomicInt s_enabled;
+};
+
+// Records a complete event covering its lifetime
+class Q_DECL_EXPORT TraceSpan
+{
+public:
+    TraceSpan(char const* category, char const* name, QString const& arg = QString());
+    ~TraceSpan();
+
+    bool isActive() const;
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+
+    char const* m_category;
+    char const* m_name;
+    QString m_arg;
+    qint64 m_start; // -1 if tracing was off
+};
+
+} // namespace scopes_ng
+
+#endif // NG_TRACING_H
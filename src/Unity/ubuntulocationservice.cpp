@@ -19,8 +19,11 @@
 
 #include "ubuntulocationservice.h"
 
+#include <QDateTime>
 #include <QDebug>
 
+#include <algorithm>
+
 using namespace std;
 using namespace scopes_ng;
 
@@ -38,34 +41,51 @@ namespace
      * Re-do the GeoIP call every 60 seconds
      */
     static const int GEOIP_INTERVAL = 60000;
+
+    static const qint64 HOUR = 3600000;
+
+    /**
+     * A GeoIP result saved by a previous session is used if it's younger than this
+     */
+    static const qint64 MAX_SAVED_GEOIP_AGE = 24 * HOUR;
 }
 
+const int UbuntuLocationService::DEFAULT_MAX_FIX_AGE;
+const int UbuntuLocationService::MAX_GPS_FIX_AGE;
+
 class UbuntuLocationService::TokenImpl: public UbuntuLocationService::Token
 {
     Q_OBJECT
 
 public:
-    TokenImpl(UbuntuLocationService& locationService)
+    TokenImpl(UbuntuLocationService& locationService, int maxFixAge)
+        : m_maxFixAge(maxFixAge)
     {
-        connect(this, &TokenImpl::destroyed, &locationService, &UbuntuLocationService::enqueueDeactivate);
-        Q_EMIT locationService.enqueueActivate();
+        connect(this, &TokenImpl::released, &locationService, &UbuntuLocationService::enqueueDeactivate);
+        Q_EMIT locationService.enqueueActivate(m_maxFixAge);
     }
 
     ~TokenImpl()
     {
-        Q_EMIT destroyed();
+        Q_EMIT released(m_maxFixAge);
     }
 
 Q_SIGNALS:
-    void destroyed();
+    void released(int maxFixAge);
+
+private:
+    int m_maxFixAge;
 };
 
-UbuntuLocationService::UbuntuLocationService(const GeoIp::Ptr& geoIp)
+UbuntuLocationService::UbuntuLocationService(const GeoIp::Ptr& geoIp, QGeoPositionInfoSource* locationSource)
     : m_geoIp(geoIp)
 {
+    m_clock.start();
+
     // If the location service is disabled
     if (qEnvironmentVariableIsSet("UNITY_SCOPES_NO_LOCATION"))
     {
+        delete locationSource;
         return;
     }
 
@@ -76,7 +96,18 @@ UbuntuLocationService::UbuntuLocationService(const GeoIp::Ptr& geoIp)
     m_geoipTimer.setInterval(GEOIP_INTERVAL);
     m_geoipTimer.setTimerType(Qt::CoarseTimer);
 
-    m_locationSource = QGeoPositionInfoSource::createDefaultSource(this);
+    m_staleFixTimer.setSingleShot(true);
+    m_staleFixTimer.setTimerType(Qt::CoarseTimer);
+
+    if (locationSource)
+    {
+        m_locationSource = locationSource;
+        m_locationSource->setParent(this);
+    }
+    else
+    {
+        m_locationSource = QGeoPositionInfoSource::createDefaultSource(this);
+    }
     connect(m_locationSource, &QGeoPositionInfoSource::positionUpdated, this, &UbuntuLocationService::positionChanged);
     connect(m_locationSource, &QGeoPositionInfoSource::updateTimeout, this, &UbuntuLocationService::onPositionUpdateTimeout);
     connect(m_locationSource, SIGNAL(error(QGeoPositionInfoSource::Error)), this, SLOT(onError(QGeoPositionInfoSource::Error)));
@@ -84,30 +115,48 @@ UbuntuLocationService::UbuntuLocationService(const GeoIp::Ptr& geoIp)
     // Wire up the deactivate timer
     connect(&m_deactivateTimer, &QTimer::timeout, this, &UbuntuLocationService::update);
 
+    // The cached fix got too old for an active token
+    connect(&m_staleFixTimer, &QTimer::timeout, this, &UbuntuLocationService::update);
+
     // Wire up the network request finished timer
     connect(m_geoIp.data(), &GeoIp::finished, this, &UbuntuLocationService::requestFinished);
 
     // Wire up the GeoIP repeat timer
-    connect(&m_geoipTimer, &QTimer::timeout, m_geoIp.data(), &GeoIp::start);
+    connect(&m_geoipTimer, &QTimer::timeout, this, &UbuntuLocationService::refreshGeoIp);
 
     // Connect to signals (which will be queued)
     connect(this, &UbuntuLocationService::enqueueActivate, this, &UbuntuLocationService::doActivate, Qt::QueuedConnection);
     connect(this, &UbuntuLocationService::enqueueDeactivate, this, &UbuntuLocationService::doDeactivate, Qt::QueuedConnection);
 
-    m_geoIp->start();
+    // The last lookup serves until a new one finishes, so that startup doesn't wait for the network
+    GeoIp::Result saved;
+    qint64 savedAt;
+    if (GeoIp::loadResult(GeoIp::cachePath(), saved, savedAt))
+    {
+        const qint64 age = QDateTime::currentMSecsSinceEpoch() - savedAt;
+        if (age >= 0 && age < MAX_SAVED_GEOIP_AGE)
+        {
+            m_result = saved;
+            m_resultTime = now() - age;
+        }
+    }
+
+    refreshGeoIp();
 }
 
-void UbuntuLocationService::doActivate()
+void UbuntuLocationService::doActivate(int maxFixAge)
 {
     m_active = true;
     ++m_activationCount;
+    m_maxFixAges.append(maxFixAge);
     m_deactivateTimer.stop();
     update();
 }
 
-void UbuntuLocationService::doDeactivate()
+void UbuntuLocationService::doDeactivate(int maxFixAge)
 {
     --m_activationCount;
+    m_maxFixAges.removeOne(maxFixAge);
     if (m_activationCount < 0)
     {
         m_activationCount = 0;
@@ -118,26 +167,41 @@ void UbuntuLocationService::doDeactivate()
 
 void UbuntuLocationService::update()
 {
-    if (m_activationCount > 0)
-    {
-        // Update the GeoIp data again
-        m_geoIp->start();
-    }
-
     try
     {
         if (m_activationCount > 0)
         {
-            qDebug() << "Enabling location updates";
-            m_locationSource->startUpdates();
+            refreshGeoIp();
             m_geoipTimer.start();
+
+            if (!m_gpsRunning)
+            {
+                const qint64 maxFixAge = m_maxFixAges.isEmpty() ? DEFAULT_MAX_FIX_AGE
+                        : *std::min_element(m_maxFixAges.constBegin(), m_maxFixAges.constEnd());
+                const qint64 fixAge = gpsFixAge();
+                if (fixAge < 0 || fixAge >= maxFixAge)
+                {
+                    qDebug() << "Enabling location updates";
+                    m_staleFixTimer.stop();
+                    m_gpsRunning = true;
+                    recordEvent(m_gpsSessions);
+                    m_locationSource->startUpdates();
+                }
+                else
+                {
+                    // the cached fix is good enough for now
+                    m_staleFixTimer.start(maxFixAge - fixAge);
+                }
+            }
         }
         else
         {
             qDebug() << "Disabling location updates";
             m_active = false;
+            m_gpsRunning = false;
             m_locationSource->stopUpdates();
             m_geoipTimer.stop();
+            m_staleFixTimer.stop();
         }
     }
     catch (exception& e)
@@ -146,10 +210,73 @@ void UbuntuLocationService::update()
     }
 }
 
+void UbuntuLocationService::refreshGeoIp()
+{
+    if (m_geoIp->isRunning())
+    {
+        return;
+    }
+
+    const qint64 currentTime = now();
+    if (m_result.valid)
+    {
+        if (currentTime - m_resultTime < GEOIP_INTERVAL)
+        {
+            return;
+        }
+        // GPS is better than anything GeoIP can tell
+        const qint64 fixAge = gpsFixAge();
+        if (fixAge >= 0 && fixAge < GEOIP_INTERVAL)
+        {
+            return;
+        }
+    }
+
+    recordEvent(m_geoIpRequests);
+    m_geoIp->start();
+}
+
+qint64 UbuntuLocationService::now() const
+{
+    return m_clock.elapsed();
+}
+
+qint64 UbuntuLocationService::gpsFixAge() const
+{
+    return m_locationUpdatedAtLeastOnce ? now() - m_lastLocationTime : -1;
+}
+
+void UbuntuLocationService::recordEvent(QList<qint64>& events)
+{
+    const qint64 currentTime = now();
+    while (!events.isEmpty() && events.first() <= currentTime - HOUR)
+    {
+        events.removeFirst();
+    }
+    events.append(currentTime);
+}
+
+int UbuntuLocationService::countLastHour(QList<qint64> const& events) const
+{
+    const qint64 since = now() - HOUR;
+    return std::count_if(events.constBegin(), events.constEnd(), [since](qint64 time) { return time > since; });
+}
+
+int UbuntuLocationService::gpsSessionsPerHour() const
+{
+    return countLastHour(m_gpsSessions);
+}
+
+int UbuntuLocationService::geoIpRequestsPerHour() const
+{
+    return countLastHour(m_geoIpRequests);
+}
+
 void UbuntuLocationService::positionChanged(const QGeoPositionInfo& update)
 {
     m_locationUpdatedAtLeastOnce = true;
     m_lastLocation = update;
+    m_lastLocationTime = now();
     Q_EMIT locationChanged();
 }
 
@@ -171,8 +298,16 @@ void UbuntuLocationService::onError(QGeoPositionInfoSource::Error positioningErr
 void UbuntuLocationService::requestFinished(const GeoIp::Result& result)
 {
     qDebug() << "GeoIP request finished";
+    // a failed refresh doesn't throw away a previous result
+    if (result.valid || !m_result.valid)
     {
         m_result = result;
+        // the age is counted from when the lookup was made, so that the repeat timer isn't skipped
+        m_resultTime = m_geoIpRequests.isEmpty() ? now() : m_geoIpRequests.last();
+    }
+    if (result.valid)
+    {
+        GeoIp::saveResult(GeoIp::cachePath(), result, QDateTime::currentMSecsSinceEpoch());
     }
     Q_EMIT geoIpLookupFinished();
 }
@@ -200,8 +335,9 @@ scopes::Location UbuntuLocationService::location() const
         location.set_city(result.city.toStdString());
     }
 
-    // We need to be active, and the location session must have updated at least once
-    if (isActive() && m_locationUpdatedAtLeastOnce)
+    // A GPS fix is better than GeoIP even if it's a few minutes old, and any fix is better than nothing
+    const qint64 fixAge = gpsFixAge();
+    if (fixAge >= 0 && (fixAge < MAX_GPS_FIX_AGE || !result.valid))
     {
         location.set_latitude(m_lastLocation.coordinate().latitude());
         location.set_longitude(m_lastLocation.coordinate().longitude());
@@ -238,19 +374,19 @@ bool UbuntuLocationService::isActive() const
 
 bool UbuntuLocationService::hasLocation() const
 {
-    return m_lastLocation.isValid() || m_locationUpdatedAtLeastOnce;
+    return m_lastLocation.isValid() || m_locationUpdatedAtLeastOnce || m_result.valid;
 }
 
-QSharedPointer<UbuntuLocationService::Token> UbuntuLocationService::activate()
+QSharedPointer<UbuntuLocationService::Token> UbuntuLocationService::activate(int maxFixAge)
 {
-    return QSharedPointer<Token>(new TokenImpl(*this));
+    return QSharedPointer<Token>(new TokenImpl(*this, maxFixAge));
 }
 
 void UbuntuLocationService::requestInitialLocation()
 {
     qDebug() << "Requesting initial location update";
     m_locationSource->requestUpdate();
-    m_geoipTimer.start();
+    refreshGeoIp();
 }
 
 #include "ubuntulocationservice.moc"
@@ -23,6 +23,8 @@
 
 #include "geoip.h"
 
+#include <QElapsedTimer>
+#include <QList>
 #include <QObject>
 #include <QSharedPointer>
 #include <QTimer>
@@ -33,6 +35,12 @@
 namespace scopes_ng
 {
 
+/*
+ * Fixes are cached in tiers: a GPS fix younger than the tolerance of the active
+ * tokens is used as is, an older one is still used (and GPS restarted) for up to
+ * MAX_GPS_FIX_AGE, after that the GeoIP result is used. GeoIP isn't refreshed
+ * while there's a recent GPS fix.
+ */
 class Q_DECL_EXPORT UbuntuLocationService: public QObject
 {
     Q_OBJECT
@@ -47,11 +55,21 @@ public:
 
     class TokenImpl;
 
-    UbuntuLocationService(const GeoIp::Ptr& geoIp = GeoIp::Ptr(new GeoIp));
+    // milliseconds
+    static const int DEFAULT_MAX_FIX_AGE = 60000;
+    static const int MAX_GPS_FIX_AGE = 600000;
+
+    // takes ownership of locationSource; the default source is used if it's null
+    UbuntuLocationService(const GeoIp::Ptr& geoIp = GeoIp::Ptr(new GeoIp), QGeoPositionInfoSource* locationSource = nullptr);
     unity::scopes::Location location() const;
     bool hasLocation() const;
     bool isActive() const;
-    QSharedPointer<Token> activate();
+    // GPS is only started if the cached fix is older than maxFixAge
+    QSharedPointer<Token> activate(int maxFixAge = DEFAULT_MAX_FIX_AGE);
+
+    // sessions / requests started during the last hour
+    int gpsSessionsPerHour() const;
+    int geoIpRequestsPerHour() const;
 
 public Q_SLOTS:
     void requestInitialLocation();
@@ -67,28 +85,44 @@ Q_SIGNALS:
     void geoIpLookupFinished();
     void activeChanged();
     void accessDenied();
-    void enqueueActivate();
-    void enqueueDeactivate();
+    void enqueueActivate(int maxFixAge);
+    void enqueueDeactivate(int maxFixAge);
 
 protected Q_SLOTS:
-    void doActivate();
-    void doDeactivate();
+    void doActivate(int maxFixAge);
+    void doDeactivate(int maxFixAge);
     void update();
+    void refreshGeoIp();
     void positionChanged(const QGeoPositionInfo& update);
     void onPositionUpdateTimeout();
     void onError(QGeoPositionInfoSource::Error positioningError);
     void requestFinished(const GeoIp::Result& result);
 
 protected:
-    bool m_active;
-    QGeoPositionInfoSource *m_locationSource;
+    // monotonic milliseconds
+    virtual qint64 now() const;
+    // -1 if there's no GPS fix
+    qint64 gpsFixAge() const;
+    void recordEvent(QList<qint64>& events);
+    int countLastHour(QList<qint64> const& events) const;
+
+    bool m_active = false;
+    QGeoPositionInfoSource *m_locationSource = nullptr;
     QGeoPositionInfo m_lastLocation;
     bool m_locationUpdatedAtLeastOnce = false;
+    qint64 m_lastLocationTime = 0;
     int m_activationCount = 0;
+    QList<int> m_maxFixAges; // of the active tokens
+    bool m_gpsRunning = false;
     QTimer m_geoipTimer;
     QTimer m_deactivateTimer;
+    QTimer m_staleFixTimer;
     GeoIp::Ptr m_geoIp;
     GeoIp::Result m_result;
+    qint64 m_resultTime = 0;
+    QElapsedTimer m_clock;
+    QList<qint64> m_gpsSessions;
+    QList<qint64> m_geoIpRequests;
 };
 
 } // namespace scopes_ng
@@ -20,13 +20,45 @@
 // self
 #include "utils.h"
 
+#include <QDir>
 #include <QStringList>
 
+#include <unordered_map>
+
 namespace scopes_ng
 {
 
 using namespace unity;
 
+namespace
+{
+
+const size_t MAX_INTERNED_KEY_LENGTH = 32;
+const size_t MAX_INTERNED_KEYS = 4096;
+
+// Dictionary keys (result fields, widget attributes, setting names...) repeat a lot,
+// convert each of them once per thread and share the QString data afterwards.
+QString internedKey(std::string const& key)
+{
+    if (key.size() > MAX_INTERNED_KEY_LENGTH) {
+        return QString::fromStdString(key);
+    }
+
+    thread_local std::unordered_map<std::string, QString> keys;
+    auto it = keys.find(key);
+    if (it != keys.end()) {
+        return it->second;
+    }
+
+    QString converted(QString::fromStdString(key));
+    if (keys.size() < MAX_INTERNED_KEYS) {
+        keys.emplace(key, converted);
+    }
+    return converted;
+}
+
+}
+
 QVariant scopeVariantToQVariant(scopes::Variant const& variant)
 {
     switch (variant.which()) {
@@ -41,19 +73,21 @@ QVariant scopeVariantToQVariant(scopes::Variant const& variant)
         case scopes::Variant::Type::Double:
             return QVariant(variant.get_double());
         case scopes::Variant::Type::Dict: {
-            scopes::VariantMap dict(variant.get_dict());
+            // get_dict() returns a copy, walk it by reference from here on
+            scopes::VariantMap const dict(variant.get_dict());
             QVariantMap result_dict;
-            for (auto it = dict.begin(); it != dict.end(); ++it) {
-                result_dict.insert(QString::fromStdString(it->first), scopeVariantToQVariant(it->second));
+            for (auto const& item: dict) {
+                // std::map is sorted, so appending with an end() hint doesn't need a lookup
+                result_dict.insert(result_dict.cend(), internedKey(item.first), scopeVariantToQVariant(item.second));
             }
             return result_dict;
         }
         case scopes::Variant::Type::Array: {
-            scopes::VariantArray arr(variant.get_array());
+            scopes::VariantArray const arr(variant.get_array());
             QVariantList result_list;
             result_list.reserve(arr.size());
-            for (size_t i = 0; i < arr.size(); i++) {
-                result_list.append(scopeVariantToQVariant(arr[i]));
+            for (auto const& item: arr) {
+                result_list.append(scopeVariantToQVariant(item));
             }
             return result_list;
         }
@@ -140,4 +174,12 @@ Q_DECL_EXPORT QString uuidToString(QUuid const& uuid)
     return uuid_str;
 }
 
+Q_DECL_EXPORT QString configDir()
+{
+    if (qEnvironmentVariableIsSet("UNITY_SCOPES_CONFIG_DIR")) {
+        return QString::fromLocal8Bit(qgetenv("UNITY_SCOPES_CONFIG_DIR"));
+    }
+    return QDir::home().filePath(QStringLiteral(".config/unity-scopes"));
+}
+
 } // namespace scopes_ng
@@ -33,6 +33,7 @@ Q_DECL_EXPORT QVariant scopeVariantToQVariant(unity::scopes::Variant const& vari
 Q_DECL_EXPORT unity::scopes::Variant qVariantToScopeVariant(QVariant const& variant);
 Q_DECL_EXPORT QVariant backgroundUriToVariant(QString const& uri);
 Q_DECL_EXPORT QString uuidToString(QUuid const& uuid);
+Q_DECL_EXPORT QString configDir();
 
 } // namespace scopes_ng
 
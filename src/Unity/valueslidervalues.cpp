@@ -44,15 +44,18 @@ void ValueSliderValues::update(const unity::scopes::ValueSliderLabels& values, i
             [](const unity::scopes::ValueLabelPair& p) -> QSharedPointer<QPair<int, QString>> {
                 return QSharedPointer<QPair<int, QString>>(new QPair<int, QString>(p.first, QString::fromStdString(p.second)));
                 },
-            [this](int row, const unity::scopes::ValueLabelPair& v1, const QSharedPointer<QPair<int, QString>>& v2) -> bool {
+            [](const unity::scopes::ValueLabelPair& v1, const QSharedPointer<QPair<int, QString>>& v2, QVector<int>& roles) -> UpdateResult {
                 if (v1.first != v2->first) {
-                    return false;
+                    return Recreate;
                 }
 
-                if (v1.second != v2->second.toStdString()) {
-                    Q_EMIT dataChanged(index(row, 0), index(row, 0), { unity::shell::scopes::ValueSliderValuesInterface::Roles::RoleLabel });
+                const QString label = QString::fromStdString(v1.second);
+                if (label != v2->second) {
+                    v2->second = label;
+                    roles.append(unity::shell::scopes::ValueSliderValuesInterface::Roles::RoleLabel);
+                    return Changed;
                 }
-                return true;
+                return Unchanged;
             });
 }
 
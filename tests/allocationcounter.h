@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NG_TESTS_ALLOCATION_COUNTER_H
+#define NG_TESTS_ALLOCATION_COUNTER_H
+
+// Replaces global operator new of the test executable, so it must only be
+// included by a single translation unit.
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace allocation_counter
+{
+
+std::atomic<bool> enabled(false);
+std::atomic<long> count(0);
+
+// counts heap allocations made (by any thread) during its lifetime
+class Scope
+{
+public:
+    Scope(): m_start(count.load())
+    {
+        enabled = true;
+    }
+
+    ~Scope()
+    {
+        enabled = false;
+    }
+
+    long allocations() const
+    {
+        return count.load() - m_start;
+    }
+
+private:
+    long m_start;
+};
+
+}
+
+void* operator new(std::size_t size)
+{
+    if (allocation_counter::enabled.load(std::memory_order_relaxed)) {
+        allocation_counter::count++;
+    }
+    void* ptr = std::malloc(size ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QObject>
+#include <QSignalSpy>
+#include <QTest>
+
+#include <categories.h>
+
+#include <unity/scopes/CategoryRenderer.h>
+#include <unity/scopes/testing/Category.h>
+
+using namespace scopes_ng;
+using namespace unity;
+
+namespace
+{
+
+const char* GRID_TEMPLATE = R"({"schema-version": 1, "components": {"title": "title", "art": "art"}})";
+const char* LIST_TEMPLATE = R"({"schema-version": 1, "template": {"category-layout": "vertical-journal"}, "components": {"title": "title"}})";
+
+class CategoriesTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    static scopes::Category::SCPtr makeCategory(std::string const& title, std::string const& rendererTemplate = GRID_TEMPLATE)
+    {
+        return std::make_shared<scopes::testing::Category>("cat1", title, "", scopes::CategoryRenderer(rendererTemplate));
+    }
+
+    static void reregister(Categories& categories, scopes::Category::SCPtr const& category)
+    {
+        categories.markNewSearch();
+        categories.registerCategory(category, QSharedPointer<ResultsModel>());
+    }
+
+    static QVector<int> changedRoles(QSignalSpy const& spy)
+    {
+        return spy.last().at(2).value<QVector<int>>();
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        qRegisterMetaType<QVector<int>>();
+    }
+
+    void testUnchangedCategory()
+    {
+        Categories categories;
+        auto category = makeCategory("Category 1");
+        categories.registerCategory(category, QSharedPointer<ResultsModel>());
+        QCOMPARE(categories.rowCount(), 1);
+
+        QSignalSpy spy(&categories, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+        const quint64 compares = Categories::fullCategoryCompares();
+
+        // the same object doesn't need its query uri or template looked at
+        reregister(categories, category);
+        QCOMPARE(Categories::fullCategoryCompares(), compares);
+        QCOMPARE(spy.count(), 0);
+
+        // an equal copy is compared once, but nothing changes
+        reregister(categories, makeCategory("Category 1"));
+        QCOMPARE(Categories::fullCategoryCompares(), compares + 1);
+        QCOMPARE(spy.count(), 0);
+    }
+
+    void testChangeAfterUnchangedCategory()
+    {
+        Categories categories;
+        categories.registerCategory(makeCategory("Category 1"), QSharedPointer<ResultsModel>());
+        reregister(categories, makeCategory("Category 1"));
+
+        QSignalSpy spy(&categories, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+        reregister(categories, makeCategory("Category 2"));
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(changedRoles(spy), QVector<int>() << Categories::RoleName);
+        QCOMPARE(categories.data(categories.index(0), Categories::RoleName), QVariant(QString("Category 2")));
+
+        reregister(categories, makeCategory("Category 2"));
+        QCOMPARE(spy.count(), 1);
+
+        reregister(categories, makeCategory("Category 2", LIST_TEMPLATE));
+        QCOMPARE(spy.count(), 2);
+        QVERIFY(changedRoles(spy).contains(Categories::RoleRawRendererTemplate));
+        QVERIFY(changedRoles(spy).contains(Categories::RoleRenderer));
+        QCOMPARE(categories.data(categories.index(0), Categories::RoleRawRendererTemplate), QVariant(QString(LIST_TEMPLATE)));
+    }
+
+    void testOverriddenTemplateRestored()
+    {
+        Categories categories;
+        auto category = makeCategory("Category 1");
+        categories.registerCategory(category, QSharedPointer<ResultsModel>());
+        QVERIFY(categories.overrideCategoryJson("cat1", LIST_TEMPLATE));
+
+        // re-registering the same object brings back the template of the scope
+        QSignalSpy spy(&categories, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+        reregister(categories, category);
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(categories.data(categories.index(0), Categories::RoleRawRendererTemplate), QVariant(QString(GRID_TEMPLATE)));
+    }
+};
+
+}
+
+QTEST_GUILESS_MAIN(CategoriesTest)
+#include <categoriestest.moc>
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QObject>
+#include <QTest>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <collectors.h>
+#include <resultqueue.h>
+
+#include "allocationcounter.h"
+
+#include <unity/scopes/CategorisedResult.h>
+#include <unity/scopes/CategoryRenderer.h>
+#include <unity/scopes/testing/Category.h>
+
+using namespace scopes_ng;
+using namespace unity;
+
+namespace
+{
+
+// Plays the role of Scope on the UI thread, measures how long collecting takes
+class ChunkReceiver : public QObject
+{
+public:
+    ChunkReceiver(): events(0), stallNs(0), maxStallNs(0)
+    {
+    }
+
+    bool event(QEvent* ev) override
+    {
+        if (ev->type() != PushEvent::eventType) {
+            return QObject::event(ev);
+        }
+
+        PushEvent* pushEvent = static_cast<PushEvent*>(ev);
+        QVector<scopes::CategorisedResult::SPtr> chunk;
+        scopes::Department::SCPtr rootDepartment;
+        QList<scopes::FilterBase::SCPtr> filters;
+
+        QElapsedTimer timer;
+        timer.start();
+        pushEvent->collectSearchResults(chunk, rootDepartment, filters);
+        qint64 elapsed = timer.nsecsElapsed();
+
+        events++;
+        stallNs += elapsed;
+        maxStallNs = std::max(maxStallNs, elapsed);
+        results += chunk;
+
+        return true;
+    }
+
+    int events;
+    qint64 stallNs;
+    qint64 maxStallNs;
+    QVector<scopes::CategorisedResult::SPtr> results;
+};
+
+}
+
+class CollectorsTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    scopes::Category::SCPtr m_category;
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        m_category = std::make_shared<scopes::testing::Category>("cat1", "Category 1", "", scopes::CategoryRenderer());
+    }
+
+    void testQueueOrder()
+    {
+        ResultQueue<int> queue;
+        QVERIFY(queue.isEmpty());
+        for (int i = 0; i < 10; i++) {
+            queue.push(i);
+        }
+        QVERIFY(!queue.isEmpty());
+
+        std::vector<int> out;
+        QCOMPARE(queue.takeAll(out), 10);
+        QVERIFY(queue.isEmpty());
+        for (int i = 0; i < 10; i++) {
+            QCOMPARE(out[i], i);
+        }
+        QCOMPARE(queue.takeAll(out), 0);
+        QCOMPARE(static_cast<int>(out.size()), 10);
+    }
+
+    void testConcurrentPush_data()
+    {
+        QTest::addColumn<int>("numResults");
+        QTest::addColumn<int>("numThreads");
+
+        QTest::newRow("300 results, 1 thread") << 300 << 1;
+        QTest::newRow("300 results, 4 threads") << 300 << 4;
+        QTest::newRow("10000 results, 1 thread") << 10000 << 1;
+        QTest::newRow("10000 results, 4 threads") << 10000 << 4;
+        QTest::newRow("10000 results, 8 threads") << 10000 << 8;
+    }
+
+    void testConcurrentPush()
+    {
+        QFETCH(int, numResults);
+        QFETCH(int, numThreads);
+
+        ChunkReceiver receiver;
+        auto pushReceiver = std::make_shared<SearchResultReceiver>(&receiver);
+
+        // prepare the results upfront, so that only the collector is measured
+        std::vector<std::vector<scopes::CategorisedResult>> perThread(numThreads);
+        for (int i = 0; i < numResults; i++) {
+            scopes::CategorisedResult res(m_category);
+            res.set_uri("test:uri:" + std::to_string(i % numThreads) + ":" + std::to_string(i));
+            res.set_title("result " + std::to_string(i));
+            perThread[i % numThreads].push_back(res);
+        }
+
+        std::atomic<int> running(numThreads);
+        QElapsedTimer timer;
+        timer.start();
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < numThreads; t++) {
+            threads.emplace_back([&perThread, &running, &pushReceiver, t]() {
+                for (auto const& res : perThread[t]) {
+                    pushReceiver->push(res);
+                }
+                running--;
+            });
+        }
+
+        // the UI thread keeps draining while the producers are running
+        while (running > 0 || receiver.results.size() < numResults) {
+            QCoreApplication::sendPostedEvents(&receiver, PushEvent::eventType);
+        }
+        qint64 elapsedNs = timer.nsecsElapsed();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        QCOMPARE(receiver.results.size(), numResults);
+
+        // results pushed by a single thread must preserve their order
+        std::vector<int> lastIndex(numThreads, -1);
+        for (auto const& res : receiver.results) {
+            std::string uri = res->uri();
+            auto sep = uri.rfind(':');
+            int thread = std::stoi(uri.substr(9, sep - 9));
+            int index = std::stoi(uri.substr(sep + 1));
+            QVERIFY(index > lastIndex[thread]);
+            lastIndex[thread] = index;
+        }
+
+        qDebug() << numResults << "results from" << numThreads << "threads:"
+                 << (numResults * 1000000.0 / std::max<qint64>(elapsedNs, 1)) << "results/ms,"
+                 << receiver.events << "push events, UI thread stall" << (receiver.stallNs / 1000) << "us total,"
+                 << (receiver.maxStallNs / 1000) << "us max";
+
+        pushReceiver->invalidate();
+    }
+
+    // the results mock-scope-manyresults replies with for an empty query
+    std::vector<scopes::CategorisedResult> manyResults(int numResults)
+    {
+        std::vector<scopes::CategorisedResult> results;
+        for (int i = 0; i < numResults; i++) {
+            scopes::CategorisedResult res(m_category);
+            res.set_uri("cat1_uri" + std::to_string(i));
+            res.set_title("result5 for: \"\"");
+            results.push_back(res);
+        }
+        return results;
+    }
+
+    void testIngestionAllocations()
+    {
+        const int numResults = 2000;
+
+        ChunkReceiver receiver;
+        receiver.results.reserve(numResults);
+        auto pushReceiver = std::make_shared<SearchResultReceiver>(&receiver);
+
+        std::vector<scopes::CategorisedResult> input(manyResults(numResults));
+        long allocations;
+        {
+            allocation_counter::Scope counter;
+            for (int i = 0; i < numResults; i++) {
+                pushReceiver->push(std::move(input[i]));
+                // drain every now and then, like the UI thread would
+                if (i % 100 == 99) {
+                    QCoreApplication::sendPostedEvents(&receiver, PushEvent::eventType);
+                }
+            }
+            QCoreApplication::sendPostedEvents(&receiver, PushEvent::eventType);
+            allocations = counter.allocations();
+        }
+
+        QCOMPARE(receiver.results.size(), numResults);
+
+        // what the collector used to do: a make_shared() per result appended to a QList
+        // under the collector lock, swapped out and appended to the received results
+        std::vector<scopes::CategorisedResult> referenceInput(manyResults(numResults));
+        QList<scopes::CategorisedResult::SPtr> referenceResults;
+        long referenceAllocations;
+        {
+            QMutex mutex;
+            QList<scopes::CategorisedResult::SPtr> collected;
+            allocation_counter::Scope counter;
+            for (int i = 0; i < numResults; i++) {
+                auto result = std::make_shared<scopes::CategorisedResult>(std::move(referenceInput[i]));
+                {
+                    QMutexLocker locker(&mutex);
+                    collected.append(result);
+                }
+                if (i % 100 == 99 || i == numResults - 1) {
+                    QList<scopes::CategorisedResult::SPtr> chunk;
+                    {
+                        QMutexLocker locker(&mutex);
+                        collected.swap(chunk);
+                    }
+                    referenceResults += chunk;
+                }
+            }
+            referenceAllocations = counter.allocations();
+        }
+
+        QCOMPARE(referenceResults.size(), numResults);
+
+        // the shared_ptr holding the result is the only per-result allocation,
+        // queue nodes and result lists are amortized
+        const double perResult = static_cast<double>(allocations) / numResults;
+        const double referencePerResult = static_cast<double>(referenceAllocations) / numResults;
+        qDebug() << "Allocations per ingested result:" << perResult << "QList path:" << referencePerResult;
+        QVERIFY(perResult < 1.5);
+        QVERIFY(perResult < referencePerResult);
+
+        pushReceiver->invalidate();
+    }
+};
+
+QTEST_GUILESS_MAIN(CollectorsTest)
+#include <collectorstest.moc>
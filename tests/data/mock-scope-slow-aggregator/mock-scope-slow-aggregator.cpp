@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2014 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/scopes/CategorisedResult.h>
+#include <unity/scopes/ScopeBase.h>
+#include <unity/scopes/SearchReply.h>
+
+#include <chrono>
+#include <thread>
+
+#define EXPORT __attribute__ ((visibility ("default")))
+
+using namespace std;
+using namespace unity::scopes;
+
+// how long listing the child scopes takes
+static const chrono::milliseconds CHILD_SCOPES_DELAY(3000);
+
+class MyQuery : public SearchQueryBase
+{
+public:
+    MyQuery(CannedQuery const& query, SearchMetadata const& metadata) :
+        SearchQueryBase(query, metadata)
+    {
+    }
+
+    ~MyQuery()
+    {
+    }
+
+    virtual void cancelled() override
+    {
+    }
+
+    virtual void run(SearchReplyProxy const& reply) override
+    {
+        auto cat = reply->register_category("cat1", "Category 1", "");
+        CategorisedResult res(cat);
+        res.set_uri("test:uri");
+        res.set_title("result for: \"" + query().query_string() + "\"");
+        reply->push(res);
+    }
+};
+
+class MyScope : public ScopeBase
+{
+public:
+    MyScope()
+    {
+    }
+
+    virtual SearchQueryBase::UPtr search(CannedQuery const& q, SearchMetadata const& metadata) override
+    {
+        return SearchQueryBase::UPtr(new MyQuery(q, metadata));
+    }
+
+    virtual PreviewQueryBase::UPtr preview(Result const&, ActionMetadata const&) override
+    {
+        return nullptr;
+    }
+
+    virtual ChildScopeList find_child_scopes() const
+    {
+        this_thread::sleep_for(CHILD_SCOPES_DELAY);
+
+        ChildScopeList list;
+        list.push_back({"mock-scope", registry()->get_metadata("mock-scope"), true});
+        return list;
+    }
+};
+
+extern "C"
+{
+
+    EXPORT
+    unity::scopes::ScopeBase*
+    // cppcheck-suppress unusedFunction
+    UNITY_SCOPE_CREATE_FUNCTION()
+    {
+        return new MyScope;
+    }
+
+    EXPORT
+    void
+    // cppcheck-suppress unusedFunction
+    UNITY_SCOPE_DESTROY_FUNCTION(unity::scopes::ScopeBase* scope_base)
+    {
+        delete scope_base;
+    }
+
+}
@@ -19,7 +19,9 @@
 
 #include <unity-scopes.h>
 
+#include <chrono>
 #include <iostream>
+#include <thread>
 
 #define EXPORT __attribute__ ((visibility ("default")))
 
@@ -267,6 +269,20 @@ public:
             res1.set_title("result for: \"" + query_ + "\"");
             reply->push(res1);
         }
+        else if (query_ == "thirty-categories")
+        {
+            CategoryRenderer grid_rndr(R"({"schema-version": 1, "components": {"title": "title", "art": "art"}})");
+            CategoryRenderer list_rndr(R"({"schema-version": 1, "template": {"category-layout": "vertical-journal"}, "components": {"title": "title"}})");
+            for (int i = 0; i < 30; i++)
+            {
+                auto cat = reply->register_category("cat" + std::to_string(i), "Category " + std::to_string(i), "", i % 2 ? list_rndr : grid_rndr);
+                CategorisedResult res(cat);
+                res.set_uri("test:uri:" + std::to_string(i));
+                res.set_title("result " + std::to_string(i));
+                res.set_art("art");
+                reply->push(res);
+            }
+        }
         else if (query_ == "expansion-query")
         {
             CategoryRenderer minimal_rndr(R"({"schema-version": 1, "components": {"title": "title"}})");
@@ -744,6 +760,10 @@ class MyScope : public ScopeBase
 public:
     virtual SearchQueryBase::UPtr search(CannedQuery const& q, SearchMetadata const& metadata) override
     {
+        if (q.query_string() == "slow-dispatch") {
+            // the client is waiting for the query to be created
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        }
         SearchQueryBase::UPtr query(new MyQuery(q, metadata, settings()));
         cout << "scope-A: created query: \"" << q.query_string() << "\"" << endl;
         return query;
@@ -763,6 +783,12 @@ public:
         {
             return ActivationQueryBase::UPtr(new MyActivation(result, meta));
         }
+        else if (widget_id == "actions" && action_id == "stall")
+        {
+            // a slow scope, the client is waiting for the query to be created
+            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+            return ActivationQueryBase::UPtr(new MyActivation(result, meta));
+        }
         else if (widget_id == "actions" && action_id == "download")
         {
             MyActivation* response = new MyActivation(result, meta, ActivationResponse::ShowPreview);
@@ -21,6 +21,10 @@
 #include <QScopedPointer>
 #include <QTest>
 #include <QList>
+#include <QtGlobal>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+#include <QAbstractItemModelTester>
+#endif
 #include "filters.h"
 #include "optionselectorfilter.h"
 
@@ -220,6 +224,75 @@ private Q_SLOTS:
         QCOMPARE(filtersModel->data(idx1, unity::shell::scopes::FiltersInterface::Roles::RoleFilterId).toString(), QString("f2"));
     }
 
+    void testFiltersModelBatchedSignals()
+    {
+        QList<unity::scopes::FilterBase::SCPtr> filters;
+        for (int i = 0; i < 20; i++) {
+            auto f = unity::scopes::OptionSelectorFilter::create("f" + std::to_string(i), "Filter" + std::to_string(i), false);
+            f->add_option("o1", "Option1");
+            filters.append(f);
+        }
+        filtersModel->update(filters);
+        QCOMPARE(filtersModel->rowCount(), 20);
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+        QAbstractItemModelTester tester(filtersModel.data(), QAbstractItemModelTester::FailureReportingMode::QtTest);
+#endif
+        QSignalSpy rowsInsertedSignal(filtersModel.data(), SIGNAL(rowsInserted(const QModelIndex&, int, int)));
+        QSignalSpy rowsRemovedSignal(filtersModel.data(), SIGNAL(rowsRemoved(const QModelIndex&, int, int)));
+        QSignalSpy rowsMovedSignal(filtersModel.data(), SIGNAL(rowsMoved(const QModelIndex&, int, int, const QModelIndex&, int)));
+        QSignalSpy dataChangedSignal(filtersModel.data(), SIGNAL(dataChanged(const QModelIndex&, const QModelIndex&, const QVector<int>&)));
+
+        // same filters again, nothing to notify
+        filtersModel->update(filters);
+        QCOMPARE(rowsInsertedSignal.count(), 0);
+        QCOMPARE(rowsRemovedSignal.count(), 0);
+        QCOMPARE(rowsMovedSignal.count(), 0);
+        QCOMPARE(dataChangedSignal.count(), 0);
+
+        // drop the first 5 filters, add 5 new ones at the end and move the last 5 old ones to the front
+        QList<unity::scopes::FilterBase::SCPtr> newFilters;
+        newFilters.append(filters.mid(15));
+        newFilters.append(filters.mid(5, 10));
+        for (int i = 20; i < 25; i++) {
+            auto f = unity::scopes::OptionSelectorFilter::create("f" + std::to_string(i), "Filter" + std::to_string(i), false);
+            f->add_option("o1", "Option1");
+            newFilters.append(f);
+        }
+        filtersModel->update(newFilters);
+
+        qDebug() << "Signals emitted for 20 filter changes: removed" << rowsRemovedSignal.count() << "inserted" << rowsInsertedSignal.count()
+                 << "moved" << rowsMovedSignal.count() << "changed" << dataChangedSignal.count();
+
+        QCOMPARE(rowsRemovedSignal.count(), 1);
+        QCOMPARE(rowsInsertedSignal.count(), 1);
+        QCOMPARE(rowsMovedSignal.count(), 1);
+        QCOMPARE(dataChangedSignal.count(), 0);
+        {
+            auto args = rowsRemovedSignal.takeFirst();
+            QCOMPARE(args.at(1).toInt(), 0);
+            QCOMPARE(args.at(2).toInt(), 4);
+        }
+        {
+            auto args = rowsMovedSignal.takeFirst();
+            QCOMPARE(args.at(1).toInt(), 10);
+            QCOMPARE(args.at(2).toInt(), 14);
+            QCOMPARE(args.at(4).toInt(), 0);
+        }
+        {
+            auto args = rowsInsertedSignal.takeFirst();
+            QCOMPARE(args.at(1).toInt(), 15);
+            QCOMPARE(args.at(2).toInt(), 19);
+        }
+
+        QCOMPARE(filtersModel->rowCount(), 20);
+        for (int i = 0; i < 20; i++) {
+            auto idx = filtersModel->index(i, 0);
+            QCOMPARE(filtersModel->data(idx, unity::shell::scopes::FiltersInterface::Roles::RoleFilterId).toString(),
+                    QString::fromStdString(newFilters[i]->id()));
+        }
+    }
+
 private:
     QScopedPointer<Filters> filtersModel;
     unity::scopes::OptionSelectorFilter::SPtr f1, f2;
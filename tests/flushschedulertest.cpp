@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QObject>
+#include <QTest>
+#include <QDebug>
+
+#include <flushscheduler.h>
+
+using namespace scopes_ng;
+
+namespace
+{
+
+struct Arrival
+{
+    int ms;
+    int count;
+};
+
+struct Timeline
+{
+    QVector<Arrival> arrivals;
+    int finishedMs;
+
+    int total() const
+    {
+        int sum = 0;
+        for (auto const& arrival: arrivals) {
+            sum += arrival.count;
+        }
+        return sum;
+    }
+};
+
+struct ReplayStats
+{
+    int timeToFirstCard = -1;
+    int modelUpdates = 0;
+    int shown = 0;
+};
+
+// Replays the arrival timeline the same way Scope::processSearchChunk() drives the scheduler,
+// with a simulated flush timer.
+ReplayStats replay(FlushScheduler& scheduler, Timeline const& timeline)
+{
+    ReplayStats stats;
+    int pending = 0;
+    int deadline = scheduler.searchStarted();
+
+    auto flush = [&](int now) {
+        // Scope::flushUpdates() doesn't touch the models while there is nothing to show
+        if (pending == 0) {
+            return;
+        }
+        if (stats.shown == 0) {
+            stats.timeToFirstCard = now;
+        }
+        stats.shown += pending;
+        stats.modelUpdates++;
+        pending = 0;
+        scheduler.flushed();
+    };
+
+    for (auto const& arrival: timeline.arrivals) {
+        if (deadline >= 0 && deadline <= arrival.ms) {
+            flush(deadline);
+            deadline = -1;
+        }
+
+        pending += arrival.count;
+        const int remaining = deadline >= 0 ? deadline - arrival.ms : -1;
+        const int delay = scheduler.resultsReceived(arrival.count, pending, arrival.ms, remaining);
+        if (delay == 0) {
+            deadline = -1;
+            flush(arrival.ms);
+        } else if (delay > 0) {
+            deadline = arrival.ms + delay;
+        }
+    }
+
+    if (deadline >= 0 && deadline <= timeline.finishedMs) {
+        flush(deadline);
+    }
+    flush(timeline.finishedMs);
+
+    return stats;
+}
+
+Timeline makeTimeline(int firstMs, int intervalMs, int chunks, int chunkSize, int finishedMs)
+{
+    Timeline timeline;
+    for (int i = 0; i < chunks; i++) {
+        timeline.arrivals.append(Arrival { firstMs + i * intervalMs, chunkSize });
+    }
+    timeline.finishedMs = finishedMs;
+    return timeline;
+}
+
+}
+
+Q_DECLARE_METATYPE(Timeline)
+
+class FlushSchedulerTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testPolicyForScope()
+    {
+        QCOMPARE(FlushScheduler::policyForScope("foo", ""), QString());
+        QCOMPARE(FlushScheduler::policyForScope("foo", "adaptive"), QString("adaptive"));
+        QCOMPARE(FlushScheduler::policyForScope("foo", "delay,foo=adaptive"), QString("adaptive"));
+        QCOMPARE(FlushScheduler::policyForScope("bar", "delay,foo=adaptive"), QString("delay"));
+        QCOMPARE(FlushScheduler::policyForScope("bar", "foo=adaptive"), QString());
+
+        QCOMPARE(FlushScheduler::create("adaptive")->name(), QString("adaptive"));
+        QCOMPARE(FlushScheduler::create("delay")->name(), QString("delay"));
+        QCOMPARE(FlushScheduler::create(QString())->name(), QString("delay"));
+    }
+
+    void testDelayPolicy()
+    {
+        DelayFlushScheduler scheduler;
+        QCOMPARE(scheduler.searchStarted(), 1000);
+        // timer already running
+        QCOMPARE(scheduler.resultsReceived(1, 1, 10, 990), -1);
+        QCOMPARE(scheduler.resultsReceived(1, 1, 10, -1), 1000);
+        QCOMPARE(scheduler.resultsReceived(1, 1, 300, -1), 333);
+    }
+
+    void testReplay_data()
+    {
+        QTest::addColumn<Timeline>("timeline");
+
+        Timeline burst;
+        burst.arrivals << Arrival { 5, 100 } << Arrival { 12, 100 } << Arrival { 20, 100 };
+        burst.finishedMs = 25;
+
+        Timeline slowAggregator = makeTimeline(500, 100, 16, 10, 2100);
+        slowAggregator.arrivals.prepend(Arrival { 400, 5 });
+
+        QTest::newRow("burst") << burst;
+        QTest::newRow("trickle") << makeTimeline(50, 50, 40, 1, 2050);
+        QTest::newRow("slow aggregator") << slowAggregator;
+        QTest::newRow("single late chunk") << makeTimeline(1500, 0, 1, 300, 1510);
+        QTest::newRow("steady stream") << makeTimeline(10, 10, 100, 3, 1020);
+    }
+
+    void testReplay()
+    {
+        QFETCH(Timeline, timeline);
+
+        DelayFlushScheduler delay;
+        AdaptiveFlushScheduler adaptive;
+        const ReplayStats delayStats = replay(delay, timeline);
+        const ReplayStats adaptiveStats = replay(adaptive, timeline);
+
+        qDebug() << "delay: time to first card" << delayStats.timeToFirstCard << "ms, model updates" << delayStats.modelUpdates;
+        qDebug() << "adaptive: time to first card" << adaptiveStats.timeToFirstCard << "ms, model updates" << adaptiveStats.modelUpdates;
+
+        QCOMPARE(delayStats.shown, timeline.total());
+        QCOMPARE(adaptiveStats.shown, timeline.total());
+        QVERIFY(adaptiveStats.timeToFirstCard <= delayStats.timeToFirstCard);
+        // growing batches keep the number of updates low for long-running searches
+        QVERIFY(adaptiveStats.modelUpdates <= 6);
+    }
+};
+
+QTEST_GUILESS_MAIN(FlushSchedulerTest)
+#include <flushschedulertest.moc>
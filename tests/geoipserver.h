@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NG_TESTS_GEOIP_SERVER_H
+#define NG_TESTS_GEOIP_SERVER_H
+
+#include <QHash>
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrl>
+
+// Local stand-in for the GeoIP lookup service, answering every request with the same body.
+// No Q_OBJECT, so that the header doesn't need moc.
+class GeoIpServer : public QTcpServer
+{
+public:
+    static QByteArray response(QString const& city, double latitude, double longitude)
+    {
+        return QStringLiteral(
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+            "<Response>"
+            "<Ip>127.0.0.1</Ip>"
+            "<Status>OK</Status>"
+            "<CountryCode>GB</CountryCode>"
+            "<CountryCode3>GBR</CountryCode3>"
+            "<CountryName>United Kingdom</CountryName>"
+            "<RegionCode>H9</RegionCode>"
+            "<RegionName>London, City of</RegionName>"
+            "<City>%1</City>"
+            "<ZipPostalCode>EC1A</ZipPostalCode>"
+            "<Latitude>%2</Latitude>"
+            "<Longitude>%3</Longitude>"
+            "<AreaCode>0</AreaCode>"
+            "<TimeZone>Europe/London</TimeZone>"
+            "</Response>").arg(city).arg(latitude).arg(longitude).toUtf8();
+    }
+
+    explicit GeoIpServer(QByteArray const& body = response(QStringLiteral("London"), 51.5142, -0.0931))
+        : m_body(body), m_requests(0)
+    {
+        connect(this, &QTcpServer::newConnection, this, [this]() { accept(); });
+        listen(QHostAddress::LocalHost);
+    }
+
+    QUrl url() const
+    {
+        return QUrl(QStringLiteral("http://127.0.0.1:%1/lookup").arg(serverPort()));
+    }
+
+    void setBody(QByteArray const& body)
+    {
+        m_body = body;
+    }
+
+    int requests() const
+    {
+        return m_requests;
+    }
+
+private:
+    void accept()
+    {
+        while (QTcpSocket* socket = nextPendingConnection()) {
+            connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+                m_pending[socket] += socket->readAll();
+                if (!m_pending[socket].contains("\r\n\r\n")) {
+                    return;
+                }
+                m_pending.remove(socket);
+                m_requests++;
+
+                socket->write("HTTP/1.1 200 OK\r\n"
+                              "Content-Type: text/xml\r\n"
+                              "Connection: close\r\n"
+                              "Content-Length: " + QByteArray::number(m_body.size()) + "\r\n\r\n");
+                socket->write(m_body);
+                socket->disconnectFromHost();
+            });
+        }
+    }
+
+    QByteArray m_body;
+    QHash<QTcpSocket*, QByteArray> m_pending;
+    int m_requests;
+};
+
+#endif // NG_TESTS_GEOIP_SERVER_H
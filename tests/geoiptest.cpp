@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QFile>
+#include <QObject>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <geoip.h>
+
+#include "geoipserver.h"
+
+using namespace scopes_ng;
+
+namespace
+{
+
+class GeoIpTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    void lookup(QByteArray const& body, GeoIp::Result& result)
+    {
+        GeoIpServer server(body);
+        GeoIp geoIp(server.url());
+
+        bool finished = false;
+        connect(&geoIp, &GeoIp::finished, [&](GeoIp::Result const& r) {
+            result = r;
+            finished = true;
+        });
+        geoIp.start();
+        QTRY_VERIFY(finished);
+    }
+
+private Q_SLOTS:
+    void testParse()
+    {
+        GeoIp::Result result;
+        lookup(GeoIpServer::response(QStringLiteral("London"), 51.5142, -0.0931), result);
+        QVERIFY(result.valid);
+        QCOMPARE(result.ip, QString("127.0.0.1"));
+        QCOMPARE(result.status, QString("OK"));
+        QCOMPARE(result.countryCode, QString("GB"));
+        QCOMPARE(result.countryCode3, QString("GBR"));
+        QCOMPARE(result.countryName, QString("United Kingdom"));
+        QCOMPARE(result.regionCode, QString("H9"));
+        QCOMPARE(result.regionName, QString("London, City of"));
+        QCOMPARE(result.city, QString("London"));
+        QCOMPARE(result.zipPostalCode, QString("EC1A"));
+        QCOMPARE(result.latitude, 51.5142);
+        QCOMPARE(result.longitude, -0.0931);
+        QCOMPARE(result.areaCode, QString("0"));
+        QCOMPARE(result.timeZone, QString("Europe/London"));
+    }
+
+    void testUnknownAndEmptyElements()
+    {
+        GeoIp::Result result;
+        lookup("<Response>"
+               "<Extra><City>Nowhere</City></Extra>"
+               "<City>Cambridge</City>"
+               "<RegionName/>"
+               "<Latitude>52.2</Latitude>"
+               "<Comment>ignored</Comment>"
+               "<Longitude>0.12</Longitude>"
+               "</Response>", result);
+        QVERIFY(result.valid);
+        QCOMPARE(result.city, QString("Cambridge"));
+        QVERIFY(result.regionName.isEmpty());
+        QCOMPARE(result.latitude, 52.2);
+        QCOMPARE(result.longitude, 0.12);
+    }
+
+    void testNestedElements()
+    {
+        GeoIp::Result result;
+        lookup("<Response>"
+               "<City><x/>Cambridge</City>"
+               "<Latitude><y>1</y>52.2</Latitude>"
+               "<TimeZone>Europe/London</TimeZone>"
+               "<Longitude>0.12</Longitude>"
+               "</Response>", result);
+        QVERIFY(result.valid);
+        QCOMPARE(result.city, QString("Cambridge"));
+        QCOMPARE(result.latitude, 52.2);
+        // fields after them are still read
+        QCOMPARE(result.timeZone, QString("Europe/London"));
+        QCOMPARE(result.longitude, 0.12);
+    }
+
+    void testInvalidResponse()
+    {
+        GeoIp::Result truncated;
+        lookup("<Response><City>London</Ci", truncated);
+        QVERIFY(!truncated.valid);
+
+        GeoIp::Result unexpected;
+        lookup("<Error>no lookup for you</Error>", unexpected);
+        QVERIFY(!unexpected.valid);
+    }
+
+    void testSaveAndLoad()
+    {
+        QTemporaryDir dir;
+        const QString path = dir.path() + "/geoip.cache";
+
+        GeoIp::Result result;
+        lookup(GeoIpServer::response(QStringLiteral("London"), 51.5142, -0.0931), result);
+        QVERIFY(GeoIp::saveResult(path, result, 1234));
+
+        GeoIp::Result loaded;
+        qint64 timestamp = 0;
+        QVERIFY(GeoIp::loadResult(path, loaded, timestamp));
+        QVERIFY(loaded.valid);
+        QCOMPARE(timestamp, qint64(1234));
+        QCOMPARE(loaded.city, result.city);
+        QCOMPARE(loaded.countryName, result.countryName);
+        QCOMPARE(loaded.timeZone, result.timeZone);
+        QCOMPARE(loaded.latitude, result.latitude);
+        QCOMPARE(loaded.longitude, result.longitude);
+
+        // damaged files are ignored
+        QFile file(path);
+        QVERIFY(file.resize(file.size() / 2));
+        GeoIp::Result damaged;
+        QVERIFY(!GeoIp::loadResult(path, damaged, timestamp));
+        QVERIFY(!damaged.valid);
+
+        QVERIFY(!GeoIp::loadResult(dir.path() + "/missing", damaged, timestamp));
+    }
+};
+
+}
+
+QTEST_GUILESS_MAIN(GeoIpTest)
+#include <geoiptest.moc>
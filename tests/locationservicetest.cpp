@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QGeoPositionInfoSource>
+#include <QObject>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <geoip.h>
+#include <ubuntulocationservice.h>
+
+#include "geoipserver.h"
+
+using namespace scopes_ng;
+
+namespace
+{
+
+class FakePositionSource : public QGeoPositionInfoSource
+{
+    Q_OBJECT
+
+public:
+    FakePositionSource() : QGeoPositionInfoSource(nullptr), starts(0), stops(0)
+    {
+    }
+
+    QGeoPositionInfo lastKnownPosition(bool) const override
+    {
+        return m_position;
+    }
+
+    PositioningMethods supportedPositioningMethods() const override
+    {
+        return SatellitePositioningMethods;
+    }
+
+    int minimumUpdateInterval() const override
+    {
+        return 1000;
+    }
+
+    Error error() const override
+    {
+        return NoError;
+    }
+
+    void sendPosition(double latitude, double longitude, double accuracy)
+    {
+        m_position = QGeoPositionInfo(QGeoCoordinate(latitude, longitude), QDateTime::currentDateTime());
+        m_position.setAttribute(QGeoPositionInfo::HorizontalAccuracy, accuracy);
+        Q_EMIT positionUpdated(m_position);
+    }
+
+    int starts;
+    int stops;
+
+public Q_SLOTS:
+    void startUpdates() override
+    {
+        starts++;
+    }
+
+    void stopUpdates() override
+    {
+        stops++;
+    }
+
+    void requestUpdate(int) override
+    {
+    }
+
+private:
+    QGeoPositionInfo m_position;
+};
+
+// with a clock the test can move forward
+class TestLocationService : public UbuntuLocationService
+{
+public:
+    TestLocationService(GeoIp::Ptr const& geoIp, FakePositionSource* source)
+        : UbuntuLocationService(geoIp, source), offset(0)
+    {
+    }
+
+    // skips DEACTIVATE_INTERVAL
+    void deactivateNow()
+    {
+        QCoreApplication::processEvents();
+        m_deactivateTimer.stop();
+        update();
+    }
+
+    qint64 offset;
+
+protected:
+    qint64 now() const override
+    {
+        return UbuntuLocationService::now() + offset;
+    }
+};
+
+class LocationServiceTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    QScopedPointer<QTemporaryDir> m_configDir;
+    QScopedPointer<GeoIpServer> m_server;
+    FakePositionSource* m_source;
+    QScopedPointer<TestLocationService> m_service;
+
+    void activateAndWait(QSharedPointer<UbuntuLocationService::Token>& token, int maxFixAge = UbuntuLocationService::DEFAULT_MAX_FIX_AGE)
+    {
+        token = m_service->activate(maxFixAge);
+        QTRY_VERIFY(m_service->isActive());
+        QCoreApplication::processEvents();
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        qunsetenv("UNITY_SCOPES_NO_LOCATION");
+    }
+
+    void init()
+    {
+        // for the saved GeoIP result
+        m_configDir.reset(new QTemporaryDir);
+        qputenv("UNITY_SCOPES_CONFIG_DIR", m_configDir->path().toUtf8());
+
+        m_server.reset(new GeoIpServer);
+        QVERIFY(m_server->isListening());
+        m_source = new FakePositionSource;
+        m_service.reset(new TestLocationService(GeoIp::Ptr(new GeoIp(m_server->url())), m_source));
+
+        // the lookup made on startup
+        QSignalSpy spy(m_service.data(), SIGNAL(geoIpLookupFinished()));
+        QVERIFY(spy.wait());
+        QCOMPARE(m_server->requests(), 1);
+    }
+
+    void cleanup()
+    {
+        m_service.reset();
+        m_server.reset();
+        m_configDir.reset();
+    }
+
+    void testGeoIpTier()
+    {
+        auto location = m_service->location();
+        QCOMPARE(QString::fromStdString(location.city()), QString("London"));
+        QCOMPARE(location.latitude(), 51.5142);
+        QCOMPARE(location.horizontal_accuracy(), 100000.0);
+    }
+
+    void testSavedResultServedAtStartup()
+    {
+        QVERIFY(QFile::exists(GeoIp::cachePath()));
+
+        // the next session knows where it is before any lookup
+        GeoIpServer server(GeoIpServer::response(QStringLiteral("Paris"), 48.8566, 2.3522));
+        m_source = new FakePositionSource;
+        m_service.reset(new TestLocationService(GeoIp::Ptr(new GeoIp(server.url())), m_source));
+        QVERIFY(m_service->hasLocation());
+        QCOMPARE(QString::fromStdString(m_service->location().city()), QString("London"));
+
+        // and the saved result is recent enough to not look up again
+        QTest::qWait(100);
+        QCOMPARE(server.requests(), 0);
+
+        // until it gets old
+        QSignalSpy spy(m_service.data(), SIGNAL(geoIpLookupFinished()));
+        QSharedPointer<UbuntuLocationService::Token> token;
+        m_service->offset += 70000;
+        activateAndWait(token);
+        QVERIFY(spy.wait());
+        QCOMPARE(server.requests(), 1);
+        QCOMPARE(QString::fromStdString(m_service->location().city()), QString("Paris"));
+    }
+
+    void testCachedFixReused()
+    {
+        QSharedPointer<UbuntuLocationService::Token> token;
+        activateAndWait(token);
+        QCOMPARE(m_source->starts, 1);
+
+        m_source->sendPosition(52.2, 0.12, 10.0);
+        QCOMPARE(m_service->location().latitude(), 52.2);
+        QCOMPARE(m_service->location().horizontal_accuracy(), 10.0);
+
+        token.reset();
+        m_service->deactivateNow();
+        QVERIFY(!m_service->isActive());
+
+        // the fix is attached right away and GPS isn't restarted while it's fresh enough
+        m_service->offset += 30000;
+        QCOMPARE(m_service->location().latitude(), 52.2);
+        activateAndWait(token);
+        QCOMPARE(m_source->starts, 1);
+
+        // but a scope that wants a fresher fix gets one
+        QSharedPointer<UbuntuLocationService::Token> strictToken;
+        activateAndWait(strictToken, 10000);
+        QCOMPARE(m_source->starts, 2);
+
+        strictToken.reset();
+        token.reset();
+        m_service->deactivateNow();
+
+        // too old to be reused
+        m_service->offset += UbuntuLocationService::DEFAULT_MAX_FIX_AGE;
+        activateAndWait(token);
+        QCOMPARE(m_source->starts, 3);
+        QCOMPARE(m_service->gpsSessionsPerHour(), 3);
+
+        // and past MAX_GPS_FIX_AGE, GeoIP is better than nothing
+        token.reset();
+        m_service->deactivateNow();
+        m_service->offset += UbuntuLocationService::MAX_GPS_FIX_AGE;
+        QCOMPARE(m_service->location().horizontal_accuracy(), 100000.0);
+
+        m_service->offset += 3600000;
+        QCOMPARE(m_service->gpsSessionsPerHour(), 0);
+    }
+
+    void testOldGpsFixWithoutGeoIp()
+    {
+        // GeoIP doesn't work and there's no saved result
+        m_configDir.reset(new QTemporaryDir);
+        qputenv("UNITY_SCOPES_CONFIG_DIR", m_configDir->path().toUtf8());
+        m_server->setBody("<Error>no lookup for you</Error>");
+        m_source = new FakePositionSource;
+        m_service.reset(new TestLocationService(GeoIp::Ptr(new GeoIp(m_server->url())), m_source));
+        QSignalSpy spy(m_service.data(), SIGNAL(geoIpLookupFinished()));
+        QVERIFY(spy.wait());
+        QVERIFY(!m_service->hasLocation());
+
+        QSharedPointer<UbuntuLocationService::Token> token;
+        activateAndWait(token);
+        m_source->sendPosition(52.2, 0.12, 10.0);
+        token.reset();
+        m_service->deactivateNow();
+
+        // the old fix is still used, with its own accuracy
+        m_service->offset += UbuntuLocationService::MAX_GPS_FIX_AGE + 1000;
+        QVERIFY(m_service->hasLocation());
+        QCOMPARE(m_service->location().latitude(), 52.2);
+        QCOMPARE(m_service->location().horizontal_accuracy(), 10.0);
+    }
+
+    void testGeoIpSkippedWithRecentGpsFix()
+    {
+        QSharedPointer<UbuntuLocationService::Token> token;
+        activateAndWait(token);
+        m_source->sendPosition(52.2, 0.12, 10.0);
+        token.reset();
+        m_service->deactivateNow();
+
+        // the GeoIP result is out of date, but there's a recent GPS fix
+        m_service->offset += 70000;
+        m_source->sendPosition(52.3, 0.13, 10.0);
+        activateAndWait(token);
+        QTest::qWait(100);
+        QCOMPARE(m_server->requests(), 1);
+        QCOMPARE(m_service->geoIpRequestsPerHour(), 1);
+
+        // without one, GeoIP is asked again
+        token.reset();
+        m_service->deactivateNow();
+        m_service->offset += 70000;
+        QSignalSpy spy(m_service.data(), SIGNAL(geoIpLookupFinished()));
+        activateAndWait(token);
+        QVERIFY(spy.wait());
+        QCOMPARE(m_server->requests(), 2);
+        QCOMPARE(m_service->geoIpRequestsPerHour(), 2);
+    }
+};
+
+}
+
+QTEST_GUILESS_MAIN(LocationServiceTest)
+#include <locationservicetest.moc>
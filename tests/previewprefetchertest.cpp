@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QSignalSpy>
+#include <QScopedPointer>
+#include <QTest>
+#include <QUuid>
+
+#include <scopes.h>
+#include <scope.h>
+#include <categories.h>
+#include <previewmodel.h>
+#include <previewprefetcher.h>
+#include <resultsmodel.h>
+
+#include <scope-harness/registry/pre-existing-registry.h>
+#include <scope-harness/test-utils.h>
+
+using namespace unity::scopeharness;
+using namespace unity::scopeharness::registry;
+using namespace scopes_ng;
+namespace sc = unity::scopes;
+
+class PreviewPrefetcherTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    QScopedPointer<Scopes> m_scopes;
+    Scope::Ptr m_scope;
+    Registry::UPtr m_registry;
+
+    QSharedPointer<ResultsModel> resultsModel()
+    {
+        Categories* categories = qobject_cast<Categories*>(m_scope->categories());
+        return categories ? categories->resultsModelAt(0) : QSharedPointer<ResultsModel>();
+    }
+
+    QList<sc::Result::SPtr> results(int first, int count)
+    {
+        QList<sc::Result::SPtr> list;
+        auto model = resultsModel();
+        for (int i = first; model && i < first + count && i < model->count(); i++) {
+            list.append(model->resultAt(i));
+        }
+        return list;
+    }
+
+    void waitForQueries(PreviewPrefetcher* prefetcher)
+    {
+        QTRY_VERIFY_WITH_TIMEOUT(prefetcher->runningQueries() == 0 && prefetcher->queuedResults() == 0, 30000);
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        qputenv("UNITY_SCOPES_PREVIEW_PREFETCH", "3");
+        m_registry.reset(new PreExistingRegistry(TEST_RUNTIME_CONFIG));
+        m_registry->start();
+    }
+
+    void cleanupTestCase()
+    {
+        m_registry.reset();
+        qunsetenv("UNITY_SCOPES_PREVIEW_PREFETCH");
+    }
+
+    void init()
+    {
+        qputenv("UNITY_SCOPES_NO_PREPOPULATE_FIRST", "1");
+
+        const QStringList favs {"scope://mock-scope-manyresults"};
+        TestUtils::setFavouriteScopes(favs);
+
+        m_scopes.reset(new Scopes(nullptr));
+
+        QSignalSpy spy(m_scopes.data(), SIGNAL(loadedChanged()));
+        QVERIFY(spy.wait());
+        QCOMPARE(m_scopes->loaded(), true);
+
+        m_scope = m_scopes->getScopeById("mock-scope-manyresults");
+        QVERIFY(m_scope != nullptr);
+        QVERIFY(m_scope->previewPrefetcher() != nullptr);
+        m_scope->setActive(true);
+
+        // the first results of the top category get prefetched once the search finishes
+        TestUtils::performSearch(m_scope, "");
+        QVERIFY(resultsModel());
+        QVERIFY(resultsModel()->count() >= 100);
+        waitForQueries(m_scope->previewPrefetcher());
+    }
+
+    void cleanup()
+    {
+        m_scopes.reset();
+        m_scope.reset();
+    }
+
+    void testCacheHit()
+    {
+        auto prefetcher = m_scope->previewPrefetcher();
+        QCOMPARE(prefetcher->issuedQueries(), quint64(3));
+        QCOMPARE(prefetcher->cachedPreviews(), 3);
+        QCOMPARE(prefetcher->wastedQueries(), quint64(0));
+
+        // the prefetched preview is shown right away
+        auto model = resultsModel();
+        QScopedPointer<PreviewModel> preview(qobject_cast<PreviewModel*>(
+            m_scope->preview(QVariant::fromValue(model->resultAt(0)), QStringLiteral("cat1"))));
+        QVERIFY(preview);
+        QVERIFY(preview->loaded());
+        QCOMPARE(prefetcher->hits(), quint64(1));
+        QCOMPARE(prefetcher->cachedPreviews(), 2);
+
+        // not prefetched
+        QScopedPointer<PreviewModel> preview2(qobject_cast<PreviewModel*>(
+            m_scope->preview(QVariant::fromValue(model->resultAt(10)), QStringLiteral("cat1"))));
+        QVERIFY(preview2);
+        QVERIFY(!preview2->loaded());
+        QCOMPARE(prefetcher->misses(), quint64(1));
+        QCOMPARE(prefetcher->hitRate(), 0.5);
+
+        // a taken preview isn't served twice
+        QVERIFY(prefetcher->take(*model->resultAt(0)).isNull());
+        QCOMPARE(prefetcher->misses(), quint64(2));
+    }
+
+    void testCancelOnNewSearch()
+    {
+        auto prefetcher = m_scope->previewPrefetcher();
+        const quint64 wasted = prefetcher->wastedQueries();
+
+        prefetcher->prefetch(results(3, 90), QUuid::createUuid(), QString());
+        QCOMPARE(prefetcher->runningQueries(), PreviewPrefetcher::MAX_RUNNING_QUERIES);
+        QCOMPARE(prefetcher->queuedResults(), 90 - PreviewPrefetcher::MAX_RUNNING_QUERIES);
+
+        // a new search invalidates the last one before it goes out
+        int running = -1;
+        int queued = -1;
+        quint64 cancelled = 0;
+        auto connection = connect(m_scope.data(), &Scope::searchInProgressChanged, this, [&]() {
+            if (m_scope->searchInProgress() && running < 0) {
+                running = prefetcher->runningQueries();
+                queued = prefetcher->queuedResults();
+                cancelled = prefetcher->wastedQueries() - wasted;
+            }
+        });
+        TestUtils::performSearch(m_scope, "search1");
+        disconnect(connection);
+
+        QCOMPARE(running, 0);
+        QCOMPARE(queued, 0);
+        QVERIFY(cancelled > 0);
+        // cancelled queries were never cached
+        QVERIFY(prefetcher->issuedQueries() < quint64(3 + 90));
+    }
+
+    void testEviction()
+    {
+        auto prefetcher = m_scope->previewPrefetcher();
+        const int extra = 8;
+
+        // the first 3 are already cached and get skipped
+        prefetcher->prefetch(results(0, PreviewPrefetcher::MAX_CACHED_PREVIEWS + extra), QUuid::createUuid(), QString());
+        QCOMPARE(prefetcher->queuedResults(), PreviewPrefetcher::MAX_CACHED_PREVIEWS + extra - 3 - PreviewPrefetcher::MAX_RUNNING_QUERIES);
+        waitForQueries(prefetcher);
+
+        QCOMPARE(prefetcher->issuedQueries(), quint64(PreviewPrefetcher::MAX_CACHED_PREVIEWS + extra));
+        QCOMPARE(prefetcher->cachedPreviews(), PreviewPrefetcher::MAX_CACHED_PREVIEWS);
+        QCOMPARE(prefetcher->wastedQueries(), quint64(extra));
+
+        // the oldest ones are gone, the newest are kept
+        auto model = resultsModel();
+        for (int i = 0; i < 3; i++) {
+            QVERIFY(prefetcher->take(*model->resultAt(i)).isNull());
+        }
+        QVERIFY(!prefetcher->take(*model->resultAt(PreviewPrefetcher::MAX_CACHED_PREVIEWS + extra - 1)).isNull());
+        QCOMPARE(prefetcher->hits(), quint64(1));
+        QCOMPARE(prefetcher->misses(), quint64(3));
+    }
+};
+
+QTEST_GUILESS_MAIN(PreviewPrefetcherTest)
+#include <previewprefetchertest.moc>
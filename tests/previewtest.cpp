@@ -20,17 +20,26 @@
 #include <QObject>
 #include <QTest>
 #include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <QScopedPointer>
 #include <QSignalSpy>
 #include <QDBusConnection>
 
+#include <algorithm>
+
 #include <scopes.h>
 #include <scope.h>
 #include <categories.h>
 #include <resultsmodel.h>
 #include <previewmodel.h>
+#include <previewprefetcher.h>
 #include <previewwidgetmodel.h>
 
+#include <unity/scopes/CategorisedResult.h>
+#include <unity/scopes/CategoryRenderer.h>
+#include <unity/scopes/testing/Category.h>
+
 #include <scope-harness/matcher/category-matcher.h>
 #include <scope-harness/matcher/category-list-matcher.h>
 #include <scope-harness/matcher/preview-column-matcher.h>
@@ -57,9 +66,44 @@ private:
 
     shv::ResultsView::SPtr m_resultsView;
 
+    static sc::Result::SPtr makeResult()
+    {
+        auto category = std::make_shared<sc::testing::Category>("cat1", "Category 1", "", sc::CategoryRenderer());
+        auto result = std::make_shared<sc::CategorisedResult>(category);
+        result->set_uri("test:uri");
+        return result;
+    }
+
+    static sc::PreviewWidget textWidget(std::string const& id, std::string const& field)
+    {
+        sc::PreviewWidget widget(id, "text");
+        widget.add_attribute_mapping("text", field);
+        return widget;
+    }
+
+    // widgets and data arriving in a preview chunk
+    static QSharedPointer<scopes_ng::PrefetchedPreview> chunk(sc::PreviewWidgetList const& widgets, QHash<QString, QVariant> const& data = QHash<QString, QVariant>())
+    {
+        QSharedPointer<scopes_ng::PrefetchedPreview> preview(new scopes_ng::PrefetchedPreview);
+        preview->widgets = widgets;
+        preview->data = data;
+        return preview;
+    }
+
+    static scopes_ng::PreviewWidgetModel* columnModel(scopes_ng::PreviewModel& model)
+    {
+        return model.data(model.index(0), scopes_ng::PreviewModel::RoleColumnModel).value<scopes_ng::PreviewWidgetModel*>();
+    }
+
+    static QVariant widgetText(scopes_ng::PreviewWidgetModel* column, int row)
+    {
+        return column->data(column->index(row), scopes_ng::PreviewWidgetModel::RoleProperties).toMap().value(QStringLiteral("text"));
+    }
+
 private Q_SLOTS:
     void initTestCase()
     {
+        qRegisterMetaType<QVector<int>>();
         m_harness = sh::ScopeHarness::newFromScopeList(
             shr::CustomRegistry::Parameters({
                 TEST_DATA_DIR "mock-scope/mock-scope.ini"
@@ -368,6 +412,35 @@ private Q_SLOTS:
         QVERIFY(bool(previewView2));
     }
 
+    void testPreviewActionDoesNotBlock()
+    {
+        m_resultsView->setQuery("layout");
+
+        auto abstractView = m_resultsView->category(0).result(0).longPress();
+        QVERIFY(bool(abstractView));
+        auto previewView = dynamic_pointer_cast<shv::PreviewView>(abstractView);
+        QVERIFY(bool(previewView));
+
+        // the mock scope takes a second to create the "stall" action query,
+        // the event loop has to keep running meanwhile
+        int ticks = 0;
+        QTimer ticker;
+        ticker.setInterval(10);
+        connect(&ticker, &QTimer::timeout, [&ticks]() { ticks++; });
+        ticker.start();
+
+        QElapsedTimer timer;
+        timer.start();
+        auto sameView = previewView->widgetsInFirstColumn().at("actions").trigger("stall", sc::Variant());
+        const qint64 elapsed = timer.elapsed();
+        ticker.stop();
+
+        QCOMPARE(abstractView, sameView);
+        qDebug() << "Event loop ran" << ticks << "times during" << elapsed << "ms of stalled action";
+        QVERIFY(elapsed >= 1000);
+        QVERIFY(ticks > 50);
+    }
+
     void testPreviewUpdateViaAction()
     {
         m_resultsView->setQuery("update-preview");
@@ -691,6 +764,78 @@ private Q_SLOTS:
             .match(previewView2->widgets())
         );
     }
+    void testPreviewDataUpdatesDependentWidgets()
+    {
+        scopes_ng::PreviewModel model;
+        auto result = makeResult();
+        model.loadForResult(result, chunk({textWidget("w1", "desc"), textWidget("w2", "summary"), textWidget("w3", "desc")}));
+        auto column = columnModel(model);
+        QVERIFY(column);
+        QCOMPARE(column->rowCount(), 3);
+
+        QSignalSpy spy(column, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+        model.loadForResult(result, chunk({}, {{QStringLiteral("desc"), QStringLiteral("Description")}}));
+
+        // only the widgets mapping "desc" are touched, and only their properties
+        QCOMPARE(spy.count(), 2);
+        QList<int> rows;
+        for (auto const& args: spy) {
+            QCOMPARE(args.at(0).toModelIndex().row(), args.at(1).toModelIndex().row());
+            QCOMPARE(args.at(2).value<QVector<int>>(), QVector<int>() << scopes_ng::PreviewWidgetModel::RoleProperties);
+            rows << args.at(0).toModelIndex().row();
+        }
+        std::sort(rows.begin(), rows.end());
+        QCOMPARE(rows, QList<int>() << 0 << 2);
+        QCOMPARE(widgetText(column, 0), QVariant(QStringLiteral("Description")));
+        QVERIFY(widgetText(column, 1).isNull());
+        QCOMPARE(widgetText(column, 2), QVariant(QStringLiteral("Description")));
+    }
+
+    void testReplacedWidgetUnindexed()
+    {
+        scopes_ng::PreviewModel model;
+        auto result = makeResult();
+        model.loadForResult(result, chunk({textWidget("w1", "desc")}));
+        auto column = columnModel(model);
+        QCOMPARE(column->rowCount(), 1);
+
+        // the widget now depends on another key; the old one is gone
+        QWeakPointer<scopes_ng::PreviewWidgetData> oldWidget(column->widget(0));
+        model.update({textWidget("w1", "summary")});
+        QCOMPARE(column->rowCount(), 1);
+        QVERIFY(oldWidget.isNull());
+
+        QSignalSpy spy(column, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+        model.loadForResult(result, chunk({}, {{QStringLiteral("desc"), QStringLiteral("Description")}}));
+        QCOMPARE(spy.count(), 0);
+        QVERIFY(widgetText(column, 0).isNull());
+
+        model.loadForResult(result, chunk({}, {{QStringLiteral("summary"), QStringLiteral("Summary")}}));
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(spy.at(0).at(0).toModelIndex().row(), 0);
+        QCOMPARE(widgetText(column, 0), QVariant(QStringLiteral("Summary")));
+    }
+
+    void testIdenticalWidgetReused()
+    {
+        scopes_ng::PreviewModel model;
+        auto result = makeResult();
+        model.loadForResult(result, chunk({textWidget("w1", "desc")}, {{QStringLiteral("desc"), QStringLiteral("Description")}}));
+        auto column = columnModel(model);
+        QCOMPARE(column->rowCount(), 1);
+        auto widget = column->widget(0);
+        QCOMPARE(widget->data.value(QStringLiteral("text")), QVariant(QStringLiteral("Description")));
+
+        // the same definition keeps the widget data as it is
+        model.update({textWidget("w1", "desc")});
+        QCOMPARE(column->widget(0), widget);
+        QCOMPARE(widgetText(column, 0), QVariant(QStringLiteral("Description")));
+
+        // a different one is processed again
+        model.update({textWidget("w1", "summary")});
+        QVERIFY(column->widget(0) != widget);
+        QVERIFY(widgetText(column, 0).isNull());
+    }
 };
 
 QTEST_GUILESS_MAIN(PreviewTest)
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QObject>
+#include <QTest>
+#include <QThread>
+
+#include <string>
+
+#include <resultsetcache.h>
+
+#include <unity/scopes/CategorisedResult.h>
+#include <unity/scopes/CategoryRenderer.h>
+#include <unity/scopes/testing/Category.h>
+
+using namespace scopes_ng;
+using namespace unity;
+
+class ResultSetCacheTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    scopes::Category::SCPtr m_category;
+
+    QSharedPointer<CachedResultSet> makeResultSet(int count, std::string const& prefix = "test:uri:")
+    {
+        QSharedPointer<CachedResultSet> resultSet(new CachedResultSet);
+        for (int i = 0; i < count; i++) {
+            auto res = std::make_shared<scopes::CategorisedResult>(m_category);
+            res->set_uri(prefix + std::to_string(i));
+            res->set_title("result " + std::to_string(i));
+            resultSet->results.append(res);
+        }
+        return resultSet;
+    }
+
+    static QByteArray key(std::string const& query)
+    {
+        return ResultSetCache::key(query, "", scopes::FilterState(), QStringLiteral("phone"), QStringLiteral("C"));
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        m_category = std::make_shared<scopes::testing::Category>("cat1", "Category 1", "", scopes::CategoryRenderer());
+    }
+
+    void testKey()
+    {
+        scopes::FilterState filterState;
+        QVERIFY(key("foo") == key("foo"));
+        QVERIFY(key("foo") != key("bar"));
+        QVERIFY(ResultSetCache::key("foo", "dep", filterState, QStringLiteral("phone"), QStringLiteral("C")) !=
+                ResultSetCache::key("foo", "", filterState, QStringLiteral("phone"), QStringLiteral("C")));
+        // fields can't leak into each other
+        QVERIFY(ResultSetCache::key("ab", "c", filterState, QStringLiteral("phone"), QStringLiteral("C")) !=
+                ResultSetCache::key("a", "bc", filterState, QStringLiteral("phone"), QStringLiteral("C")));
+        QVERIFY(ResultSetCache::key("foo", "", filterState, QStringLiteral("desktop"), QStringLiteral("C")) != key("foo"));
+        QVERIFY(ResultSetCache::key("foo", "", filterState, QStringLiteral("phone"), QStringLiteral("de_DE")) != key("foo"));
+
+        scopes::Variant userData("data");
+        QVERIFY(ResultSetCache::key("foo", "", filterState, QStringLiteral("phone"), QStringLiteral("C"), &userData) != key("foo"));
+    }
+
+    void testLookup()
+    {
+        ResultSetCache cache(1024 * 1024);
+        QVERIFY(!cache.lookup(key("foo")));
+        QCOMPARE(cache.misses(), 1ull);
+
+        auto resultSet = makeResultSet(10);
+        cache.insert(key("foo"), resultSet, 0);
+        QCOMPARE(cache.size(), 1);
+        QVERIFY(cache.usedBytes() >= ResultSetCache::estimateSize(*resultSet));
+
+        auto cached = cache.lookup(key("foo"));
+        QVERIFY(cached);
+        QCOMPARE(cached->results.size(), 10);
+        QCOMPARE(cached->results[3]->uri(), std::string("test:uri:3"));
+        QCOMPARE(cache.hits(), 1ull);
+
+        // replacing an entry doesn't account for it twice
+        const qint64 used = cache.usedBytes();
+        cache.insert(key("foo"), makeResultSet(10), 0);
+        QCOMPARE(cache.usedBytes(), used);
+
+        cache.clear();
+        QCOMPARE(cache.size(), 0);
+        QCOMPARE(cache.usedBytes(), 0ll);
+        QVERIFY(!cache.lookup(key("foo")));
+    }
+
+    void testExpiry()
+    {
+        ResultSetCache cache(1024 * 1024);
+        cache.insert(key("short"), makeResultSet(5), 50);
+        cache.insert(key("forever"), makeResultSet(5), 0);
+        QVERIFY(cache.lookup(key("short")));
+
+        QThread::msleep(100);
+        QVERIFY(!cache.lookup(key("short")));
+        QCOMPARE(cache.expired(), 1ull);
+        QVERIFY(cache.lookup(key("forever")));
+        QCOMPARE(cache.size(), 1);
+    }
+
+    void testLeastRecentlyUsedEviction()
+    {
+        const qint64 entrySize = ResultSetCache::estimateSize(*makeResultSet(20)) + key("query0").size();
+        ResultSetCache cache(entrySize * 3);
+
+        cache.insert(key("query0"), makeResultSet(20), 0);
+        cache.insert(key("query1"), makeResultSet(20), 0);
+        cache.insert(key("query2"), makeResultSet(20), 0);
+        QCOMPARE(cache.size(), 3);
+
+        // query0 becomes the most recently used one
+        QVERIFY(cache.lookup(key("query0")));
+
+        cache.insert(key("query3"), makeResultSet(20), 0);
+        QCOMPARE(cache.size(), 3);
+        QCOMPARE(cache.evictions(), 1ull);
+        QVERIFY(cache.usedBytes() <= cache.maxBytes());
+        QVERIFY(!cache.lookup(key("query1")));
+        QVERIFY(cache.lookup(key("query0")));
+        QVERIFY(cache.lookup(key("query2")));
+        QVERIFY(cache.lookup(key("query3")));
+
+        // result sets larger than the whole cache are not stored at all
+        cache.insert(key("huge"), makeResultSet(100), 0);
+        QVERIFY(!cache.lookup(key("huge")));
+        QCOMPARE(cache.size(), 3);
+
+        cache.setMaxBytes(entrySize);
+        QCOMPARE(cache.size(), 1);
+        QVERIFY(cache.lookup(key("query3")));
+    }
+};
+
+QTEST_GUILESS_MAIN(ResultSetCacheTest)
+#include <resultsetcachetest.moc>
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2015 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QObject>
+#include <QTest>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+#include <resultsmap.h>
+
+#include <unity/scopes/CategorisedResult.h>
+#include <unity/scopes/CategoryRenderer.h>
+#include <unity/scopes/testing/Category.h>
+
+using namespace unity;
+
+namespace
+{
+
+typedef std::shared_ptr<scopes::CategorisedResult> ResultPtr;
+
+// The std::multimap based lookup ResultsMap used to do, kept as a reference for the benchmark
+class MultimapResultsMap
+{
+public:
+    explicit MultimapResultsMap(QVector<ResultPtr> const& results)
+    {
+        int pos = 0;
+        for (auto const& result: results) {
+            if (find(result) < 0) {
+                m_results.insert({result->uri(), { result, pos++ }});
+            }
+        }
+    }
+
+    int find(ResultPtr const& result) const
+    {
+        auto it = m_results.find(result->uri());
+        while (it != m_results.end() && it->second.first->uri() == result->uri()) {
+            if (*(it->second.first) == *result) {
+                return it->second.second;
+            }
+            ++it;
+        }
+        return -1;
+    }
+
+private:
+    std::multimap<std::string, std::pair<ResultPtr, int>> m_results;
+};
+
+}
+
+class ResultsMapTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    scopes::Category::SCPtr m_category;
+
+    ResultPtr makeResult(std::string const& uri, std::string const& title)
+    {
+        auto result = std::make_shared<scopes::CategorisedResult>(m_category);
+        result->set_uri(uri);
+        result->set_title(title);
+        result->set_art("file:///tmp/" + uri + ".png");
+        (*result)["subtitle"] = scopes::Variant("subtitle of " + title);
+        return result;
+    }
+
+    // every tenth result shares the uri with the previous one
+    QVector<ResultPtr> makeResults(int count)
+    {
+        QVector<ResultPtr> results;
+        results.reserve(count);
+        for (int i = 0; i < count; i++) {
+            const int uriIndex = (i % 10 == 9) ? i - 1 : i;
+            results.append(makeResult("uri" + std::to_string(uriIndex), "title" + std::to_string(i)));
+        }
+        return results;
+    }
+
+    // deep copies, so that lookups can't take the pointer shortcut
+    static QVector<ResultPtr> copyResults(QVector<ResultPtr> const& results)
+    {
+        QVector<ResultPtr> copies;
+        copies.reserve(results.size());
+        for (auto const& result: results) {
+            copies.append(std::make_shared<scopes::CategorisedResult>(*result));
+        }
+        return copies;
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        m_category = std::make_shared<scopes::testing::Category>("cat1", "Category 1", "", scopes::CategoryRenderer());
+    }
+
+    void testDeduplication()
+    {
+        QVector<ResultPtr> results;
+        results << makeResult("a", "A") << makeResult("b", "B") << makeResult("a", "A") << makeResult("c", "C");
+
+        ResultsMap map(results);
+        QCOMPARE(results.size(), 3);
+        QCOMPARE(map.size(), 3);
+        QCOMPARE(map.find(makeResult("a", "A")), 0);
+        QCOMPARE(map.find(makeResult("b", "B")), 1);
+        QCOMPARE(map.find(makeResult("c", "C")), 2);
+        QCOMPARE(map.find(makeResult("d", "D")), -1);
+    }
+
+    void testDuplicatedUris()
+    {
+        QVector<ResultPtr> results;
+        results << makeResult("a", "first") << makeResult("a", "second") << makeResult("b", "B");
+
+        ResultsMap map(results);
+        QCOMPARE(results.size(), 3);
+        QCOMPARE(map.find(makeResult("a", "first")), 0);
+        QCOMPARE(map.find(makeResult("a", "second")), 1);
+        QCOMPARE(map.find(makeResult("a", "third")), -1);
+    }
+
+    void testFingerprint()
+    {
+        QCOMPARE(ResultsMap::fingerprint(*makeResult("a", "A")), ResultsMap::fingerprint(*makeResult("a", "A")));
+        QVERIFY(ResultsMap::fingerprint(*makeResult("a", "A")) != ResultsMap::fingerprint(*makeResult("a", "B")));
+        QVERIFY(ResultsMap::fingerprint(*makeResult("a", "A")) != ResultsMap::fingerprint(*makeResult("b", "A")));
+    }
+
+    void testRememberedFingerprint()
+    {
+        auto plain = makeResult("a", "A");
+        auto fingerprinted = std::make_shared<FingerprintedResult>(scopes::CategorisedResult(*plain));
+        QCOMPARE(ResultsMap::fingerprint(*fingerprinted), ResultsMap::computeFingerprint(*plain));
+        // served from the result afterwards
+        QCOMPARE(ResultsMap::fingerprint(*fingerprinted), ResultsMap::fingerprint(*plain));
+
+        QVector<ResultPtr> results;
+        results << makeResult("b", "B") << fingerprinted;
+        ResultsMap map(results);
+        QCOMPARE(map.find(plain), 1);
+        QCOMPARE(map.find(fingerprinted), 1);
+    }
+
+    void testUpdateAndIndices()
+    {
+        QVector<ResultPtr> results = makeResults(100);
+        ResultsMap map;
+        map.update(results, 0);
+        QCOMPARE(map.size(), 100);
+
+        // reverse the rows and let the map catch up
+        QList<std::shared_ptr<scopes::Result>> rows;
+        for (int i = results.size() - 1; i >= 0; i--) {
+            rows.append(results[i]);
+        }
+        map.updateIndices(rows, 0, rows.size());
+        for (int i = 0; i < results.size(); i++) {
+            QCOMPARE(map.find(results[i]), results.size() - 1 - i);
+        }
+
+        map.rebuild(rows);
+        QCOMPARE(map.size(), 100);
+        QCOMPARE(map.find(results[0]), 99);
+
+        map.clear();
+        QCOMPARE(map.size(), 0);
+        QCOMPARE(map.find(results[0]), -1);
+    }
+
+    void benchmarkLookups_data()
+    {
+        QTest::addColumn<int>("count");
+
+        QTest::newRow("300 results") << 300;
+        QTest::newRow("1000 results") << 1000;
+        QTest::newRow("5000 results") << 5000;
+    }
+
+    void benchmarkLookups()
+    {
+        QFETCH(int, count);
+
+        QVector<ResultPtr> results = makeResults(count);
+        QVector<ResultPtr> incoming = copyResults(results);
+        std::shuffle(incoming.begin(), incoming.end(), std::mt19937(count));
+
+        QElapsedTimer timer;
+
+        timer.start();
+        MultimapResultsMap multimap(results);
+        int multimapFound = 0;
+        for (auto const& result: incoming) {
+            multimapFound += (multimap.find(result) >= 0);
+        }
+        const qint64 multimapNs = timer.nsecsElapsed();
+
+        timer.restart();
+        QVector<ResultPtr> input(results);
+        ResultsMap map(input);
+        int found = 0;
+        for (auto const& result: incoming) {
+            found += (map.find(result) >= 0);
+        }
+        const qint64 hashNs = timer.nsecsElapsed();
+
+        QCOMPARE(multimapFound, count);
+        QCOMPARE(found, count);
+        for (auto const& result: incoming) {
+            QCOMPARE(map.find(result), multimap.find(result));
+        }
+
+        qDebug() << count << "results: multimap" << (multimapNs / 1000) << "us, hash map" << (hashNs / 1000) << "us";
+    }
+};
+
+QTEST_GUILESS_MAIN(ResultsMapTest)
+#include <resultsmaptest.moc>
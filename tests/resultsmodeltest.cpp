@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2015 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QObject>
+#include <QTest>
+#include <QSignalSpy>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+#include <resultsmodel.h>
+
+#include <unity/scopes/CategorisedResult.h>
+#include <unity/scopes/CategoryRenderer.h>
+#include <unity/scopes/testing/Category.h>
+
+using namespace scopes_ng;
+using namespace unity;
+
+typedef QVector<std::shared_ptr<scopes::CategorisedResult>> ResultList;
+
+class ResultsModelTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    scopes::Category::SCPtr m_category;
+
+    std::shared_ptr<scopes::CategorisedResult> makeResult(int id)
+    {
+        auto result = std::make_shared<scopes::CategorisedResult>(m_category);
+        result->set_uri("uri" + std::to_string(id));
+        result->set_title("title" + std::to_string(id));
+        return result;
+    }
+
+    ResultList makeResults(QVector<int> const& ids)
+    {
+        ResultList results;
+        results.reserve(ids.size());
+        for (int id: ids) {
+            results.append(makeResult(id));
+        }
+        return results;
+    }
+
+    static QVector<int> range(int first, int count)
+    {
+        QVector<int> ids(count);
+        std::iota(ids.begin(), ids.end(), first);
+        return ids;
+    }
+
+    static QStringList modelUris(ResultsModel const& model)
+    {
+        QStringList uris;
+        for (int i = 0; i < model.rowCount(); i++) {
+            uris << model.data(model.index(i), ResultsModel::RoleUri).toString();
+        }
+        return uris;
+    }
+
+    static QStringList expectedUris(QVector<int> const& ids)
+    {
+        QStringList uris;
+        for (int id: ids) {
+            uris << QStringLiteral("uri%1").arg(id);
+        }
+        return uris;
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        m_category = std::make_shared<scopes::testing::Category>("cat1", "Category 1", "", scopes::CategoryRenderer());
+    }
+
+    void testTransitions_data()
+    {
+        QTest::addColumn<QVector<int>>("before");
+        QTest::addColumn<QVector<int>>("after");
+        QTest::addColumn<int>("expectedOperations");
+
+        QTest::newRow("unchanged") << range(0, 5) << range(0, 5) << 0;
+        QTest::newRow("removed first") << range(0, 5) << range(1, 4) << 1;
+        QTest::newRow("removed range") << range(0, 5) << (QVector<int>() << 0 << 4) << 1;
+        QTest::newRow("appended") << range(0, 5) << range(0, 8) << 1;
+        QTest::newRow("inserted range") << range(0, 3) << (QVector<int>() << 0 << 10 << 11 << 1 << 2) << 1;
+        QTest::newRow("last moved to front") << range(0, 5) << (QVector<int>() << 4 << 0 << 1 << 2 << 3) << 1;
+        QTest::newRow("first moved to back") << range(0, 5) << (QVector<int>() << 1 << 2 << 3 << 4 << 0) << 1;
+        QTest::newRow("block moved") << range(0, 6) << (QVector<int>() << 3 << 4 << 0 << 1 << 2 << 5) << 1;
+        QTest::newRow("swapped") << range(0, 2) << (QVector<int>() << 1 << 0) << 1;
+        // search1 -> search2 like transition of mock-scope-manyresults
+        QTest::newRow("mixed") << (QVector<int>() << 0 << 1 << 2 << 3 << 4) << (QVector<int>() << 5 << 3 << 0 << 6 << 2) << 5;
+    }
+
+    void testTransitions()
+    {
+        QFETCH(QVector<int>, before);
+        QFETCH(QVector<int>, after);
+        QFETCH(int, expectedOperations);
+
+        ResultsModel model;
+        ResultList initial = makeResults(before);
+        model.addResults(initial);
+        QCOMPARE(modelUris(model), expectedUris(before));
+
+        QSignalSpy insertSpy(&model, SIGNAL(rowsInserted(QModelIndex, int, int)));
+        QSignalSpy removeSpy(&model, SIGNAL(rowsRemoved(QModelIndex, int, int)));
+        QSignalSpy moveSpy(&model, SIGNAL(rowsMoved(QModelIndex, int, int, QModelIndex, int)));
+
+        model.markNewSearch();
+        ResultList updated = makeResults(after);
+        model.addUpdateResults(updated);
+
+        QCOMPARE(modelUris(model), expectedUris(after));
+        QCOMPARE(insertSpy.count() + removeSpy.count() + moveSpy.count(), expectedOperations);
+    }
+
+    void testDuplicatesAndChunks()
+    {
+        ResultsModel model;
+        ResultList initial = makeResults(range(0, 4));
+        model.addResults(initial);
+
+        model.markNewSearch();
+        // results accumulate over several chunks of the same search
+        ResultList results = makeResults(QVector<int>() << 3 << 1 << 3);
+        model.addUpdateResults(results);
+        QCOMPARE(modelUris(model), expectedUris(QVector<int>() << 3 << 1));
+
+        results += makeResults(QVector<int>() << 1 << 7 << 0);
+        model.addUpdateResults(results);
+        QCOMPARE(modelUris(model), expectedUris(QVector<int>() << 3 << 1 << 7 << 0));
+        QCOMPARE(results.size(), 4);
+    }
+
+    void testAdoptedResults()
+    {
+        ResultsModel model;
+        ResultList initial = makeResults(range(0, 4));
+        model.addResults(initial);
+
+        QSignalSpy changeSpy(&model, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+        QSignalSpy moveSpy(&model, SIGNAL(rowsMoved(QModelIndex, int, int, QModelIndex, int)));
+
+        // equal results from the live search replace the ones shown so far (e.g. from a snapshot)
+        model.markNewSearch();
+        ResultList updated = makeResults(QVector<int>() << 0 << 1 << 3 << 2);
+        updated[1] = initial[1];
+        model.addUpdateResults(updated);
+
+        QCOMPARE(modelUris(model), expectedUris(QVector<int>() << 0 << 1 << 3 << 2));
+        for (int i = 0; i < updated.size(); i++) {
+            QVERIFY(model.resultAt(i) == updated[i]);
+        }
+        QCOMPARE(moveSpy.count(), 1);
+
+        // rows 0, 2 and 3 adopted the new objects, reported before the move
+        QCOMPARE(changeSpy.count(), 2);
+        QCOMPARE(changeSpy[0][0].toModelIndex().row(), 0);
+        QCOMPARE(changeSpy[0][1].toModelIndex().row(), 0);
+        QCOMPARE(changeSpy[1][0].toModelIndex().row(), 2);
+        QCOMPARE(changeSpy[1][1].toModelIndex().row(), 3);
+        QCOMPARE(changeSpy[1][2].value<QVector<int>>(), QVector<int>() << ResultsModel::RoleResult);
+    }
+
+    void testComponentsMapping()
+    {
+        ResultsModel model;
+        QHash<QString, QString> mapping;
+        mapping[QStringLiteral("title")] = QStringLiteral("title");
+        mapping[QStringLiteral("attributes")] = QStringLiteral("attrs");
+        mapping[QStringLiteral("unknown")] = QStringLiteral("uri");
+        mapping[QStringLiteral("summary")] = QStringLiteral("uri");
+        model.setComponentsMapping(mapping);
+        model.setMaxAtrributesCount(2);
+
+        auto result = makeResult(0);
+        scopes::VariantArray attrs;
+        for (auto const& value: { "a", "b", "c" }) {
+            scopes::VariantMap attr;
+            attr["value"] = scopes::Variant(value);
+            attrs.push_back(scopes::Variant(attr));
+            attrs.push_back(scopes::Variant("not a dict"));
+        }
+        (*result)["attrs"] = scopes::Variant(attrs);
+
+        ResultList results;
+        results << result;
+        model.addResults(results);
+
+        auto idx = model.index(0);
+        QCOMPARE(model.data(idx, ResultsModel::RoleTitle).toString(), QString("title0"));
+        QCOMPARE(model.data(idx, ResultsModel::RoleSummary).toString(), QString("uri0"));
+        QVERIFY(model.data(idx, ResultsModel::RoleSubtitle).isNull());
+        QVERIFY(model.data(idx, ResultsModel::RoleBackground).isNull());
+
+        auto attributes = model.data(idx, ResultsModel::RoleAttributes).toList();
+        QCOMPARE(attributes.size(), 2);
+        QCOMPARE(attributes[0].toMap()[QStringLiteral("value")].toString(), QString("a"));
+        QCOMPARE(attributes[1].toMap()[QStringLiteral("value")].toString(), QString("b"));
+    }
+
+    void testDataCache()
+    {
+        ResultsModel model;
+        QHash<QString, QString> mapping;
+        mapping[QStringLiteral("title")] = QStringLiteral("title");
+        mapping[QStringLiteral("subtitle")] = QStringLiteral("missing");
+        model.setComponentsMapping(mapping);
+
+        ResultList results = makeResults(range(0, 3));
+        model.addResults(results);
+
+        auto idx = model.index(1);
+        QCOMPARE(model.data(idx, ResultsModel::RoleTitle).toString(), QString("title1"));
+        QVERIFY(model.data(idx, ResultsModel::RoleSubtitle).isNull());
+        QCOMPARE(model.dataCacheHits(), quint64(0));
+
+        QCOMPARE(model.data(idx, ResultsModel::RoleTitle).toString(), QString("title1"));
+        QVERIFY(model.data(idx, ResultsModel::RoleSubtitle).isNull());
+        QCOMPARE(model.dataCacheHits(), quint64(2));
+
+        // updated result gets converted again
+        scopes::Result updated(*results[1]);
+        updated.set_title("updated title");
+        model.updateResult(*results[1], updated);
+        QCOMPARE(model.data(idx, ResultsModel::RoleTitle).toString(), QString("updated title"));
+        QCOMPARE(model.dataCacheHits(), quint64(2));
+
+        // so do all the results after mapping change
+        mapping[QStringLiteral("title")] = QStringLiteral("uri");
+        model.setComponentsMapping(mapping);
+        QCOMPARE(model.data(model.index(0), ResultsModel::RoleTitle).toString(), QString("uri0"));
+        QCOMPARE(model.dataCacheHits(), quint64(2));
+
+        // rows keep their cached values when they move
+        model.markNewSearch();
+        ResultList reordered;
+        reordered << results[2] << results[0];
+        model.addUpdateResults(reordered);
+        QCOMPARE(model.data(model.index(1), ResultsModel::RoleTitle).toString(), QString("uri0"));
+        QCOMPARE(model.dataCacheHits(), quint64(3));
+    }
+
+    void benchmarkTransitions_data()
+    {
+        QTest::addColumn<int>("count");
+        QTest::addColumn<QString>("transition");
+
+        for (int count: { 300, 1000 }) {
+            for (auto const& transition: { "reversed", "rotated", "every other removed", "every other inserted", "shuffled" }) {
+                QTest::newRow(qPrintable(QStringLiteral("%1 results, %2").arg(count).arg(transition))) << count << QString(transition);
+            }
+        }
+    }
+
+    void benchmarkTransitions()
+    {
+        QFETCH(int, count);
+        QFETCH(QString, transition);
+
+        QVector<int> before = range(0, count);
+        QVector<int> after;
+        if (transition == "reversed") {
+            after = before;
+            std::reverse(after.begin(), after.end());
+        } else if (transition == "rotated") {
+            after = before;
+            std::rotate(after.begin(), after.begin() + 1, after.end());
+        } else if (transition == "every other removed") {
+            for (int i = 0; i < count; i += 2) {
+                after << i;
+            }
+        } else if (transition == "every other inserted") {
+            for (int i = 0; i < count; i++) {
+                after << i << count + i;
+            }
+        } else {
+            after = before;
+            std::shuffle(after.begin(), after.end(), std::mt19937(count));
+        }
+
+        ResultsModel model;
+        ResultList initial = makeResults(before);
+        model.addResults(initial);
+
+        QSignalSpy insertSpy(&model, SIGNAL(rowsInserted(QModelIndex, int, int)));
+        QSignalSpy removeSpy(&model, SIGNAL(rowsRemoved(QModelIndex, int, int)));
+        QSignalSpy moveSpy(&model, SIGNAL(rowsMoved(QModelIndex, int, int, QModelIndex, int)));
+
+        ResultList updated = makeResults(after);
+        QElapsedTimer timer;
+        timer.start();
+        model.markNewSearch();
+        model.addUpdateResults(updated);
+        const qint64 elapsed = timer.nsecsElapsed();
+
+        QCOMPARE(modelUris(model), expectedUris(after));
+        qDebug() << transition << count << "results:" << (elapsed / 1000) << "us," << insertSpy.count() << "inserts,"
+                 << removeSpy.count() << "removes," << moveSpy.count() << "moves";
+    }
+};
+
+QTEST_GUILESS_MAIN(ResultsModelTest)
+#include <resultsmodeltest.moc>
@@ -23,10 +23,15 @@
 #include <QSignalSpy>
 #include <QDBusConnection>
 #include <QDebug>
+#include <QElapsedTimer>
 
 #include <chrono>
 #include <cstdlib>
+#include <Unity/categories.h>
+#include <Unity/latencyhistogram.h>
+#include <Unity/querydispatcher.h>
 #include <Unity/resultsmodel.h>
+#include <Unity/scope.h>
 
 #include <unity/shell/scopes/CategoriesInterface.h>
 #include <unity/shell/scopes/ResultsModelInterface.h>
@@ -40,6 +45,8 @@
 #include <scope-harness/view/preview-view.h>
 #include <scope-harness/scope-harness.h>
 
+#include "allocationcounter.h"
+
 using namespace std;
 namespace sh = unity::scopeharness;
 namespace shm = unity::scopeharness::matcher;
@@ -241,6 +248,92 @@ private Q_SLOTS:
         );
     }
 
+    void testCategoryTemplateCache()
+    {
+        auto resultsView = m_harness->resultsView();
+        resultsView->setActiveScope("mock-scope");
+        resultsView->setQuery("");
+
+        const quint64 hits = scopes_ng::Categories::templateCacheHits();
+        const quint64 misses = scopes_ng::Categories::templateCacheMisses();
+
+        // same categories again, the templates shouldn't be parsed again
+        resultsView->setQuery("foo");
+        QVERIFY_MATCHRESULT(
+            shm::CategoryListMatcher()
+                .hasExactly(1)
+                .match(resultsView->categories())
+        );
+
+        QVERIFY(scopes_ng::Categories::templateCacheHits() > hits);
+        QCOMPARE(scopes_ng::Categories::templateCacheMisses(), misses);
+    }
+
+    void testManyCategoriesReregistration()
+    {
+        auto resultsView = m_harness->resultsView();
+        resultsView->setActiveScope("mock-scope");
+        resultsView->setQuery("thirty-categories");
+
+        QVERIFY_MATCHRESULT(
+            shm::CategoryListMatcher()
+                .hasExactly(30)
+                .match(resultsView->categories())
+        );
+
+        const quint64 misses = scopes_ng::Categories::templateCacheMisses();
+        const int searches = 10;
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < searches; i++) {
+            resultsView->forceRefresh();
+        }
+        qDebug() << "Search re-registering 30 categories took" << (timer.elapsed() / searches) << "ms on average";
+
+        QVERIFY_MATCHRESULT(
+            shm::CategoryListMatcher()
+                .hasExactly(30)
+                .match(resultsView->categories())
+        );
+        QCOMPARE(scopes_ng::Categories::templateCacheMisses(), misses);
+    }
+
+    void testSearchDispatchLatency()
+    {
+        auto resultsView = m_harness->resultsView();
+        resultsView->setActiveScope("mock-scope");
+        resultsView->setQuery("");
+
+        auto& latency = scopes_ng::Scope::searchDispatchLatency();
+        latency.reset();
+
+        // the mock scope takes 300ms to create this query
+        resultsView->setQuery("slow-dispatch");
+        QVERIFY_MATCHRESULT(
+            shm::CategoryListMatcher()
+                .hasAtLeast(1)
+                .mode(shm::CategoryListMatcher::Mode::by_id)
+                .category(shm::CategoryMatcher("cat1")
+                    .hasAtLeast(1)
+                    .mode(shm::CategoryMatcher::Mode::by_uri)
+                    .result(shm::ResultMatcher("test:uri")
+                        .title("result for: \"slow-dispatch\"")
+                    )
+                )
+                .match(resultsView->categories())
+        );
+        for (int i = 0; i < 5; i++) {
+            resultsView->forceRefresh();
+        }
+
+        qDebug() << "UI thread time per search dispatch:" << latency.toString();
+        QVERIFY(latency.count() >= 6);
+        if (!scopes_ng::QueryDispatcher::isSynchronous()) {
+            QVERIFY(latency.maxUsecs() < 150000);
+        }
+    }
+
     void testBasicResultData()
     {
         auto resultsView = m_harness->resultsView();
@@ -1407,6 +1500,30 @@ private Q_SLOTS:
 
     }
 
+    void testResultsIngestionAllocations()
+    {
+        auto resultsView = m_harness->resultsView();
+        resultsView->setActiveScope("mock-scope-manyresults");
+
+        long allocations;
+        {
+            allocation_counter::Scope counter;
+            resultsView->setQuery("lots_of_results");
+            allocations = counter.allocations();
+        }
+        QVERIFY_MATCHRESULT(
+            shm::CategoryListMatcher()
+                .hasExactly(1)
+                .category(shm::CategoryMatcher("cat1")
+                    .hasAtLeast(2000)
+                )
+                .match(resultsView->categories())
+        );
+
+        // includes deserialization of the results and the harness overhead
+        qDebug() << "Allocations per result (whole search):" << (allocations / 2000.0);
+    }
+
     void testResultsModelUpdatesRandomSearches()
     {
         // the aim of this test is to ensure no crashes; results art random and not verified
@@ -17,9 +17,13 @@
  *  Pawel Stolowski <pawel.stolowski@canonical.com>
  */
 
+#include <QElapsedTimer>
+#include <QFile>
+#include <QLocale>
 #include <QSignalSpy>
 #include <QTest>
 #include <scopes.h>
+#include <resultsnapshot.h>
 #include <scope-harness/registry/pre-existing-registry.h>
 #include <scope-harness/test-utils.h>
 
@@ -31,6 +35,37 @@ class ScopesInitTest : public QObject
 {
     Q_OBJECT
 
+private:
+    static bool firstCategoryPopulated(Scopes* scopes)
+    {
+        auto scope = scopes->getScopeByRow(0);
+        if (!scope) {
+            return false;
+        }
+        auto categories = scope->categories();
+        return categories->rowCount() > 0 &&
+            categories->data(categories->index(0), unity::shell::scopes::CategoriesInterface::RoleCount).toInt() > 0;
+    }
+
+    // milliseconds from creating the model until the first category of the first scope shows results
+    static qint64 measureStartup(QScopedPointer<Scopes>& scopes, bool& populatedOnLoad)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        scopes.reset(new Scopes(nullptr));
+
+        populatedOnLoad = false;
+        Scopes* model = scopes.data();
+        QObject::connect(model, &Scopes::loadedChanged, [model, &populatedOnLoad]() {
+            populatedOnLoad = firstCategoryPopulated(model);
+        });
+
+        while (!firstCategoryPopulated(model) && timer.elapsed() < 10000) {
+            QTest::qWait(1);
+        }
+        return firstCategoryPopulated(model) ? timer.elapsed() : -1;
+    }
+
 private Q_SLOTS:
 
     void initTestCase()
@@ -72,6 +107,80 @@ private Q_SLOTS:
         QVERIFY(scopes->overviewScope() != nullptr);
     }
 
+    void testStartupPhases()
+    {
+        QScopedPointer<Scopes> scopes(new Scopes(nullptr));
+
+        auto phaseIndex = [&scopes](QString const& phase) {
+            auto const phases = scopes->startupPhases();
+            for (int i = 0; i < phases.size(); i++) {
+                if (phases[i].first == phase) {
+                    return i;
+                }
+            }
+            return -1;
+        };
+
+        QTRY_VERIFY(phaseIndex(QStringLiteral("first-search")) >= 0);
+        // the first search can only start once the user agent is known and the model is populated
+        QVERIFY(phaseIndex(QStringLiteral("user-agent")) >= 0);
+        QVERIFY(phaseIndex(QStringLiteral("user-agent")) < phaseIndex(QStringLiteral("first-search")));
+        QVERIFY(phaseIndex(QStringLiteral("registry")) >= 0);
+        QVERIFY(phaseIndex(QStringLiteral("registry")) < phaseIndex(QStringLiteral("model")));
+        QVERIFY(phaseIndex(QStringLiteral("model")) < phaseIndex(QStringLiteral("first-search")));
+        QVERIFY(scopes->getScopeByRow(0)->initialQueryDone());
+
+        QTRY_VERIFY(!scopes->getScopeByRow(0)->searchInProgress());
+    }
+
+    void testStartupSnapshot()
+    {
+        const QString snapshotPath = ResultSnapshot::path(QStringLiteral("mock-scope-filters"));
+        QFile::remove(snapshotPath);
+
+        // cold start without a snapshot; the finished search writes one
+        QScopedPointer<Scopes> scopes;
+        bool populatedOnLoad;
+        const qint64 withoutSnapshot = measureStartup(scopes, populatedOnLoad);
+        QVERIFY(withoutSnapshot >= 0);
+        QTRY_VERIFY(!scopes->getScopeByRow(0)->searchInProgress());
+        QTRY_VERIFY(QFile::exists(snapshotPath));
+        scopes.reset();
+
+        // results are there as soon as the scope is in the model, before its first search finishes
+        const qint64 withSnapshot = measureStartup(scopes, populatedOnLoad);
+        QVERIFY(withSnapshot >= 0);
+        QVERIFY(populatedOnLoad);
+        qDebug() << "Time to first populated category:" << withoutSnapshot << "ms without snapshot," << withSnapshot << "ms with snapshot";
+
+        // and get replaced by the live search
+        QTRY_VERIFY(!scopes->getScopeByRow(0)->searchInProgress());
+        QVERIFY(firstCategoryPopulated(scopes.data()));
+
+        // refreshing with the same results doesn't write the snapshot again
+        auto scope = scopes->getScopeByRow(0);
+        scope->setActive(true);
+        QTRY_VERIFY(!scope->searchInProgress());
+        QVERIFY(QFile::remove(snapshotPath));
+        QSignalSpy spy(scope.data(), SIGNAL(searchInProgressChanged()));
+        scope->refresh();
+        QTRY_VERIFY(spy.count() >= 2 && !scope->searchInProgress());
+        QTest::qWait(500);
+        QVERIFY(!QFile::exists(snapshotPath));
+        scope.reset();
+        scopes.reset();
+
+        // write it back for the locale checks below
+        measureStartup(scopes, populatedOnLoad);
+        QTRY_VERIFY(!scopes->getScopeByRow(0)->searchInProgress());
+        QTRY_VERIFY(QFile::exists(snapshotPath));
+        scopes.reset();
+
+        // snapshots from another locale aren't used
+        QVERIFY(!ResultSnapshot::load(snapshotPath, QStringLiteral("mock-scope-filters"), QStringLiteral("de_DE")));
+        QVERIFY(ResultSnapshot::load(snapshotPath, QStringLiteral("mock-scope-filters"), QLocale::system().name()));
+    }
+
 private:
     Registry::UPtr m_registry;
 };
@@ -18,6 +18,7 @@
  *  Pawel Stolowski <pawel.stolowski@canonical.com>
  */
 
+#include <QElapsedTimer>
 #include <QTest>
 
 #include <scope-harness/scope-harness.h>
@@ -373,7 +374,8 @@ private Q_SLOTS:
 
         auto settings = resultsView->settings();
         QVERIFY(settings.get());
-        QCOMPARE(static_cast<long>(settings->count()), 4l);
+        // child scopes are listed asynchronously
+        QTRY_COMPARE(static_cast<long>(settings->count()), 4l);
 
         QVERIFY_MATCHRESULT(
                 shm::SettingsMatcher().mode(shm::SettingsMatcher::Mode::all)
@@ -408,6 +410,41 @@ private Q_SLOTS:
                     .match(settings)
                 );
     }
+
+    void testSlowChildScopes()
+    {
+        m_harness = sh::ScopeHarness::newFromScopeList(
+            shr::CustomRegistry::Parameters({
+                TEST_DATA_DIR "mock-scope-slow-aggregator/mock-scope-slow-aggregator.ini",
+                TEST_DATA_DIR "mock-scope/mock-scope.ini",
+            })
+        );
+        auto resultsView = m_harness->resultsView();
+
+        // the aggregator takes 3 seconds to list its child scopes, searches don't wait for it
+        QElapsedTimer timer;
+        timer.start();
+        resultsView->setActiveScope("mock-scope-slow-aggregator");
+        resultsView->setQuery("foo");
+        const qint64 elapsed = timer.elapsed();
+        qDebug() << "Activation and first keystroke took" << elapsed << "ms";
+        QVERIFY(elapsed < 3000);
+
+        QVERIFY_MATCHRESULT(
+            shm::CategoryListMatcher()
+                .hasAtLeast(1)
+                .category(shm::CategoryMatcher("cat1")
+                    .hasAtLeast(1)
+                    .result(shm::ResultMatcher("test:uri")
+                        .title("result for: \"foo\"")
+                    )
+                )
+                .match(resultsView->categories())
+        );
+
+        auto settings = resultsView->settings();
+        QTRY_COMPARE_WITH_TIMEOUT(static_cast<long>(settings->count()), 2l, 10000);
+    }
 };
 
 QTEST_GUILESS_MAIN(SettingsEndToEndTest)
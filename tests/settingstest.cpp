@@ -19,6 +19,7 @@
 
 #include <QJsonDocument>
 #include <QObject>
+#include <QSignalSpy>
 #include <QTemporaryDir>
 #include <QTest>
 
@@ -304,6 +305,107 @@ private Q_SLOTS:
         // Verify the initial values
         verifyValue(0, "北京京");
     }
+
+    void testValuesServedFromMemory()
+    {
+        newSettingsModel("memory", MIXED_DEFINITION);
+        setValue(0, "Banana");
+        SettingsModel* model = qobject_cast<SettingsModel*>(settings.data());
+        QTRY_COMPARE(model->fileWrites(), quint64(1));
+
+        newSettingsModel("memory", MIXED_DEFINITION);
+        model = qobject_cast<SettingsModel*>(settings.data());
+        // not read until the values are needed
+        QCOMPARE(model->fileReads(), quint64(0));
+
+        // what the settings page does when it's opened and scrolled
+        QBENCHMARK {
+            for (int i = 0; i < settings->rowCount(); i++) {
+                for (int role : {SettingsModelInterface::RoleSettingId, SettingsModelInterface::RoleDisplayName,
+                        SettingsModelInterface::RoleType, SettingsModelInterface::RoleProperties, SettingsModelInterface::RoleValue}) {
+                    settings->data(settings->index(i), role);
+                }
+                model->value(settings->data(settings->index(i), SettingsModelInterface::RoleSettingId).toString());
+            }
+        }
+        QCOMPARE(settings->data(settings->index(0), SettingsModelInterface::RoleValue), QVariant("Banana"));
+        QCOMPARE(model->fileReads(), quint64(1));
+        QCOMPARE(model->fileWrites(), quint64(0));
+    }
+
+    void testCoalescedWrite()
+    {
+        newSettingsModel("coalesced", MIXED_DEFINITION);
+        SettingsModel* model = qobject_cast<SettingsModel*>(settings.data());
+        QSignalSpy spy(model, SIGNAL(settingsChanged()));
+
+        setValue(0, "Banana");
+        setValue(1, 0);
+        setValue(2, 123);
+        setValue(3, false);
+
+        // visible before they hit the disk
+        QCOMPARE(settings->data(settings->index(0), SettingsModelInterface::RoleValue), QVariant("Banana"));
+        QCOMPARE(model->fileWrites(), quint64(0));
+
+        QTRY_COMPARE(spy.count(), 1);
+        QTest::qWait(500);
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(model->fileWrites(), quint64(1));
+    }
+
+    void testBatchedCommit()
+    {
+        QVariantList definitions;
+        for (int i = 0; i < 30; i++) {
+            QVariantMap definition;
+            definition["id"] = QString("setting%1").arg(i);
+            definition["displayName"] = QString("Setting %1").arg(i);
+            definition["type"] = "boolean";
+            definition["defaultValue"] = true;
+            definitions << definition;
+        }
+        newSettingsModel("batched", QJsonDocument::fromVariant(definitions).toJson());
+        SettingsModel* model = qobject_cast<SettingsModel*>(settings.data());
+        QSignalSpy spy(model, SIGNAL(settingsChanged()));
+
+        // several toggles of every setting in a row
+        for (int round = 0; round < 3; round++) {
+            for (int i = 0; i < settings->rowCount(); i++) {
+                setValue(i, round % 2 == 1);
+                QTest::qWait(1);
+            }
+        }
+
+        QTRY_COMPARE(spy.count(), 1);
+        QTest::qWait(500);
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(model->fileWrites(), quint64(1));
+
+        newSettingsModel("batched", QJsonDocument::fromVariant(definitions).toJson());
+        for (int i = 0; i < settings->rowCount(); i++) {
+            QCOMPARE(settings->data(settings->index(i), SettingsModelInterface::RoleValue), QVariant(false));
+        }
+    }
+
+    void testExternalChange()
+    {
+        newSettingsModel("external", MIXED_DEFINITION);
+        SettingsModel* model = qobject_cast<SettingsModel*>(settings.data());
+        QSignalSpy spy(model, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+        // the file is watched once the settings page has been shown
+        QVERIFY(settings->data(settings->index(0), SettingsModelInterface::RoleValue).isValid());
+
+        QFile file(QDir(tempDir->path()).filePath("external/settings.ini"));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("[General]\nlocationSetting=Paris\nageSetting=42\n");
+        file.close();
+
+        verifyValue(0, "Paris");
+        verifyValue(2, 42);
+        verifyValue(3, true);
+        QCOMPARE(spy.count(), 2);
+    }
 };
 
 }
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2014 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QObject>
+#include <QTest>
+#include <QThread>
+
+#include <tracing.h>
+
+using namespace scopes_ng;
+
+class TracingTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    static QJsonArray traceEvents()
+    {
+        return QJsonDocument::fromJson(Tracer::chromeTrace()).object().value(QStringLiteral("traceEvents")).toArray();
+    }
+
+private Q_SLOTS:
+    void init()
+    {
+        Tracer::clear();
+    }
+
+    void cleanup()
+    {
+        Tracer::setEnabled(false);
+    }
+
+    void testDisabled()
+    {
+        Tracer::setEnabled(false);
+        {
+            TraceSpan span("test", "span");
+            QVERIFY(!span.isActive());
+        }
+        Tracer::instant("test", "instant");
+        QCOMPARE(Tracer::eventCount(), 0);
+    }
+
+    void testChromeTrace()
+    {
+        Tracer::setEnabled(true);
+        {
+            TraceSpan span("test", "span", QStringLiteral("argument"));
+            QVERIFY(span.isActive());
+            QThread::msleep(5);
+        }
+        Tracer::instant("test", "instant");
+        QCOMPARE(Tracer::eventCount(), 2);
+
+        auto const events = traceEvents();
+        QCOMPARE(events.size(), 2);
+
+        auto const span = events[0].toObject();
+        QCOMPARE(span.value(QStringLiteral("name")).toString(), QStringLiteral("span"));
+        QCOMPARE(span.value(QStringLiteral("cat")).toString(), QStringLiteral("test"));
+        QCOMPARE(span.value(QStringLiteral("ph")).toString(), QStringLiteral("X"));
+        QVERIFY(span.value(QStringLiteral("dur")).toDouble() >= 5000);
+        QCOMPARE(span.value(QStringLiteral("args")).toObject().value(QStringLiteral("arg")).toString(), QStringLiteral("argument"));
+
+        auto const instant = events[1].toObject();
+        QCOMPARE(instant.value(QStringLiteral("ph")).toString(), QStringLiteral("i"));
+        QVERIFY(instant.value(QStringLiteral("ts")).toDouble() >= span.value(QStringLiteral("ts")).toDouble());
+    }
+
+    void testRingBuffer()
+    {
+        Tracer::setEnabled(true);
+        for (int i = 0; i < Tracer::CAPACITY + 10; i++) {
+            Tracer::complete("test", "event", i, 0);
+        }
+        QCOMPARE(Tracer::eventCount(), Tracer::CAPACITY);
+
+        // the oldest events got overwritten, the rest is in order
+        auto const events = traceEvents();
+        QCOMPARE(events.size(), Tracer::CAPACITY);
+        QCOMPARE(events.first().toObject().value(QStringLiteral("ts")).toDouble(), 10.0);
+        QCOMPARE(events.last().toObject().value(QStringLiteral("ts")).toDouble(), static_cast<double>(Tracer::CAPACITY + 9));
+    }
+};
+
+QTEST_GUILESS_MAIN(TracingTest)
+#include <tracingtest.moc>
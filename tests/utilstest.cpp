@@ -23,12 +23,73 @@
 #include <QScopedPointer>
 #include <QSignalSpy>
 
+#include <string>
+
 #include <utils.h>
 #include <unity/scopes/Variant.h>
 
 using namespace scopes_ng;
 using namespace unity;
 
+namespace
+{
+
+// the conversion as it used to be, copying every dict and array it walks
+QVariant referenceVariantToQVariant(scopes::Variant const& variant)
+{
+    switch (variant.which()) {
+        case scopes::Variant::Type::Int:
+            return QVariant(variant.get_int());
+        case scopes::Variant::Type::Bool:
+            return QVariant(variant.get_bool());
+        case scopes::Variant::Type::String:
+            return QVariant(QString::fromStdString(variant.get_string()));
+        case scopes::Variant::Type::Double:
+            return QVariant(variant.get_double());
+        case scopes::Variant::Type::Dict: {
+            scopes::VariantMap dict(variant.get_dict());
+            QVariantMap result_dict;
+            for (auto it = dict.begin(); it != dict.end(); ++it) {
+                result_dict.insert(QString::fromStdString(it->first), referenceVariantToQVariant(it->second));
+            }
+            return result_dict;
+        }
+        case scopes::Variant::Type::Array: {
+            scopes::VariantArray arr(variant.get_array());
+            QVariantList result_list;
+            for (size_t i = 0; i < arr.size(); i++) {
+                result_list.append(referenceVariantToQVariant(arr[i]));
+            }
+            return result_list;
+        }
+        default:
+            return QVariant();
+    }
+}
+
+// dict with 'width' entries per level, nested 'depth' levels deep
+scopes::Variant makePayload(int depth, int width)
+{
+    scopes::VariantMap dict;
+    for (int i = 0; i < width; i++) {
+        const std::string key("key" + std::to_string(i));
+        if (depth > 1 && i % 2 == 0) {
+            dict[key] = makePayload(depth - 1, width);
+        } else if (i % 3 == 0) {
+            scopes::VariantArray arr;
+            for (int j = 0; j < width; j++) {
+                arr.push_back(scopes::Variant("value" + std::to_string(j)));
+            }
+            dict[key] = scopes::Variant(arr);
+        } else {
+            dict[key] = scopes::Variant(i);
+        }
+    }
+    return scopes::Variant(dict);
+}
+
+}
+
 class UtilsTest : public QObject
 {
     Q_OBJECT
@@ -108,6 +169,58 @@ private Q_SLOTS:
         QCOMPARE(qVariantToScopeVariant(dict.value("last")), v3);
         QCOMPARE(qVariantToScopeVariant(dict), scopes::Variant(vm));
     }
+
+    void testDictKeyOrder()
+    {
+        scopes::VariantMap vm;
+        vm["b"] = scopes::Variant(1);
+        vm["a"] = scopes::Variant(2);
+        vm["\xc3\xa4"] = scopes::Variant(3); // a with diaeresis
+        vm["Z"] = scopes::Variant(4);
+        vm[std::string(40, 'x')] = scopes::Variant(5);
+
+        QVariantMap dict = scopeVariantToQVariant(scopes::Variant(vm)).toMap();
+        QCOMPARE(dict.size(), 5);
+        QCOMPARE(dict.keys(), QStringList() << "Z" << "a" << "b" << QString(40, 'x') << QString::fromUtf8("\xc3\xa4"));
+        QCOMPARE(dict.value(QString::fromUtf8("\xc3\xa4")).toInt(), 3);
+        QCOMPARE(dict.value(QString(40, 'x')).toInt(), 5);
+    }
+
+    void benchmarkVariantConversion_data()
+    {
+        QTest::addColumn<int>("depth");
+        QTest::addColumn<int>("width");
+        QTest::addColumn<bool>("reference");
+
+        QTest::newRow("wide") << 1 << 500 << false;
+        QTest::newRow("wide, reference") << 1 << 500 << true;
+        QTest::newRow("deep") << 8 << 4 << false;
+        QTest::newRow("deep, reference") << 8 << 4 << true;
+        QTest::newRow("deep and wide") << 4 << 16 << false;
+        QTest::newRow("deep and wide, reference") << 4 << 16 << true;
+    }
+
+    void benchmarkVariantConversion()
+    {
+        QFETCH(int, depth);
+        QFETCH(int, width);
+        QFETCH(bool, reference);
+
+        const scopes::Variant payload(makePayload(depth, width));
+        QCOMPARE(scopeVariantToQVariant(payload), referenceVariantToQVariant(payload));
+
+        QVariant converted;
+        if (reference) {
+            QBENCHMARK {
+                converted = referenceVariantToQVariant(payload);
+            }
+        } else {
+            QBENCHMARK {
+                converted = scopeVariantToQVariant(payload);
+            }
+        }
+        QVERIFY(!converted.isNull());
+    }
 };
 
 QTEST_GUILESS_MAIN(UtilsTest)